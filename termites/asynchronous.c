@@ -0,0 +1,201 @@
+#include "asynchronous.h"
+
+#include "simulation.h"
+
+
+void asynchronous_create( struct asynchronous *async,
+			  struct simulation *sim )
+{
+    assert( async != NULL );
+    assert( sim != NULL );
+    assert( sim->grid.layout != GRID_LAYOUT_SPARSE );
+
+    async->sim = sim;
+    workers_create( &async->single, 1 );
+}
+
+
+void asynchronous_destroy( struct asynchronous *async )
+{
+    assert( async != NULL );
+
+    workers_destroy( &async->single );
+    async->sim = NULL;
+}
+
+
+/**
+ * \brief Returns bit k of a plane written by other workers.
+ */
+static inline bool load( const uint64_t *plane,
+			 size_t k )
+{
+    return (__atomic_load_n( &plane[ k >> 6 ], __ATOMIC_RELAXED ) >> (k & 63)) & 1;
+}
+
+
+/**
+ * \brief Sets or clears bit k of a plane with the given memory order.
+ *
+ * \return The previous value of the bit.
+ */
+static inline bool store( uint64_t *plane,
+			  size_t k,
+			  bool value,
+			  int order )
+{
+    const uint64_t bit = UINT64_C( 1 ) << (k & 63);
+    const uint64_t old = value
+	? __atomic_fetch_or( &plane[ k >> 6 ], bit, order )
+	: __atomic_fetch_and( &plane[ k >> 6 ], ~bit, order );
+    return (old & bit) != 0;
+}
+
+
+/**
+ * \brief Sets or clears the ghost copies of the cell at (x, y).
+ */
+static inline void store_ghosts( const struct grid *grid,
+				 const enum grid_layout layout,
+				 uint64_t *plane,
+				 int x,
+				 int y,
+				 bool value )
+{
+    if( layout != GRID_LAYOUT_PADDED
+	|| (x != 0 && y != 0 && x != grid->width - 1 && y != grid->height - 1) ) {
+	return;
+    }
+    size_t ghosts[ GRID_MAX_GHOSTS ];
+    const int count = grid_get_ghosts( grid, x, y, ghosts );
+    for( int i = 0; i < count; ++i ) {
+	store( plane, ghosts[ i ], value, __ATOMIC_RELAXED );
+    }
+}
+
+
+/**
+ * \brief Advances a termite one time step on a grid shared with other
+ * workers (see struct asynchronous).
+ *
+ * Follows the rules of termite_step() and is always inlined with a
+ * constant layout, like them.
+ *
+ * \return The events of the step.
+ */
+static inline unsigned step( struct termite *term,
+			     struct grid *grid,
+			     const unsigned quarters,
+			     const enum grid_layout layout )
+{
+    int x, y;
+    termite_get_coords( term, &x, &y );
+    int direction = termite_get_direction( term );
+    bool carry = termite_carries_wood_chip( term );
+    unsigned events = 0;
+
+    /* Turn. */
+    direction = (direction + quarters) % 4;
+    events |= (quarters != 0) * COUNTERS_TURN;
+
+    /* Drop or pick up a chip (in the own cell) and turn around. */
+    const size_t here = grid_index( grid, x, y );
+    if( carry && load( grid->chips, grid_neighbor( grid, layout, x, y, here, direction ) ) ) {
+	store( grid->chips, here, true, __ATOMIC_RELAXED );
+	store_ghosts( grid, layout, grid->chips, x, y, true );
+	carry = false;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_DROP;
+    } else if( ! carry && load( grid->chips, here ) ) {
+	store_ghosts( grid, layout, grid->chips, x, y, false );
+	store( grid->chips, here, false, __ATOMIC_RELAXED );
+	carry = true;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_PICKUP;
+    }
+
+    /* Move forward, claiming the target cell. */
+    const size_t ahead = grid_neighbor( grid, layout, x, y, here, direction );
+    if( load( grid->termites, ahead ) ) {
+	events |= COUNTERS_BLOCKED_BY_TERMITE;
+    } else if( carry && load( grid->chips, ahead ) ) {
+	events |= COUNTERS_BLOCKED_BY_CHIP;
+    } else {
+	int tx = x + grid_dx[ direction ];
+	int ty = y + grid_dy[ direction ];
+	grid_wrap( grid, layout, &tx, &ty );
+	const size_t target = grid_index( grid, tx, ty );
+	if( store( grid->termites, target, true, __ATOMIC_ACQUIRE ) ) {
+	    events |= COUNTERS_BLOCKED_BY_TERMITE;
+	} else if( carry && load( grid->chips, target ) ) {
+	    store( grid->termites, target, false, __ATOMIC_RELEASE );
+	    events |= COUNTERS_BLOCKED_BY_CHIP;
+	} else {
+	    store_ghosts( grid, layout, grid->termites, tx, ty, true );
+	    store_ghosts( grid, layout, grid->termites, x, y, false );
+	    store( grid->termites, here, false, __ATOMIC_RELEASE );
+	    x = tx;
+	    y = ty;
+	    events |= COUNTERS_MOVE;
+	}
+    }
+    termite_set_state( term, x, y, direction, carry );
+    return events;
+}
+
+
+/**
+ * \brief Steps the termites of one worker (a contiguous range of
+ * indices).
+ *
+ * \param [in,out] arg The engine (struct asynchronous).
+ *
+ * \param [in] worker The index of the worker.
+ *
+ * \param [in] num_workers The number of workers.
+ */
+static void asynchronous_task( void *arg,
+			       int worker,
+			       int num_workers )
+{
+    struct asynchronous *async = (struct asynchronous*) arg;
+    struct simulation *sim = async->sim;
+    const int begin = (int) ((int64_t) sim->num_termites * worker / num_workers);
+    const int end = (int) ((int64_t) sim->num_termites * (worker + 1) / num_workers);
+    struct counters *counters = &sim->counters[ worker ];
+    struct intlist *log = sim->clusters != NULL ? clusters_log( sim->clusters, worker ) : NULL;
+
+    rng_fill_turns( sim->seed, begin, sim->step, end - begin, &sim->turns[ begin ] );
+    for( int k = begin; k < end; ++k ) {
+	struct termite *term = &sim->termites[ k ];
+	unsigned events;
+	switch( sim->grid.layout ) {
+	case GRID_LAYOUT_POW2:
+	    events = step( term, &sim->grid, sim->turns[ k ], GRID_LAYOUT_POW2 );
+	    break;
+	case GRID_LAYOUT_PADDED:
+	    events = step( term, &sim->grid, sim->turns[ k ], GRID_LAYOUT_PADDED );
+	    break;
+	default:
+	    events = step( term, &sim->grid, sim->turns[ k ], GRID_LAYOUT_GENERIC );
+	    break;
+	}
+	counters_record( counters, events );
+	if( log != NULL ) {
+	    clusters_record( log, &sim->grid, term, events );
+	}
+    }
+}
+
+
+void asynchronous_step( struct asynchronous *async,
+			struct workers *workers )
+{
+    assert( async != NULL );
+
+    if( workers == NULL ) {
+	workers = &async->single;
+    }
+    assert( workers->num_workers <= async->sim->num_threads );
+    workers_run( workers, asynchronous_task, async );
+}
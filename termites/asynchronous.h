@@ -0,0 +1,78 @@
+#pragma once
+
+#include "common.h"
+
+#include "workers.h"
+
+
+/**
+ * \brief Represents the state of the asynchronous engine.
+ *
+ * Asynchronous update.
+ *
+ * Every worker steps a contiguous range of the termites in order,
+ * without any synchronization with the other workers during the step.
+ * The grid planes are only accessed with atomic operations, and the
+ * invariants are kept by the order of those operations:
+ *
+ * - A termite moves by claiming the target cell with an atomic
+ *   fetch-or of the termite bit (acquire), which fails if another
+ *   termite got there first, and then clears its old cell (release).
+ *   Hence a cell never holds two termites.
+ *
+ * - A termite only picks up or drops the chip of its own cell, which
+ *   no other termite writes, so no chip is ever lost or duplicated. A
+ *   termite carrying a chip tests the target cell for a chip again
+ *   after claiming it (a termite might have dropped one there in the
+ *   meantime) and stays if there is one, so carrying termites never
+ *   stand on a chip.
+ *
+ * - For the padded layout, ghost copies are set after claiming a cell
+ *   and cleared before releasing it.
+ *
+ * The termites of different workers interleave arbitrarily, so with
+ * more than one worker the result is not deterministic. With one
+ * worker the result equals that of the scalar engine.
+ */
+struct asynchronous
+{
+    /** \brief The simulation being stepped. */
+    struct simulation *sim;
+
+    /** \brief A team of one worker, used if no team is passed. */
+    struct workers single;
+};
+
+
+/**
+ * \brief Creates the asynchronous engine for a simulation.
+ *
+ * The grid must not have the sparse layout.
+ *
+ * \param [out] async
+ *
+ * \param [in,out] sim
+ */
+void asynchronous_create( struct asynchronous *async,
+			  struct simulation *sim );
+
+
+/**
+ * \brief Destroys the engine, releasing all resources.
+ *
+ * \param [in,out] async
+ */
+void asynchronous_destroy( struct asynchronous *async );
+
+
+/**
+ * \brief Advances the simulation one time step with the workers
+ * stepping their termites concurrently.
+ *
+ * \param [in,out] async
+ *
+ * \param [in,out] workers The team to step on, with one worker per
+ * thread of the simulation, or NULL to step sequentially.
+ */
+void asynchronous_step( struct asynchronous *async,
+			struct workers *workers );
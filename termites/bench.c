@@ -0,0 +1,305 @@
+#include "common.h"
+
+#include "simulation.h"
+
+
+
+
+/**
+ * \brief The largest number of values in a list option.
+ */
+#define BENCH_MAX_VALUES 16
+
+
+/**
+ * \brief A list of values given on the command line as a comma
+ * separated list.
+ */
+struct bench_list
+{
+    /** \brief The number of values. */
+    int count;
+
+    /** \brief The values. */
+    double value[ BENCH_MAX_VALUES ];
+};
+
+
+
+/**
+ * \brief Prints usage information and exits the program.
+ *
+ * \param [in] program The name of the program.
+ */
+static void usage( const char *program )
+{
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "Usage: %s [options]\n", program );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "Times simulation_advance() for every combination of the values below and\n" );
+    fprintf( stderr, "prints one result per combination to stdout. Lists are comma separated.\n" );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "Options:\n" );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "  -sizes L     Set the grid sizes (square grids) to L (default: 64,256,1024,4096,16384)\n" );
+    fprintf( stderr, "  -t L         Set the termite fractions to L (default: 0.01,0.05)\n" );
+    fprintf( stderr, "  -c L         Set the wood chip fractions to L (default: 0.10,0.30)\n" );
+    fprintf( stderr, "  -n L         Set the thread counts to L (default: 1,2,4)\n" );
+    fprintf( stderr, "  -e L         Set the engines to L, of: strips, scalar, soa, sync, async, tiles, blocked, leap (default: strips,scalar,soa)\n" );
+    fprintf( stderr, "  -trials N    Set the number of timed trials to N (default: 7)\n" );
+    fprintf( stderr, "  -warmup N    Set the number of untimed warmup trials to N (default: 1)\n" );
+    fprintf( stderr, "  -updates N   Set the number of termite updates per trial to about N (default: 4000000)\n" );
+    fprintf( stderr, "  -S N         Set the seed of the random number generator to N (default: 1)\n" );
+    fprintf( stderr, "  -format F    Set the output format to F, one of: csv, json (default: csv)\n" );
+    fprintf( stderr, "  -?           Print this help.\n" );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "The soa and leap engines step sequentially, so they are only run with one thread.\n" );
+    fprintf( stderr, "Thread counts above the limit of a grid are skipped.\n" );
+    fprintf( stderr, "\n" );
+    exit( EXIT_SUCCESS );
+}
+
+
+/**
+ * \brief Parses a comma separated list of numbers.
+ */
+static void parse_list( const char *program,
+			const char *text,
+			struct bench_list *list )
+{
+    list->count = 0;
+    while( *text != '\0' ) {
+	char *end;
+	if( list->count == BENCH_MAX_VALUES ) {
+	    usage( program );
+	}
+	list->value[ list->count++ ] = strtod( text, &end );
+	if( end == text || (*end != ',' && *end != '\0') ) {
+	    usage( program );
+	}
+	text = *end == ',' ? end + 1 : end;
+    }
+}
+
+
+/**
+ * \brief Returns true if a comma separated list contains a name.
+ */
+static bool list_contains( const char *list,
+			   const char *name )
+{
+    const size_t length = strlen( name );
+    while( true ) {
+	const char *end = strchr( list, ',' );
+	const size_t item = end != NULL ? (size_t) (end - list) : strlen( list );
+	if( item == length && strncmp( list, name, length ) == 0 ) {
+	    return true;
+	}
+	if( end == NULL ) {
+	    return false;
+	}
+	list = end + 1;
+    }
+}
+
+
+/**
+ * \brief Compares two doubles for qsort().
+ */
+static int compare_doubles( const void *a,
+			    const void *b )
+{
+    const double x = *(const double*) a;
+    const double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * \brief Returns the given percentile of sorted values (nearest rank).
+ */
+static double percentile( const double *sorted,
+			  int count,
+			  int percent )
+{
+    int rank = (percent * count + 99) / 100;
+    if( rank < 1 ) {
+	rank = 1;
+    }
+    return sorted[ rank - 1 ];
+}
+
+
+/**
+ * \brief The entry point of the benchmark.
+ *
+ * \param [in] argc The number of command line arguments.
+ *
+ * \param [in] argv The command line arguemnts.
+ *
+ * \return Returns EXIT_SUCCESS on normal exit and EXIT_FAILURE
+ * otherwise.
+ */
+int main( int argc,
+	  char *argv[] )
+{
+    /* The parameters swept (default values). */
+    struct bench_list sizes = { 5, { 64, 256, 1024, 4096, 16384 } };
+    struct bench_list termite_fractions = { 2, { 0.01, 0.05 } };
+    struct bench_list chip_fractions = { 2, { 0.10, 0.30 } };
+    struct bench_list threads = { 3, { 1, 2, 4 } };
+    enum simulation_engine engines[ 8 ] = { SIMULATION_ENGINE_STRIPS, SIMULATION_ENGINE_SCALAR,
+					    SIMULATION_ENGINE_SOA, SIMULATION_ENGINE_SYNCHRONOUS,
+					    SIMULATION_ENGINE_ASYNCHRONOUS, SIMULATION_ENGINE_TILES,
+					    SIMULATION_ENGINE_BLOCKED, SIMULATION_ENGINE_LEAP };
+    const char *engine_names[ 8 ] = { "strips", "scalar", "soa", "sync", "async", "tiles", "blocked", "leap" };
+    bool use_engine[ 8 ] = { true, true, true, false, false, false, false, false };
+
+    /* The measurement (default values). */
+    int num_trials = 7;
+    int num_warmup = 1;
+    double updates_per_trial = 4e6;
+    uint64_t seed = 1;
+    bool json = false;
+
+    /* Parse the command line options. */
+    int optind = 1;
+    while( optind < argc ) {
+	if( strcmp( argv[ optind ], "-?" ) == 0 || optind + 1 >= argc ) {
+	    usage( argv[ 0 ] );
+	}
+	const char *value = argv[ optind + 1 ];
+	if( strcmp( argv[ optind ], "-sizes" ) == 0 ) {
+	    parse_list( argv[ 0 ], value, &sizes );
+	} else if( strcmp( argv[ optind ], "-t" ) == 0 ) {
+	    parse_list( argv[ 0 ], value, &termite_fractions );
+	} else if( strcmp( argv[ optind ], "-c" ) == 0 ) {
+	    parse_list( argv[ 0 ], value, &chip_fractions );
+	} else if( strcmp( argv[ optind ], "-n" ) == 0 ) {
+	    parse_list( argv[ 0 ], value, &threads );
+	} else if( strcmp( argv[ optind ], "-e" ) == 0 ) {
+	    for( int e = 0; e < 8; ++e ) {
+		use_engine[ e ] = list_contains( value, engine_names[ e ] );
+	    }
+	} else if( strcmp( argv[ optind ], "-trials" ) == 0 ) {
+	    num_trials = atoi( value );
+	} else if( strcmp( argv[ optind ], "-warmup" ) == 0 ) {
+	    num_warmup = atoi( value );
+	} else if( strcmp( argv[ optind ], "-updates" ) == 0 ) {
+	    updates_per_trial = atof( value );
+	} else if( strcmp( argv[ optind ], "-S" ) == 0 ) {
+	    seed = strtoull( value, NULL, 10 );
+	} else if( strcmp( argv[ optind ], "-format" ) == 0 ) {
+	    if( strcmp( value, "csv" ) == 0 ) {
+		json = false;
+	    } else if( strcmp( value, "json" ) == 0 ) {
+		json = true;
+	    } else {
+		usage( argv[ 0 ] );
+	    }
+	} else {
+	    usage( argv[ 0 ] );
+	}
+	optind += 2;
+    }
+    assert( num_trials > 0 );
+    assert( num_warmup >= 0 );
+    assert( updates_per_trial > 0 );
+
+    /* Print the header. */
+    if( json ) {
+	printf( "[\n" );
+    } else {
+	printf( "engine,threads,width,height,termites,chips,steps_per_trial,trials,"
+		"median_step_s,p95_step_s,min_step_s,steps_per_s,updates_per_s\n" );
+    }
+
+    double *seconds = malloc( sizeof( double ) * num_trials );
+    bool first = true;
+    for( int s = 0; s < sizes.count; ++s ) {
+	for( int ti = 0; ti < termite_fractions.count; ++ti ) {
+	    for( int ci = 0; ci < chip_fractions.count; ++ci ) {
+		const int size = (int) sizes.value[ s ];
+		const double cells = (double) size * size;
+		if( cells * termite_fractions.value[ ti ] > INT_MAX || cells * chip_fractions.value[ ci ] > INT_MAX ) {
+		    continue;
+		}
+		const int num_termites = (int) (cells * termite_fractions.value[ ti ]);
+		const int num_chips = (int) (cells * chip_fractions.value[ ci ]);
+		if( num_termites < 1 ) {
+		    continue;
+		}
+		int steps = (int) (updates_per_trial / num_termites);
+		if( steps < 1 ) {
+		    steps = 1;
+		}
+
+		/* One simulation per configuration, restarted from the
+		 * same initial state for every engine and thread count.
+		 * The state keeps evolving across the trials of one
+		 * engine and thread count.
+		 */
+		struct simulation sim;
+		simulation_create( &sim, size, size, num_chips, num_termites, seed, 1 );
+
+		for( int e = 0; e < 8; ++e ) {
+		    if( ! use_engine[ e ] ) {
+			continue;
+		    }
+		    for( int n = 0; n < threads.count; ++n ) {
+			const int requested = (int) threads.value[ n ];
+			if( (engines[ e ] == SIMULATION_ENGINE_SCALAR || engines[ e ] == SIMULATION_ENGINE_SOA
+			     || engines[ e ] == SIMULATION_ENGINE_LEAP) && requested > 1 ) {
+			    continue;
+			}
+			if( simulation_set_num_threads( &sim, requested ) != requested ) {
+			    continue;
+			}
+			simulation_reset( &sim, seed );
+			simulation_set_engine( &sim, engines[ e ] );
+
+			for( int trial = -num_warmup; trial < num_trials; ++trial ) {
+			    const double t1 = gettime( );
+			    for( int step = 0; step < steps; ) {
+				step += simulation_advance( &sim, steps - step );
+			    }
+			    const double t2 = gettime( );
+			    if( trial >= 0 ) {
+				seconds[ trial ] = (t2 - t1) / steps;
+			    }
+			}
+			simulation_set_engine( &sim, SIMULATION_ENGINE_SCALAR );
+			simulation_set_num_threads( &sim, 1 );
+
+			qsort( seconds, num_trials, sizeof( double ), compare_doubles );
+			const double median = percentile( seconds, num_trials, 50 );
+			const double p95 = percentile( seconds, num_trials, 95 );
+			if( json ) {
+			    printf( "%s  { \"engine\": \"%s\", \"threads\": %d, \"width\": %d, \"height\": %d, "
+				    "\"termites\": %d, \"chips\": %d, \"steps_per_trial\": %d, \"trials\": %d, "
+				    "\"median_step_s\": %.9e, \"p95_step_s\": %.9e, \"min_step_s\": %.9e, "
+				    "\"steps_per_s\": %.6e, \"updates_per_s\": %.6e }",
+				    first ? "" : ",\n", engine_names[ e ], requested, size, size,
+				    num_termites, num_chips, steps, num_trials,
+				    median, p95, seconds[ 0 ], 1.0 / median, num_termites / median );
+			} else {
+			    printf( "%s,%d,%d,%d,%d,%d,%d,%d,%.9e,%.9e,%.9e,%.6e,%.6e\n",
+				    engine_names[ e ], requested, size, size,
+				    num_termites, num_chips, steps, num_trials,
+				    median, p95, seconds[ 0 ], 1.0 / median, num_termites / median );
+			}
+			fflush( stdout );
+			first = false;
+		    }
+		}
+		simulation_destroy( &sim );
+	    }
+	}
+    }
+    if( json ) {
+	printf( "\n]\n" );
+    }
+    free( seconds );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,610 @@
+#include "blocked.h"
+
+#include "simulation.h"
+
+
+/**
+ * \brief The context of a block shared by all workers.
+ */
+struct blocked_context
+{
+    /** \brief The engine. */
+    struct blocked *blocked;
+
+    /** \brief The team stepping the simulation. */
+    struct workers *workers;
+
+    /** \brief The number of time steps of the block. */
+    int num_steps;
+};
+
+
+void blocked_create( struct blocked *blocked,
+		     struct simulation *sim,
+		     int block_steps )
+{
+    assert( blocked != NULL );
+    assert( sim != NULL );
+    assert( sim->grid.layout != GRID_LAYOUT_SPARSE );
+    assert( block_steps >= 1 );
+
+    int width, height;
+    grid_get_size( &sim->grid, &width, &height );
+    assert( (double) width * height < UINT32_MAX );
+
+    blocked->sim = sim;
+    blocked->block_steps = block_steps;
+    blocked->windows = NULL;
+    blocked->num_windows = 0;
+    workers_create( &blocked->single, 1 );
+}
+
+
+void blocked_window_create( struct blocked_window *win,
+			    int width,
+			    int begin,
+			    int end,
+			    int halo )
+{
+    assert( win != NULL );
+    assert( begin < end && halo >= 0 );
+
+    const int rows = end - begin + 2 * halo;
+    assert( (double) width * rows < UINT32_MAX );
+    grid_create_with_layout( &win->grid, width, rows, GRID_LAYOUT_GENERIC );
+    win->first_row = begin - halo;
+    win->own_begin = halo;
+    win->own_end = halo + end - begin;
+    win->claims = calloc( ((size_t) width * rows * 4 + 63) / 64, sizeof( uint64_t ) );
+    assert( win->claims != NULL );
+    win->count = 0;
+    win->capacity = 0;
+    win->index = NULL;
+    win->x = NULL;
+    win->y = NULL;
+    win->state = NULL;
+    win->target = NULL;
+    win->decision = NULL;
+    win->events = NULL;
+}
+
+
+void blocked_window_destroy( struct blocked_window *win )
+{
+    assert( win != NULL );
+
+    grid_destroy( &win->grid );
+    free( win->claims );
+    free( win->index );
+    free( win->x );
+    free( win->y );
+    free( win->state );
+    free( win->target );
+    free( win->decision );
+    free( win->events );
+    win->claims = NULL;
+    win->index = NULL;
+    win->count = 0;
+    win->capacity = 0;
+}
+
+
+/**
+ * \brief Releases the windows of the engine.
+ */
+static void destroy_windows( struct blocked *blocked )
+{
+    for( int i = 0; i < blocked->num_windows; ++i ) {
+	blocked_window_destroy( &blocked->windows[ i ] );
+    }
+    free( blocked->windows );
+    blocked->windows = NULL;
+    blocked->num_windows = 0;
+}
+
+
+void blocked_destroy( struct blocked *blocked )
+{
+    assert( blocked != NULL );
+
+    destroy_windows( blocked );
+    workers_destroy( &blocked->single );
+}
+
+
+/**
+ * \brief Sets up one window per worker. Worker w owns rows height * w
+ * / num_workers to height * (w + 1) / num_workers - 1 of the grid.
+ */
+static void create_windows( struct blocked *blocked,
+			    int num_workers )
+{
+    int width, height;
+    grid_get_size( &blocked->sim->grid, &width, &height );
+    assert( num_workers <= height );
+    const int halo = BLOCKED_REACH * blocked->block_steps;
+
+    destroy_windows( blocked );
+    blocked->windows = malloc( sizeof( struct blocked_window ) * num_workers );
+    assert( blocked->windows != NULL );
+    for( int w = 0; w < num_workers; ++w ) {
+	blocked_window_create( &blocked->windows[ w ], width,
+			       (int) ((int64_t) height * w / num_workers),
+			       (int) ((int64_t) height * (w + 1) / num_workers), halo );
+    }
+    blocked->num_windows = num_workers;
+}
+
+
+/**
+ * \brief Returns row y of the grid of the given height, wrapped around.
+ */
+static inline int wrap_row( int y,
+			    int height )
+{
+    y %= height;
+    return y < 0 ? y + height : y;
+}
+
+
+/**
+ * \brief Returns count (1 to 64) bits of a plane starting at bit k.
+ */
+static inline uint64_t read_bits( const uint64_t *plane,
+				  size_t k,
+				  int count )
+{
+    const int shift = (int) (k & 63);
+    uint64_t bits = plane[ k >> 6 ] >> shift;
+    if( shift + count > 64 ) {
+	bits |= plane[ (k >> 6) + 1 ] << (64 - shift);
+    }
+    return count < 64 ? bits & ((UINT64_C( 1 ) << count) - 1) : bits;
+}
+
+
+/**
+ * \brief Overwrites the bits of a word selected by a mask. Words of
+ * the grid planes are shared by the strips of neighboring workers,
+ * so they are written with atomic operations.
+ */
+static inline void write_word( uint64_t *word,
+			       uint64_t mask,
+			       uint64_t bits,
+			       bool shared )
+{
+    if( shared ) {
+	__atomic_fetch_and( word, ~mask, __ATOMIC_RELAXED );
+	__atomic_fetch_or( word, bits & mask, __ATOMIC_RELAXED );
+    } else {
+	*word = (*word & ~mask) | (bits & mask);
+    }
+}
+
+
+/**
+ * \brief Copies count bits from bit src_k of one plane to bit dst_k
+ * of another.
+ */
+static void copy_bits( uint64_t *dst,
+		       size_t dst_k,
+		       const uint64_t *src,
+		       size_t src_k,
+		       int count,
+		       bool shared )
+{
+    for( int i = 0; i < count; i += 64 ) {
+	const int n = count - i < 64 ? count - i : 64;
+	const uint64_t bits = read_bits( src, src_k + i, n );
+	const size_t k = dst_k + i;
+	const int shift = (int) (k & 63);
+	const uint64_t mask = n < 64 ? (UINT64_C( 1 ) << n) - 1 : ~UINT64_C( 0 );
+	write_word( &dst[ k >> 6 ], mask << shift, bits << shift, shared );
+	if( shift + n > 64 ) {
+	    write_word( &dst[ (k >> 6) + 1 ], mask >> (64 - shift), bits >> (64 - shift), shared );
+	}
+    }
+}
+
+
+/**
+ * \brief Appends a termite to a window.
+ */
+static void push_termite( struct blocked_window *win,
+			  int index,
+			  int x,
+			  int y,
+			  unsigned state )
+{
+    if( win->count == win->capacity ) {
+	win->capacity = win->capacity > 0 ? 2 * win->capacity : 1024;
+	win->index = realloc( win->index, sizeof( int ) * win->capacity );
+	win->x = realloc( win->x, sizeof( int32_t ) * win->capacity );
+	win->y = realloc( win->y, sizeof( int32_t ) * win->capacity );
+	win->state = realloc( win->state, sizeof( uint8_t ) * win->capacity );
+	win->target = realloc( win->target, sizeof( uint32_t ) * win->capacity );
+	win->decision = realloc( win->decision, sizeof( uint8_t ) * win->capacity );
+	win->events = realloc( win->events, sizeof( uint8_t ) * win->capacity );
+	assert( win->index != NULL && win->x != NULL && win->y != NULL && win->state != NULL
+		&& win->target != NULL && win->decision != NULL && win->events != NULL );
+    }
+    const int i = win->count++;
+    win->index[ i ] = index;
+    win->x[ i ] = x;
+    win->y[ i ] = y;
+    win->state[ i ] = (uint8_t) state;
+}
+
+
+void blocked_window_gather( struct blocked_window *win,
+			    const struct simulation *sim )
+{
+    assert( win != NULL );
+    assert( sim != NULL );
+
+    /* A window taller than the grid holds some rows (and their
+     * termites) twice, which is harmless.
+     */
+    const struct grid *grid = &sim->grid;
+    const int rows = win->grid.height;
+    for( int r = 0; r < rows; ++r ) {
+	const int y = wrap_row( win->first_row + r, grid->height );
+	copy_bits( win->grid.termites, grid_index( &win->grid, 0, r ),
+		   grid->termites, grid_index( grid, 0, y ), grid->width, false );
+	copy_bits( win->grid.chips, grid_index( &win->grid, 0, r ),
+		   grid->chips, grid_index( grid, 0, y ), grid->width, false );
+    }
+
+    win->count = 0;
+    for( int k = 0; k < sim->num_termites; ++k ) {
+	const struct termite *term = &sim->termites[ k ];
+	int x, y;
+	termite_get_coords( term, &x, &y );
+	const unsigned state = termite_get_direction( term ) | (termite_carries_wood_chip( term ) << 2);
+	for( int r = wrap_row( y - win->first_row, grid->height ); r < rows; r += grid->height ) {
+	    push_termite( win, k, x, r, state );
+	}
+    }
+}
+
+
+void blocked_window_scatter( const struct blocked_window *win,
+			     struct simulation *sim )
+{
+    assert( win != NULL );
+    assert( sim != NULL );
+
+    struct grid *grid = &sim->grid;
+    for( int r = win->own_begin; r < win->own_end; ++r ) {
+	const int y = wrap_row( win->first_row + r, grid->height );
+	copy_bits( grid->termites, grid_index( grid, 0, y ),
+		   win->grid.termites, grid_index( &win->grid, 0, r ), grid->width, true );
+	copy_bits( grid->chips, grid_index( grid, 0, y ),
+		   win->grid.chips, grid_index( &win->grid, 0, r ), grid->width, true );
+    }
+
+    for( int i = 0; i < win->count; ++i ) {
+	if( win->y[ i ] >= win->own_begin && win->y[ i ] < win->own_end ) {
+	    termite_set_state( &sim->termites[ win->index[ i ] ], win->x[ i ],
+			       wrap_row( win->first_row + win->y[ i ], grid->height ),
+			       win->state[ i ] & 3, (win->state[ i ] >> 2) & 1 );
+	}
+    }
+}
+
+
+/**
+ * \brief Decides the step of termite i of a window, like decide() of
+ * the synchronous engine.
+ */
+static inline void decide( struct blocked_window *win,
+			   const int i,
+			   const unsigned quarters )
+{
+    const struct grid *grid = &win->grid;
+    const int x = win->x[ i ];
+    const int y = win->y[ i ];
+    int direction = win->state[ i ] & 3;
+    bool carry = (win->state[ i ] >> 2) & 1;
+    unsigned events = 0;
+
+    /* Turn, then drop or pick up a chip and turn around. */
+    direction = (direction + quarters) % 4;
+    events |= (quarters != 0) * COUNTERS_TURN;
+    const size_t here = grid_index( grid, x, y );
+    const bool chip_here = grid_test( grid->chips, here );
+    const bool chip_ahead = grid_test( grid->chips, grid_neighbor( grid, GRID_LAYOUT_GENERIC, x, y, here, direction ) );
+    if( carry && chip_ahead ) {
+	carry = false;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_DROP;
+    } else if( ! carry && chip_here ) {
+	carry = true;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_PICKUP;
+    }
+
+    /* Claim the cell ahead, if it is free. */
+    const size_t ahead = grid_neighbor( grid, GRID_LAYOUT_GENERIC, x, y, here, direction );
+    bool claim = false;
+    if( grid_test( grid->termites, ahead ) ) {
+	events |= COUNTERS_BLOCKED_BY_TERMITE;
+    } else if( carry && grid_test( grid->chips, ahead ) ) {
+	events |= COUNTERS_BLOCKED_BY_CHIP;
+    } else {
+	const uint32_t c = (uint32_t) ahead;
+	const size_t bit = ((size_t) c << 2) + direction;
+	win->claims[ bit >> 6 ] |= UINT64_C( 1 ) << (bit & 63);
+	win->target[ i ] = c;
+	claim = true;
+    }
+    win->decision[ i ] = (uint8_t) (direction | (carry << 2) | (claim << 3));
+    win->events[ i ] = (uint8_t) events;
+}
+
+
+/**
+ * \brief Applies the decision of termite i of a window, like apply()
+ * of the synchronous engine. The priorities are those of the cells of
+ * the grid, so that they agree with the synchronous engine.
+ *
+ * \return The events of the step.
+ */
+static inline unsigned apply( struct blocked_window *win,
+			      const int i,
+			      const uint64_t key,
+			      const int height )
+{
+    struct grid *grid = &win->grid;
+    const unsigned decision = win->decision[ i ];
+    const int direction = decision & 3;
+    unsigned events = win->events[ i ];
+
+    if( events & (COUNTERS_DROP | COUNTERS_PICKUP) ) {
+	const size_t k = grid_index( grid, win->x[ i ], win->y[ i ] );
+	grid->chips[ k >> 6 ] ^= UINT64_C( 1 ) << (k & 63);
+    }
+
+    if( decision & 8 ) {
+	/* Move unless a claim from another direction has a higher
+	 * priority.
+	 */
+	const uint32_t c = win->target[ i ];
+	const size_t bit = (size_t) c << 2;
+	const unsigned others = ((win->claims[ bit >> 6 ] >> (bit & 63)) & 15) & ~(1u << direction);
+	const int tx = (int) (c % (uint32_t) grid->width);
+	const int ty = (int) (c / (uint32_t) grid->width);
+	bool wins = true;
+	if( others != 0 ) {
+	    const uint32_t cell = (uint32_t) wrap_row( win->first_row + ty, height ) * grid->width + tx;
+	    const uint64_t mine = synchronous_priority( key, cell, direction );
+	    for( int d = 0; d < 4; ++d ) {
+		if( ((others >> d) & 1) && synchronous_priority( key, cell, d ) > mine ) {
+		    wins = false;
+		}
+	    }
+	}
+	if( wins ) {
+	    const size_t k = grid_index( grid, win->x[ i ], win->y[ i ] );
+	    grid->termites[ k >> 6 ] ^= UINT64_C( 1 ) << (k & 63);
+	    grid->termites[ c >> 6 ] ^= UINT64_C( 1 ) << (c & 63);
+	    win->x[ i ] = tx;
+	    win->y[ i ] = ty;
+	    events |= COUNTERS_MOVE;
+	} else {
+	    events |= COUNTERS_BLOCKED_BY_TERMITE;
+	}
+    }
+    win->state[ i ] = (uint8_t) (direction | (decision & 4));
+    return events;
+}
+
+
+void blocked_window_step( struct blocked_window *win,
+			  const struct simulation *sim,
+			  uint64_t step,
+			  struct counters *counters,
+			  struct intlist *log )
+{
+    assert( win != NULL );
+    assert( sim != NULL );
+
+    /* Only the termites that start the step in owned rows record
+     * their events.
+     */
+    const int height = sim->grid.height;
+
+    for( int i = 0; i < win->count; ++i ) {
+	decide( win, i, rng_turn( rng_draw( sim->seed, win->index[ i ], step ) ) );
+    }
+
+    const uint64_t key = rng_draw( sim->seed, RNG_STREAM_PRIORITY, step );
+    for( int i = 0; i < win->count; ++i ) {
+	const int x = win->x[ i ];
+	const int y = win->y[ i ];
+	const unsigned events = apply( win, i, key, height );
+	if( y >= win->own_begin && y < win->own_end ) {
+	    counters_record( counters, events );
+	    if( log != NULL && (events & (COUNTERS_PICKUP | COUNTERS_DROP)) ) {
+		intlist_push( log, x );
+		intlist_push( log, wrap_row( win->first_row + y, height ) );
+	    }
+	}
+    }
+
+    /* Withdraw the claims. */
+    for( int i = 0; i < win->count; ++i ) {
+	if( win->decision[ i ] & 8 ) {
+	    const size_t bit = ((size_t) win->target[ i ] << 2) + (win->decision[ i ] & 3);
+	    win->claims[ bit >> 6 ] &= ~(UINT64_C( 1 ) << (bit & 63));
+	}
+    }
+}
+
+
+/**
+ * \brief A termite in a message of blocked_window_pack().
+ */
+struct blocked_record
+{
+    /** \brief The index of the termite in the termite array. */
+    int32_t index;
+
+    /** \brief The x-coordinate. */
+    int32_t x;
+
+    /** \brief The row relative to the first row of the message. */
+    int32_t row;
+
+    /** \brief The packed direction and carry flag. */
+    int32_t state;
+};
+
+
+size_t blocked_window_pack_size( int width,
+				 int rows,
+				 int num_termites )
+{
+    const size_t cells = (size_t) rows * width;
+    const size_t termites = cells < (size_t) num_termites ? cells : (size_t) num_termites;
+    return 2 * sizeof( uint64_t ) * ((cells + 63) / 64) + sizeof( uint64_t )
+	+ sizeof( struct blocked_record ) * termites;
+}
+
+
+/*
+ * A message holds the termite plane of the rows, the chip plane of
+ * the rows (each packed into whole words), the number of termites
+ * and the termites (struct blocked_record).
+ */
+size_t blocked_window_pack( const struct blocked_window *win,
+			    int first,
+			    int rows,
+			    void *buffer )
+{
+    assert( win != NULL );
+    assert( first >= 0 && first + rows <= win->grid.height );
+
+    const int width = win->grid.width;
+    const size_t words = ((size_t) rows * width + 63) / 64;
+    uint64_t *termites = (uint64_t*) buffer;
+    uint64_t *chips = termites + words;
+    termites[ words - 1 ] = 0;
+    chips[ words - 1 ] = 0;
+    for( int r = 0; r < rows; ++r ) {
+	copy_bits( termites, (size_t) r * width, win->grid.termites, grid_index( &win->grid, 0, first + r ), width, false );
+	copy_bits( chips, (size_t) r * width, win->grid.chips, grid_index( &win->grid, 0, first + r ), width, false );
+    }
+
+    uint64_t *count = chips + words;
+    struct blocked_record *records = (struct blocked_record*) (count + 1);
+    *count = 0;
+    for( int i = 0; i < win->count; ++i ) {
+	if( win->y[ i ] >= first && win->y[ i ] < first + rows ) {
+	    struct blocked_record *record = &records[ (*count)++ ];
+	    record->index = win->index[ i ];
+	    record->x = win->x[ i ];
+	    record->row = win->y[ i ] - first;
+	    record->state = win->state[ i ];
+	}
+    }
+    return (size_t) ((char*) &records[ *count ] - (char*) buffer);
+}
+
+
+void blocked_window_trim( struct blocked_window *win )
+{
+    assert( win != NULL );
+
+    int count = 0;
+    for( int i = 0; i < win->count; ++i ) {
+	if( win->y[ i ] >= win->own_begin && win->y[ i ] < win->own_end ) {
+	    win->index[ count ] = win->index[ i ];
+	    win->x[ count ] = win->x[ i ];
+	    win->y[ count ] = win->y[ i ];
+	    win->state[ count ] = win->state[ i ];
+	    ++count;
+	}
+    }
+    win->count = count;
+}
+
+
+void blocked_window_unpack( struct blocked_window *win,
+			    int first,
+			    int rows,
+			    const void *buffer )
+{
+    assert( win != NULL );
+    assert( first >= 0 && first + rows <= win->grid.height );
+
+    const int width = win->grid.width;
+    const size_t words = ((size_t) rows * width + 63) / 64;
+    const uint64_t *termites = (const uint64_t*) buffer;
+    const uint64_t *chips = termites + words;
+    for( int r = 0; r < rows; ++r ) {
+	copy_bits( win->grid.termites, grid_index( &win->grid, 0, first + r ), termites, (size_t) r * width, width, false );
+	copy_bits( win->grid.chips, grid_index( &win->grid, 0, first + r ), chips, (size_t) r * width, width, false );
+    }
+
+    const uint64_t *count = chips + words;
+    const struct blocked_record *records = (const struct blocked_record*) (count + 1);
+    for( uint64_t i = 0; i < *count; ++i ) {
+	push_termite( win, records[ i ].index, records[ i ].x, first + records[ i ].row, (unsigned) records[ i ].state );
+    }
+}
+
+
+/**
+ * \brief Steps the window of one worker through a block.
+ *
+ * \param [in,out] arg The context (struct blocked_context).
+ *
+ * \param [in] worker The index of the worker.
+ *
+ * \param [in] num_workers The number of workers.
+ */
+static void blocked_task( void *arg,
+			  int worker,
+			  int num_workers )
+{
+    (void) num_workers;
+    struct blocked_context *ctx = (struct blocked_context*) arg;
+    struct simulation *sim = ctx->blocked->sim;
+    struct blocked_window *win = &ctx->blocked->windows[ worker ];
+    struct counters *counters = &sim->counters[ worker ];
+    struct intlist *log = sim->clusters != NULL ? clusters_log( sim->clusters, worker ) : NULL;
+
+    blocked_window_gather( win, sim );
+    for( int s = 0; s < ctx->num_steps; ++s ) {
+	blocked_window_step( win, sim, sim->step + s, counters, log );
+    }
+    workers_barrier( ctx->workers );
+
+    blocked_window_scatter( win, sim );
+    workers_barrier( ctx->workers );
+
+    if( worker == 0 && sim->grid.layout == GRID_LAYOUT_PADDED ) {
+	grid_update_all_ghosts( &sim->grid );
+    }
+}
+
+
+void blocked_step( struct blocked *blocked,
+		   struct workers *workers,
+		   int num_steps )
+{
+    assert( blocked != NULL );
+    assert( num_steps >= 1 && num_steps <= blocked->block_steps );
+
+    if( workers == NULL ) {
+	workers = &blocked->single;
+    }
+    assert( workers->num_workers <= blocked->sim->num_threads );
+    if( blocked->num_windows != workers->num_workers ) {
+	create_windows( blocked, workers->num_workers );
+    }
+
+    struct blocked_context ctx = { blocked, workers, num_steps };
+    workers_run( workers, blocked_task, &ctx );
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "common.h"
+
+#include "counters.h"
+#include "grid.h"
+#include "intlist.h"
+#include "workers.h"
+
+
+/**
+ * \brief The distance (in cells) over which the synchronous update
+ * rule propagates information in one time step.
+ *
+ * The cell a termite moves to is adjacent to its own, and whether it
+ * may move there depends on the other termites claiming the cell,
+ * whose claims depend on the cells next to them.
+ */
+#define BLOCKED_REACH 3
+
+
+/**
+ * \brief The copy of a horizontal band of the grid stepped by one
+ * worker of the blocked engine (or one process, see distributed_run()).
+ *
+ * The band holds the rows the worker owns plus a halo of BLOCKED_REACH
+ * * block_steps rows above and below. The termites of the band are
+ * kept as a structure of arrays (see struct soa) together with their
+ * indices in the termite array, which select their random streams.
+ */
+struct blocked_window
+{
+    /** \brief The band (generic layout, as wide as the grid). */
+    struct grid grid;
+
+    /**
+     * \brief The row of the grid of the first row of the band (might
+     * lie outside the grid and is then wrapped around).
+     */
+    int first_row;
+
+    /** \brief The first row of the band owned by the worker. */
+    int own_begin;
+
+    /** \brief One past the last row of the band owned by the worker. */
+    int own_end;
+
+    /** \brief The claim bits of the band, laid out like those of struct synchronous. */
+    uint64_t *claims;
+
+    /** \brief The number of termites in the band. */
+    int count;
+
+    /** \brief The number of termites the arrays below have room for. */
+    int capacity;
+
+    /** \brief The index of each termite in the termite array. */
+    int *index;
+
+    /** \brief The x-coordinates. */
+    int32_t *x;
+
+    /** \brief The y-coordinates (rows of the band). */
+    int32_t *y;
+
+    /** \brief The packed direction and carry flag (see struct soa). */
+    uint8_t *state;
+
+    /** \brief The claimed cell of each termite (y * width + x, in the band). */
+    uint32_t *target;
+
+    /** \brief The decision of each termite (see struct synchronous). */
+    uint8_t *decision;
+
+    /** \brief The events of each termite other than the move or block. */
+    uint8_t *events;
+};
+
+
+/**
+ * \brief Creates a window for the given rows of a grid.
+ *
+ * \param [out] win
+ *
+ * \param [in] width The width of the grid.
+ *
+ * \param [in] begin The first row owned.
+ *
+ * \param [in] end One past the last row owned.
+ *
+ * \param [in] halo The number of rows of the halo on either side.
+ */
+void blocked_window_create( struct blocked_window *win,
+			    int width,
+			    int begin,
+			    int end,
+			    int halo );
+
+
+/**
+ * \brief Destroys a window, releasing all resources.
+ *
+ * \param [in,out] win
+ */
+void blocked_window_destroy( struct blocked_window *win );
+
+
+/**
+ * \brief Copies the rows of a window and the termites in them from a
+ * simulation.
+ *
+ * \param [in,out] win
+ *
+ * \param [in] sim
+ */
+void blocked_window_gather( struct blocked_window *win,
+			    const struct simulation *sim );
+
+
+/**
+ * \brief Writes the owned rows of a window and the termites in them
+ * back to a simulation.
+ *
+ * \param [in] win
+ *
+ * \param [in,out] sim
+ */
+void blocked_window_scatter( const struct blocked_window *win,
+			     struct simulation *sim );
+
+
+/**
+ * \brief Advances the termites of a window one time step with the
+ * synchronous update rule.
+ *
+ * \param [in,out] win
+ *
+ * \param [in] sim The simulation the window was gathered from (for
+ * the seed and the size of the grid).
+ *
+ * \param [in] step The time step.
+ *
+ * \param [in,out] counters The counters to record the events of the
+ * termites in owned rows in.
+ *
+ * \param [in,out] log The log to record the cells of their pick ups
+ * and drops in (see clusters_record()), or NULL.
+ */
+void blocked_window_step( struct blocked_window *win,
+			  const struct simulation *sim,
+			  uint64_t step,
+			  struct counters *counters,
+			  struct intlist *log );
+
+
+/**
+ * \brief Returns the size in bytes of the largest message that
+ * blocked_window_pack() writes for the given number of rows.
+ *
+ * \param [in] width The width of the grid.
+ *
+ * \param [in] rows The number of rows.
+ *
+ * \param [in] num_termites The number of termites of the simulation.
+ */
+size_t blocked_window_pack_size( int width,
+				 int rows,
+				 int num_termites );
+
+
+/**
+ * \brief Packs rows of a window and the termites in them into a message.
+ *
+ * \param [in] win
+ *
+ * \param [in] first The first row of the window.
+ *
+ * \param [in] rows The number of rows.
+ *
+ * \param [out] buffer The message (see blocked_window_pack_size()).
+ *
+ * \return The size of the message in bytes.
+ */
+size_t blocked_window_pack( const struct blocked_window *win,
+			    int first,
+			    int rows,
+			    void *buffer );
+
+
+/**
+ * \brief Removes the termites outside the owned rows from a window,
+ * before the halo rows are replaced by blocked_window_unpack().
+ *
+ * \param [in,out] win
+ */
+void blocked_window_trim( struct blocked_window *win );
+
+
+/**
+ * \brief Overwrites rows of a window with a message of
+ * blocked_window_pack() and adds the termites in it.
+ *
+ * \param [in,out] win
+ *
+ * \param [in] first The first row of the window to overwrite.
+ *
+ * \param [in] rows The number of rows (as packed).
+ *
+ * \param [in] buffer The message.
+ */
+void blocked_window_unpack( struct blocked_window *win,
+			    int first,
+			    int rows,
+			    const void *buffer );
+
+
+/**
+ * \brief Represents the state of the blocked engine.
+ *
+ * Temporal blocking.
+ *
+ * The blocked engine follows the synchronous update rule (see struct
+ * synchronous) but synchronizes the workers only once every
+ * block_steps time steps. Every worker owns a horizontal strip of the
+ * grid and copies the strip plus a halo of BLOCKED_REACH * block_steps
+ * rows on either side into a window of its own. It then steps all
+ * termites of the window through the block without touching shared
+ * memory, and finally writes the rows it owns and the termites in
+ * them back.
+ *
+ * The rows at the edges of a window miss their neighbors, so they go
+ * wrong, and the error spreads by BLOCKED_REACH rows per step. After
+ * the block it has just reached the owned rows, which are therefore
+ * exact: every termite and every chip ends up where the synchronous
+ * engine puts it, and only the events of termites in owned rows are
+ * recorded. The result is identical to that of the synchronous engine
+ * for any number of workers and any block size; the halo rows are
+ * stepped redundantly by two workers, which costs 2 * BLOCKED_REACH *
+ * block_steps rows per strip.
+ */
+struct blocked
+{
+    /** \brief The simulation being stepped. */
+    struct simulation *sim;
+
+    /** \brief The maximal number of time steps per block. */
+    int block_steps;
+
+    /** \brief The windows, one per worker. */
+    struct blocked_window *windows;
+
+    /** \brief The number of windows. */
+    int num_windows;
+
+    /** \brief A team of one worker, used if no team is passed. */
+    struct workers single;
+};
+
+
+/**
+ * \brief Creates the blocked engine for a simulation.
+ *
+ * The grid must not have the sparse layout.
+ *
+ * \param [out] blocked
+ *
+ * \param [in,out] sim
+ *
+ * \param [in] block_steps The maximal number of time steps per block
+ * (at least 1).
+ */
+void blocked_create( struct blocked *blocked,
+		     struct simulation *sim,
+		     int block_steps );
+
+
+/**
+ * \brief Destroys the engine, releasing all resources.
+ *
+ * \param [in,out] blocked
+ */
+void blocked_destroy( struct blocked *blocked );
+
+
+/**
+ * \brief Advances the simulation the given number of time steps with
+ * the synchronous update rule, synchronizing the workers once.
+ *
+ * The caller advances the step counter of the simulation.
+ *
+ * \param [in,out] blocked
+ *
+ * \param [in,out] workers The team to step on, with one worker per
+ * thread of the simulation, or NULL to step sequentially.
+ *
+ * \param [in] num_steps The number of time steps (1 to block_steps).
+ */
+void blocked_step( struct blocked *blocked,
+		   struct workers *workers,
+		   int num_steps );
@@ -0,0 +1,171 @@
+#include "chunkmap.h"
+
+#include "rng.h"
+
+
+/** \brief The number of slots of a new map. */
+#define CHUNKMAP_MIN_CAPACITY 16
+
+
+/**
+ * \brief Returns the home slot of a key.
+ */
+static inline size_t home_slot( const struct chunkmap *map,
+				uint64_t key )
+{
+    return rng_mix( key ) & (map->capacity - 1);
+}
+
+
+/**
+ * \brief Returns the slot holding a key, or the empty slot where it
+ * would be inserted.
+ */
+static size_t find_slot( const struct chunkmap *map,
+			 uint64_t key )
+{
+    size_t slot = home_slot( map, key );
+    while( map->chunks[ slot ] != NULL && map->keys[ slot ] != key ) {
+	slot = (slot + 1) & (map->capacity - 1);
+    }
+    return slot;
+}
+
+
+/**
+ * \brief Allocates an empty table with the given number of slots.
+ */
+static void allocate( struct chunkmap *map,
+		      size_t capacity )
+{
+    map->capacity = capacity;
+    map->keys = malloc( sizeof( uint64_t ) * capacity );
+    map->chunks = calloc( capacity, sizeof( struct chunk* ) );
+    assert( map->keys != NULL && map->chunks != NULL );
+}
+
+
+/**
+ * \brief Doubles the number of slots, keeping all chunks.
+ */
+static void grow( struct chunkmap *map )
+{
+    uint64_t *keys = map->keys;
+    struct chunk **chunks = map->chunks;
+    const size_t capacity = map->capacity;
+
+    allocate( map, 2 * capacity );
+    for( size_t slot = 0; slot < capacity; ++slot ) {
+	if( chunks[ slot ] != NULL ) {
+	    const size_t target = find_slot( map, keys[ slot ] );
+	    map->keys[ target ] = keys[ slot ];
+	    map->chunks[ target ] = chunks[ slot ];
+	}
+    }
+    free( keys );
+    free( chunks );
+}
+
+
+void chunkmap_create( struct chunkmap *map )
+{
+    assert( map != NULL );
+
+    allocate( map, CHUNKMAP_MIN_CAPACITY );
+    map->count = 0;
+}
+
+
+void chunkmap_destroy( struct chunkmap *map )
+{
+    assert( map != NULL );
+
+    chunkmap_clear( map );
+    free( map->keys );
+    free( map->chunks );
+    map->keys = NULL;
+    map->chunks = NULL;
+    map->capacity = 0;
+}
+
+
+void chunkmap_clear( struct chunkmap *map )
+{
+    assert( map != NULL );
+
+    for( size_t slot = 0; slot < map->capacity; ++slot ) {
+	free( map->chunks[ slot ] );
+	map->chunks[ slot ] = NULL;
+    }
+    map->count = 0;
+}
+
+
+struct chunk *chunkmap_find( const struct chunkmap *map,
+			     const uint64_t key )
+{
+    assert( map != NULL );
+
+    return map->chunks[ find_slot( map, key ) ];
+}
+
+
+struct chunk *chunkmap_insert( struct chunkmap *map,
+			       const uint64_t key )
+{
+    assert( map != NULL );
+
+    size_t slot = find_slot( map, key );
+    if( map->chunks[ slot ] != NULL ) {
+	return map->chunks[ slot ];
+    }
+
+    /* Keep the load factor at most one half. */
+    if( 2 * (map->count + 1) > map->capacity ) {
+	grow( map );
+	slot = find_slot( map, key );
+    }
+    map->keys[ slot ] = key;
+    map->chunks[ slot ] = calloc( 1, sizeof( struct chunk ) );
+    assert( map->chunks[ slot ] != NULL );
+    ++map->count;
+    return map->chunks[ slot ];
+}
+
+
+void chunkmap_remove( struct chunkmap *map,
+		      const uint64_t key )
+{
+    assert( map != NULL );
+
+    size_t hole = find_slot( map, key );
+    assert( map->chunks[ hole ] != NULL );
+    free( map->chunks[ hole ] );
+    map->chunks[ hole ] = NULL;
+    --map->count;
+
+    /* Shift back the following entries of the probe sequence that
+     * cannot be found any more past the hole.
+     */
+    const size_t mask = map->capacity - 1;
+    size_t slot = (hole + 1) & mask;
+    while( map->chunks[ slot ] != NULL ) {
+	const size_t home = home_slot( map, map->keys[ slot ] );
+	if( ((slot - home) & mask) >= ((slot - hole) & mask) ) {
+	    map->keys[ hole ] = map->keys[ slot ];
+	    map->chunks[ hole ] = map->chunks[ slot ];
+	    map->chunks[ slot ] = NULL;
+	    hole = slot;
+	}
+	slot = (slot + 1) & mask;
+    }
+}
+
+
+size_t chunkmap_get_memory_footprint( const struct chunkmap *map )
+{
+    assert( map != NULL );
+
+    return map->count * sizeof( struct chunk )
+	+ map->capacity * (sizeof( uint64_t ) + sizeof( struct chunk* ));
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "common.h"
+
+
+/** \brief The width and height of a chunk (in cells). */
+#define CHUNKMAP_CHUNK_SIZE 64
+
+
+/**
+ * \brief Represents a square block of 64-by-64 cells of a sparse grid.
+ *
+ * Row r of the chunk is stored in word r of each plane, with the
+ * column as the bit index.
+ */
+struct chunk
+{
+    /** \brief The termite plane. */
+    uint64_t termites[ CHUNKMAP_CHUNK_SIZE ];
+
+    /** \brief The wood chip plane. */
+    uint64_t chips[ CHUNKMAP_CHUNK_SIZE ];
+
+    /**
+     * \brief The number of bits set in both planes. A chunk is
+     * released when this drops to zero.
+     */
+    int population;
+};
+
+
+/**
+ * \brief Represents a hash table of chunks keyed by their position.
+ *
+ * Only chunks with at least one termite or wood chip are stored. The
+ * table uses open addressing with linear probing, and deletes by
+ * shifting the following entries back, so it never holds tombstones.
+ */
+struct chunkmap
+{
+    /** \brief The key of each slot (valid if the slot holds a chunk). */
+    uint64_t *keys;
+
+    /** \brief The chunk of each slot (NULL if the slot is empty). */
+    struct chunk **chunks;
+
+    /** \brief The number of slots (a power of two). */
+    size_t capacity;
+
+    /** \brief The number of chunks. */
+    size_t count;
+};
+
+
+/**
+ * \brief Returns the key of the chunk with the given chunk coordinates.
+ *
+ * \param [in] cx The column of the chunk (x / CHUNKMAP_CHUNK_SIZE).
+ *
+ * \param [in] cy The row of the chunk (y / CHUNKMAP_CHUNK_SIZE).
+ *
+ * \return The key.
+ */
+static inline uint64_t chunkmap_key( uint32_t cx,
+				     uint32_t cy )
+{
+    return ((uint64_t) cy << 32) | cx;
+}
+
+
+/**
+ * \brief Creates an empty map.
+ *
+ * \param [out] map
+ */
+void chunkmap_create( struct chunkmap *map );
+
+
+/**
+ * \brief Destroys a map, releasing all chunks.
+ *
+ * \param [in,out] map
+ */
+void chunkmap_destroy( struct chunkmap *map );
+
+
+/**
+ * \brief Releases all chunks, keeping the table.
+ *
+ * \param [in,out] map
+ */
+void chunkmap_clear( struct chunkmap *map );
+
+
+/**
+ * \brief Returns the chunk with the given key.
+ *
+ * \param [in] map
+ *
+ * \param [in] key
+ *
+ * \return The chunk, or NULL if there is none.
+ */
+struct chunk *chunkmap_find( const struct chunkmap *map,
+			     uint64_t key );
+
+
+/**
+ * \brief Returns the chunk with the given key, creating an empty
+ * chunk if there is none.
+ *
+ * \param [in,out] map
+ *
+ * \param [in] key
+ *
+ * \return The chunk.
+ */
+struct chunk *chunkmap_insert( struct chunkmap *map,
+			       uint64_t key );
+
+
+/**
+ * \brief Removes and releases the chunk with the given key.
+ *
+ * \param [in,out] map
+ *
+ * \param [in] key The key of a chunk in the map.
+ */
+void chunkmap_remove( struct chunkmap *map,
+		      uint64_t key );
+
+
+/**
+ * \brief Returns the number of bytes used by the map and its chunks.
+ *
+ * \param [in] map
+ *
+ * \return The memory footprint in bytes.
+ */
+size_t chunkmap_get_memory_footprint( const struct chunkmap *map );
@@ -0,0 +1,546 @@
+#include "clusters.h"
+
+
+/**
+ * \brief Returns the histogram bin of a cluster size (at least 1).
+ */
+static inline int bin( uint32_t size )
+{
+    return 31 - __builtin_clz( size );
+}
+
+
+/**
+ * \brief Returns the chip bit of cell k = y * width + x.
+ */
+static inline bool has_chip( const struct grid *grid,
+			     uint64_t k )
+{
+    const int y = (int) (k / grid->width);
+    const int x = (int) (k % grid->width);
+    return grid_test( grid->chips, grid_index( grid, x, y ) );
+}
+
+
+/**
+ * \brief Returns the neighbors of cell k = y * width + x (with
+ * periodic boundaries).
+ */
+static inline void neighbors( const struct grid *grid,
+			      uint64_t k,
+			      uint64_t n[ 4 ] )
+{
+    const uint64_t width = grid->width;
+    const uint64_t area = width * grid->height;
+    const uint64_t x = k % width;
+    n[ NORTH ] = k >= width ? k - width : k + area - width;
+    n[ EAST ] = x + 1 < width ? k + 1 : k + 1 - width;
+    n[ SOUTH ] = k + width < area ? k + width : k + width - area;
+    n[ WEST ] = x > 0 ? k - 1 : k + width - 1;
+}
+
+
+/**
+ * \brief Returns the root of a cell, halving the path on the way.
+ */
+static uint32_t find( uint32_t *parent,
+		      uint32_t k )
+{
+    while( parent[ k ] != k ) {
+	parent[ k ] = parent[ parent[ k ] ];
+	k = parent[ k ];
+    }
+    return k;
+}
+
+
+/**
+ * \brief Links the trees of two cells, the root with the larger index
+ * under the other one.
+ */
+static void link( uint32_t *parent,
+		  uint32_t a,
+		  uint32_t b )
+{
+    a = find( parent, a );
+    b = find( parent, b );
+    if( a < b ) {
+	parent[ b ] = a;
+    } else if( b < a ) {
+	parent[ a ] = b;
+    }
+}
+
+
+/**
+ * \brief Moves a cluster from the bin of one size to that of another
+ * (a size of 0 means no cluster).
+ */
+static void rebin( struct clusters *clusters,
+		   uint32_t old_size,
+		   uint32_t new_size )
+{
+    if( old_size > 0 ) {
+	--clusters->histogram[ bin( old_size ) ];
+	--clusters->num_clusters;
+    }
+    if( new_size > 0 ) {
+	++clusters->histogram[ bin( new_size ) ];
+	++clusters->num_clusters;
+    }
+}
+
+
+/**
+ * \brief Merges the clusters of two cells, keeping the statistics.
+ */
+static void merge( struct clusters *clusters,
+		   uint32_t a,
+		   uint32_t b )
+{
+    a = find( clusters->parent, a );
+    b = find( clusters->parent, b );
+    if( a == b ) {
+	return;
+    }
+    if( b < a ) {
+	const uint32_t t = a;
+	a = b;
+	b = t;
+    }
+    const uint32_t size = clusters->size[ a ] + clusters->size[ b ];
+    rebin( clusters, clusters->size[ b ], 0 );
+    rebin( clusters, clusters->size[ a ], size );
+    clusters->parent[ b ] = a;
+    clusters->size[ a ] = size;
+    clusters->size[ b ] = 0;
+}
+
+
+/**
+ * \brief Adds a number of chips to the region of cell k.
+ */
+static void add_to_region( struct clusters *clusters,
+			   uint64_t k,
+			   int64_t chips )
+{
+    const int width = clusters->grid->width;
+    const int rx = (int) (k % width) / clusters->region_size;
+    const int ry = (int) (k / width) / clusters->region_size;
+    int64_t *count = &clusters->region_chips[ (int64_t) ry * clusters->regions_x + rx ];
+    clusters->occupied_regions -= (*count) > 0;
+    (*count) += chips;
+    clusters->occupied_regions += (*count) > 0;
+}
+
+
+void clusters_create( struct clusters *clusters,
+		      const struct grid *grid,
+		      const int region_size,
+		      const int num_logs,
+		      struct workers *workers )
+{
+    assert( clusters != NULL );
+    assert( grid != NULL );
+    assert( grid->layout != GRID_LAYOUT_SPARSE );
+    assert( (double) grid->width * grid->height < CLUSTERS_NONE );
+    assert( region_size > 0 );
+    assert( num_logs > 0 );
+
+    const size_t area = (size_t) grid->width * grid->height;
+    clusters->grid = grid;
+    clusters->region_size = region_size;
+    clusters->regions_x = (grid->width + region_size - 1) / region_size;
+    clusters->regions_y = (grid->height + region_size - 1) / region_size;
+    clusters->region_chips = malloc( sizeof( int64_t ) * clusters->regions_x * clusters->regions_y );
+    clusters->parent = malloc( sizeof( uint32_t ) * area );
+    clusters->size = malloc( sizeof( uint32_t ) * area );
+    clusters->num_logs = 0;
+    clusters->logs = NULL;
+    clusters->cells = NULL;
+    clusters->cells_capacity = 0;
+    clusters_set_num_logs( clusters, num_logs );
+    clusters_relabel( clusters, workers );
+}
+
+
+void clusters_destroy( struct clusters *clusters )
+{
+    assert( clusters != NULL );
+
+    clusters_set_num_logs( clusters, 0 );
+    free( clusters->logs );
+    free( clusters->region_chips );
+    free( clusters->parent );
+    free( clusters->size );
+    free( clusters->cells );
+    clusters->region_chips = NULL;
+    clusters->parent = NULL;
+    clusters->size = NULL;
+    clusters->logs = NULL;
+    clusters->cells = NULL;
+    clusters->cells_capacity = 0;
+}
+
+
+void clusters_set_num_logs( struct clusters *clusters,
+			    const int num_logs )
+{
+    assert( clusters != NULL );
+    assert( num_logs >= 0 );
+
+    for( int i = 0; i < clusters->num_logs; ++i ) {
+	assert( clusters->logs[ i ].count == 0 );
+	intlist_destroy( &clusters->logs[ i ] );
+    }
+    free( clusters->logs );
+    clusters->num_logs = num_logs;
+    clusters->logs = malloc( sizeof( struct intlist ) * (num_logs > 0 ? num_logs : 1) );
+    for( int i = 0; i < num_logs; ++i ) {
+	intlist_create( &clusters->logs[ i ] );
+    }
+}
+
+
+/**
+ * \brief Compares two cells for qsort().
+ */
+static int compare_cells( const void *a,
+			  const void *b )
+{
+    const uint64_t x = *(const uint64_t*) a;
+    const uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * \brief Returns true if a cell is in a sorted array of cells.
+ */
+static bool contains( const uint64_t *cells,
+		      size_t count,
+		      uint64_t k )
+{
+    size_t lo = 0, hi = count;
+    while( lo < hi ) {
+	const size_t mid = lo + (hi - lo) / 2;
+	if( cells[ mid ] < k ) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    return lo < count && cells[ lo ] == k;
+}
+
+
+void clusters_apply( struct clusters *clusters )
+{
+    assert( clusters != NULL );
+
+    const struct grid *grid = clusters->grid;
+
+    /* Gather the cells of all events. */
+    size_t count = 0;
+    for( int i = 0; i < clusters->num_logs; ++i ) {
+	count += clusters->logs[ i ].count / 2;
+    }
+    if( count == 0 ) {
+	return;
+    }
+    if( count > clusters->cells_capacity ) {
+	clusters->cells_capacity = 2 * count;
+	clusters->cells = realloc( clusters->cells, sizeof( uint64_t ) * clusters->cells_capacity );
+	assert( clusters->cells != NULL );
+    }
+    uint64_t *cells = clusters->cells;
+    count = 0;
+    for( int i = 0; i < clusters->num_logs; ++i ) {
+	struct intlist *log = &clusters->logs[ i ];
+	for( int j = 0; j < log->count; j += 2 ) {
+	    cells[ count++ ] = (uint64_t) log->items[ j + 1 ] * grid->width + log->items[ j ];
+	}
+	intlist_clear( log );
+    }
+
+    /* Keep the cells that were toggled an odd number of times. */
+    qsort( cells, count, sizeof( uint64_t ), compare_cells );
+    size_t num_changed = 0;
+    for( size_t i = 0; i < count; ) {
+	size_t j = i;
+	while( j < count && cells[ j ] == cells[ i ] ) {
+	    ++j;
+	}
+	if( (j - i) % 2 == 1 ) {
+	    cells[ num_changed++ ] = cells[ i ];
+	}
+	i = j;
+    }
+
+    /* Count the chips and the adjacencies. A pair with both cells
+     * changed is counted from the cell with the smaller index.
+     */
+    for( size_t i = 0; i < num_changed; ++i ) {
+	const uint64_t k = cells[ i ];
+	const bool chip = has_chip( grid, k );
+	clusters->chips += chip ? 1 : -1;
+	add_to_region( clusters, k, chip ? 1 : -1 );
+	uint64_t n[ 4 ];
+	neighbors( grid, k, n );
+	for( int d = 0; d < 4; ++d ) {
+	    const bool changed = contains( cells, num_changed, n[ d ] );
+	    if( changed && n[ d ] < k ) {
+		continue;
+	    }
+	    const bool after = has_chip( grid, n[ d ] );
+	    const bool before = after != changed;
+	    clusters->adjacencies += (int) (chip && after) - (int) (! chip && before);
+	}
+    }
+
+    /* Shrink the clusters of the chips picked up. */
+    for( size_t i = 0; i < num_changed; ++i ) {
+	const uint32_t k = (uint32_t) cells[ i ];
+	if( ! has_chip( grid, k ) ) {
+	    const uint32_t root = find( clusters->parent, k );
+	    rebin( clusters, clusters->size[ root ], clusters->size[ root ] - 1 );
+	    --clusters->size[ root ];
+	    ++clusters->stale;
+	}
+    }
+
+    /* Add the chips dropped and merge them with their neighbors. A
+     * cell that held a chip since the last labeling is still in the
+     * forest and rejoins its old cluster.
+     */
+    for( size_t i = 0; i < num_changed; ++i ) {
+	const uint32_t k = (uint32_t) cells[ i ];
+	if( ! has_chip( grid, k ) ) {
+	    continue;
+	}
+	if( clusters->parent[ k ] == CLUSTERS_NONE ) {
+	    clusters->parent[ k ] = k;
+	    clusters->size[ k ] = 0;
+	}
+	const uint32_t root = find( clusters->parent, k );
+	rebin( clusters, clusters->size[ root ], clusters->size[ root ] + 1 );
+	++clusters->size[ root ];
+	uint64_t n[ 4 ];
+	neighbors( grid, k, n );
+	for( int d = 0; d < 4; ++d ) {
+	    if( clusters->parent[ n[ d ] ] != CLUSTERS_NONE && has_chip( grid, n[ d ] ) ) {
+		merge( clusters, k, (uint32_t) n[ d ] );
+	    }
+	}
+    }
+}
+
+
+/**
+ * \brief Context for relabel_task().
+ */
+struct relabel_context
+{
+    /** \brief The statistics. */
+    struct clusters *clusters;
+
+    /** \brief The workers. */
+    struct workers *workers;
+
+    /** \brief The chips, adjacencies and histogram found by each worker. */
+    int64_t (*partial)[ CLUSTERS_NUM_BINS + 2 ];
+};
+
+
+/**
+ * \brief Labels the clusters in four phases (see clusters_relabel()),
+ * each worker working on one band of rows.
+ *
+ * \param [in,out] arg The relabel_context.
+ *
+ * \param [in] worker
+ *
+ * \param [in] num_workers
+ */
+static void relabel_task( void *arg,
+			  int worker,
+			  int num_workers )
+{
+    struct relabel_context *ctx = (struct relabel_context*) arg;
+    struct clusters *clusters = ctx->clusters;
+    const struct grid *grid = clusters->grid;
+    uint32_t *parent = clusters->parent;
+    const uint32_t width = grid->width;
+    const int row_begin = (int) ((int64_t) worker * grid->height / num_workers);
+    const int row_end = (int) ((int64_t) (worker + 1) * grid->height / num_workers);
+    const uint32_t begin = row_begin * width;
+    const uint32_t end = row_end * width;
+    int64_t *partial = ctx->partial[ worker ];
+    memset( partial, 0, sizeof( ctx->partial[ worker ] ) );
+
+    /* Phase 1: link the chips within the band, including the wrap
+     * from the last column to the first. Every tree stays inside the
+     * band, so the workers do not interfere.
+     */
+    for( int y = row_begin; y < row_end; ++y ) {
+	for( uint32_t x = 0; x < width; ++x ) {
+	    const uint32_t k = y * width + x;
+	    clusters->size[ k ] = 0;
+	    if( ! has_chip( grid, k ) ) {
+		parent[ k ] = CLUSTERS_NONE;
+		continue;
+	    }
+	    parent[ k ] = k;
+	    ++partial[ 0 ];
+	    const int64_t region = (int64_t) (y / clusters->region_size) * clusters->regions_x + x / clusters->region_size;
+	    __atomic_fetch_add( &clusters->region_chips[ region ], 1, __ATOMIC_RELAXED );
+	    if( x > 0 && has_chip( grid, k - 1 ) ) {
+		link( parent, k - 1, k );
+	    }
+	    if( y > row_begin && has_chip( grid, k - width ) ) {
+		link( parent, k - width, k );
+	    }
+	    uint64_t n[ 4 ];
+	    neighbors( grid, k, n );
+	    partial[ 1 ] += has_chip( grid, n[ EAST ] ) + has_chip( grid, n[ SOUTH ] );
+	}
+	const uint32_t first = y * width;
+	if( width > 1 && has_chip( grid, first ) && has_chip( grid, first + width - 1 ) ) {
+	    link( parent, first, first + width - 1 );
+	}
+    }
+    workers_barrier( ctx->workers );
+
+    /* Phase 2: link across the band boundaries (including the wrap
+     * from the last row to the first), on one worker.
+     */
+    if( worker == 0 ) {
+	for( int w = 0; w < num_workers; ++w ) {
+	    const int y = (int) ((int64_t) w * grid->height / num_workers);
+	    const int next = (int) ((int64_t) (w + 1) * grid->height / num_workers);
+	    const int above = y > 0 ? y - 1 : grid->height - 1;
+	    if( y == next || above == y ) {
+		continue;
+	    }
+	    for( uint32_t x = 0; x < width; ++x ) {
+		const uint32_t k = y * width + x;
+		const uint32_t a = above * width + x;
+		if( has_chip( grid, k ) && has_chip( grid, a ) ) {
+		    link( parent, a, k );
+		}
+	    }
+	}
+    }
+    workers_barrier( ctx->workers );
+
+    /* Phase 3: point every chip at its root and count the sizes. The
+     * forest no longer changes shape, so a concurrent find can only
+     * see an old parent or the root, which lead to the same root.
+     */
+    for( uint32_t k = begin; k < end; ++k ) {
+	if( parent[ k ] == CLUSTERS_NONE ) {
+	    continue;
+	}
+	uint32_t root = k;
+	uint32_t next;
+	while( (next = __atomic_load_n( &parent[ root ], __ATOMIC_RELAXED )) != root ) {
+	    root = next;
+	}
+	__atomic_store_n( &parent[ k ], root, __ATOMIC_RELAXED );
+	__atomic_fetch_add( &clusters->size[ root ], 1, __ATOMIC_RELAXED );
+    }
+    workers_barrier( ctx->workers );
+
+    /* Phase 4: collect the histogram of the roots in the band. */
+    for( uint32_t k = begin; k < end; ++k ) {
+	if( clusters->size[ k ] > 0 ) {
+	    ++partial[ 2 + bin( clusters->size[ k ] ) ];
+	}
+    }
+}
+
+
+void clusters_relabel( struct clusters *clusters,
+		       struct workers *workers )
+{
+    assert( clusters != NULL );
+    assert( workers != NULL );
+
+    for( int i = 0; i < clusters->num_logs; ++i ) {
+	intlist_clear( &clusters->logs[ i ] );
+    }
+
+    const int64_t num_regions = (int64_t) clusters->regions_x * clusters->regions_y;
+    memset( clusters->region_chips, 0, sizeof( int64_t ) * num_regions );
+
+    struct relabel_context ctx;
+    ctx.clusters = clusters;
+    ctx.workers = workers;
+    ctx.partial = malloc( sizeof( ctx.partial[ 0 ] ) * workers->num_workers );
+    workers_run( workers, relabel_task, &ctx );
+
+    clusters->chips = 0;
+    clusters->adjacencies = 0;
+    clusters->num_clusters = 0;
+    memset( clusters->histogram, 0, sizeof( clusters->histogram ) );
+    for( int w = 0; w < workers->num_workers; ++w ) {
+	clusters->chips += ctx.partial[ w ][ 0 ];
+	clusters->adjacencies += ctx.partial[ w ][ 1 ];
+	for( int b = 0; b < CLUSTERS_NUM_BINS; ++b ) {
+	    clusters->histogram[ b ] += ctx.partial[ w ][ 2 + b ];
+	    clusters->num_clusters += ctx.partial[ w ][ 2 + b ];
+	}
+    }
+    free( ctx.partial );
+    clusters->stale = 0;
+
+    clusters->occupied_regions = 0;
+    for( int64_t r = 0; r < num_regions; ++r ) {
+	clusters->occupied_regions += clusters->region_chips[ r ] > 0;
+    }
+}
+
+
+int64_t clusters_get_region_chips( const struct clusters *clusters,
+				   const int rx,
+				   const int ry )
+{
+    assert( clusters != NULL );
+    assert( rx >= 0 && rx < clusters->regions_x );
+    assert( ry >= 0 && ry < clusters->regions_y );
+
+    return clusters->region_chips[ (int64_t) ry * clusters->regions_x + rx ];
+}
+
+
+void clusters_write_header( FILE *file )
+{
+    assert( file != NULL );
+
+    fprintf( file, "step,chips,adjacencies,occupied_regions,clusters,stale,size_histogram\n" );
+}
+
+
+void clusters_write_row( FILE *file,
+			 const uint64_t step,
+			 const struct clusters *clusters )
+{
+    assert( file != NULL );
+    assert( clusters != NULL );
+
+    fprintf( file, "%llu,%lld,%lld,%lld,%lld,%lld,",
+	     (unsigned long long) step,
+	     (long long) clusters->chips,
+	     (long long) clusters->adjacencies,
+	     (long long) clusters->occupied_regions,
+	     (long long) clusters->num_clusters,
+	     (long long) clusters->stale );
+    int last = CLUSTERS_NUM_BINS - 1;
+    while( last > 0 && clusters->histogram[ last ] == 0 ) {
+	--last;
+    }
+    for( int b = 0; b <= last; ++b ) {
+	fprintf( file, b == 0 ? "%lld" : " %lld", (long long) clusters->histogram[ b ] );
+    }
+    fprintf( file, "\n" );
+}
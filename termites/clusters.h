@@ -0,0 +1,248 @@
+#pragma once
+
+#include "common.h"
+
+#include "counters.h"
+#include "grid.h"
+#include "intlist.h"
+#include "termite.h"
+#include "workers.h"
+
+
+/** \brief The parent of a cell that is not in the union-find forest. */
+#define CLUSTERS_NONE UINT32_MAX
+
+/** \brief The number of bins of the cluster size histogram. */
+#define CLUSTERS_NUM_BINS 32
+
+
+/**
+ * \brief Represents statistics of the wood chip clusters of a grid.
+ *
+ * A cluster is a set of chips connected through horizontally or
+ * vertically adjacent cells (across the periodic boundaries).
+ *
+ * Incremental updates.
+ *
+ * The engines log the cell of every pick up and drop (see
+ * clusters_record()) in one log per thread, and clusters_apply()
+ * folds the logs into the statistics after every step, in time
+ * proportional to the number of events. A cell that was toggled an
+ * even number of times in the step is left out, and the others are
+ * compared with the grid at the end of the step. The adjacency count
+ * and the region counts are then exact.
+ *
+ * The clusters are kept in a union-find forest over the cells. A drop
+ * merges the cluster of the new chip with those of its neighbors,
+ * which is exact. A pick up only shrinks its cluster, which might
+ * actually have split in two. Such pick ups are counted in stale
+ * until the next full labeling by clusters_relabel(), which runs in
+ * parallel and makes everything exact again.
+ */
+struct clusters
+{
+    /** \brief The grid. */
+    const struct grid *grid;
+
+    /** \brief The width and height (in cells) of a region. */
+    int region_size;
+
+    /** \brief The number of columns of regions. */
+    int regions_x;
+
+    /** \brief The number of rows of regions. */
+    int regions_y;
+
+    /** \brief The number of chips in each region (row by row). */
+    int64_t *region_chips;
+
+    /** \brief The number of regions with at least one chip. */
+    int64_t occupied_regions;
+
+    /** \brief The number of chips on the grid (not carried). */
+    int64_t chips;
+
+    /** \brief The number of pairs of adjacent chips. */
+    int64_t adjacencies;
+
+    /** \brief The number of clusters. */
+    int64_t num_clusters;
+
+    /**
+     * \brief The number of clusters with a size from 2^i to 2^(i+1)-1
+     * in bin i.
+     */
+    int64_t histogram[ CLUSTERS_NUM_BINS ];
+
+    /** \brief The number of pick ups since the last full labeling. */
+    int64_t stale;
+
+    /**
+     * \brief The parent of each cell (y * width + x) in the forest, or
+     * CLUSTERS_NONE for cells outside of it.
+     */
+    uint32_t *parent;
+
+    /** \brief The number of chips in the cluster of each root. */
+    uint32_t *size;
+
+    /** \brief The number of logs. */
+    int num_logs;
+
+    /** \brief The logs (x followed by y for every event). */
+    struct intlist *logs;
+
+    /** \brief Scratch space for the cells of the events of a step. */
+    uint64_t *cells;
+
+    /** \brief The capacity of cells. */
+    size_t cells_capacity;
+};
+
+
+/**
+ * \brief Creates the statistics of a grid and labels its clusters.
+ *
+ * The grid must not have the sparse layout and must have fewer than
+ * 2^32 - 1 cells.
+ *
+ * \param [out] clusters
+ *
+ * \param [in] grid
+ *
+ * \param [in] region_size The width and height of a region.
+ *
+ * \param [in] num_logs The number of logs (one per thread).
+ *
+ * \param [in,out] workers The workers to label the clusters on.
+ */
+void clusters_create( struct clusters *clusters,
+		      const struct grid *grid,
+		      int region_size,
+		      int num_logs,
+		      struct workers *workers );
+
+
+/**
+ * \brief Destroys the statistics, releasing all resources.
+ *
+ * \param [in,out] clusters
+ */
+void clusters_destroy( struct clusters *clusters );
+
+
+/**
+ * \brief Changes the number of logs. The logs must be empty.
+ *
+ * \param [in,out] clusters
+ *
+ * \param [in] num_logs
+ */
+void clusters_set_num_logs( struct clusters *clusters,
+			    int num_logs );
+
+
+/**
+ * \brief Returns log i.
+ */
+static inline struct intlist *clusters_log( struct clusters *clusters,
+					    int i )
+{
+    return &clusters->logs[ i ];
+}
+
+
+/**
+ * \brief Logs the pick up or drop (if any) of a termite step.
+ *
+ * The chip was picked up or dropped in the cell the termite occupied
+ * at the start of the step, which is the cell behind it if it moved.
+ *
+ * \param [in,out] log
+ *
+ * \param [in] grid The grid in which the termite wanders.
+ *
+ * \param [in] term The termite after the step.
+ *
+ * \param [in] events The events of the step (see termite_step()).
+ */
+static inline void clusters_record( struct intlist *log,
+				    const struct grid *grid,
+				    const struct termite *term,
+				    unsigned events )
+{
+    if( (events & (COUNTERS_PICKUP | COUNTERS_DROP)) == 0 ) {
+	return;
+    }
+    int x, y;
+    termite_get_coords( term, &x, &y );
+    if( events & COUNTERS_MOVE ) {
+	grid_get_coords_in_direction( grid, x, y, &x, &y, (termite_get_direction( term ) + 2) % 4 );
+    }
+    intlist_push( log, x );
+    intlist_push( log, y );
+}
+
+
+/**
+ * \brief Folds the logged events into the statistics and empties the
+ * logs. Must be called after every step, or after every block of
+ * steps of the blocked engine (a chip picked up and put back within
+ * the block then never leaves its cluster).
+ *
+ * \param [in,out] clusters
+ */
+void clusters_apply( struct clusters *clusters );
+
+
+/**
+ * \brief Recomputes all statistics from the grid and labels the
+ * clusters from scratch, in parallel over bands of rows.
+ *
+ * \param [in,out] clusters
+ *
+ * \param [in,out] workers
+ */
+void clusters_relabel( struct clusters *clusters,
+		       struct workers *workers );
+
+
+/**
+ * \brief Returns the number of chips in a region.
+ *
+ * \param [in] clusters
+ *
+ * \param [in] rx The column of the region.
+ *
+ * \param [in] ry The row of the region.
+ *
+ * \return The number of chips.
+ */
+int64_t clusters_get_region_chips( const struct clusters *clusters,
+				   int rx,
+				   int ry );
+
+
+/**
+ * \brief Writes the CSV header matching clusters_write_row().
+ *
+ * \param [in,out] file
+ */
+void clusters_write_header( FILE *file );
+
+
+/**
+ * \brief Writes the statistics as one CSV row.
+ *
+ * The histogram is written as one field of space separated counts,
+ * up to the last nonzero bin.
+ *
+ * \param [in,out] file
+ *
+ * \param [in] step The time step the statistics were taken at.
+ *
+ * \param [in] clusters
+ */
+void clusters_write_row( FILE *file,
+			 uint64_t step,
+			 const struct clusters *clusters );
@@ -1,11 +1,27 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
 #include <assert.h>
 
 #include "types.h"
+
+
+/**
+ * \brief Return the current time as a double (in seconds) with high
+ * resolution, from a monotonic clock.
+ *
+ * \return The current time (in seconds) since some fixed point.
+ */
+static inline double gettime( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
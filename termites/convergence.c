@@ -0,0 +1,52 @@
+#include "convergence.h"
+
+
+void convergence_create( struct convergence *conv,
+			 const int window,
+			 const double tolerance )
+{
+    assert( conv != NULL );
+    assert( window >= 2 );
+    assert( tolerance >= 0.0 );
+
+    conv->window = window;
+    conv->tolerance = tolerance;
+    conv->samples = malloc( sizeof( int64_t ) * window );
+    assert( conv->samples != NULL );
+    conv->count = 0;
+}
+
+
+void convergence_destroy( struct convergence *conv )
+{
+    assert( conv != NULL );
+
+    free( conv->samples );
+    conv->samples = NULL;
+    conv->count = 0;
+}
+
+
+bool convergence_sample( struct convergence *conv,
+			 const int64_t value )
+{
+    assert( conv != NULL );
+
+    conv->samples[ conv->count % conv->window ] = value;
+    ++conv->count;
+    if( conv->count < conv->window ) {
+	return false;
+    }
+
+    int64_t min = conv->samples[ 0 ];
+    int64_t max = conv->samples[ 0 ];
+    for( int i = 1; i < conv->window; ++i ) {
+	if( conv->samples[ i ] < min ) {
+	    min = conv->samples[ i ];
+	}
+	if( conv->samples[ i ] > max ) {
+	    max = conv->samples[ i ];
+	}
+    }
+    return (double) (max - min) <= conv->tolerance * (double) max;
+}
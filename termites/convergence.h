@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.h"
+
+
+/**
+ * \brief Detects when a sampled order parameter has settled.
+ *
+ * The parameter (for instance the number of adjacent chip pairs, see
+ * struct clusters) is sampled every so many time steps. The run has
+ * converged once the last window samples all lie within a relative
+ * tolerance of each other, i.e., once
+ *
+ *   max - min <= tolerance * max
+ *
+ * over the window.
+ */
+struct convergence
+{
+    /** \brief The number of samples in the window. */
+    int window;
+
+    /** \brief The relative tolerance. */
+    double tolerance;
+
+    /** \brief The last window samples (a ring buffer). */
+    int64_t *samples;
+
+    /** \brief The number of samples taken so far. */
+    int64_t count;
+};
+
+
+/**
+ * \brief Creates a detector with no samples.
+ *
+ * \param [out] conv
+ *
+ * \param [in] window The number of samples that must agree (at least 2).
+ *
+ * \param [in] tolerance The relative tolerance (at least 0).
+ */
+void convergence_create( struct convergence *conv,
+			 int window,
+			 double tolerance );
+
+
+/**
+ * \brief Destroys a detector, releasing all resources.
+ *
+ * \param [in,out] conv
+ */
+void convergence_destroy( struct convergence *conv );
+
+
+/**
+ * \brief Adds a sample and tells whether the parameter has converged.
+ *
+ * \param [in,out] conv
+ *
+ * \param [in] value The sample.
+ *
+ * \return True if the window is full and its samples agree within the
+ * tolerance.
+ */
+bool convergence_sample( struct convergence *conv,
+			 int64_t value );
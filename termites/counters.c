@@ -0,0 +1,53 @@
+#include "counters.h"
+
+
+
+struct counters *counters_alloc( const int count )
+{
+    assert( count >= 0 );
+
+    void *memory = NULL;
+    if( posix_memalign( &memory, 64, sizeof( struct counters ) * (count > 0 ? count : 1) ) != 0 ) {
+	return NULL;
+    }
+    memset( memory, 0, sizeof( struct counters ) * (count > 0 ? count : 1) );
+    return (struct counters*) memory;
+}
+
+
+void counters_sum( struct counters *total,
+		   const struct counters *counters,
+		   const int count )
+{
+    assert( total != NULL );
+    assert( counters != NULL || count == 0 );
+
+    for( int c = 0; c < count; ++c ) {
+	for( int i = 0; i < COUNTERS_NUM_EVENTS; ++i ) {
+	    total->count[ i ] += counters[ c ].count[ i ];
+	}
+    }
+}
+
+
+void counters_write_header( FILE *file )
+{
+    assert( file != NULL );
+
+    fprintf( file, "step,turns,moves,blocked_by_termite,blocked_by_chip,pickups,drops\n" );
+}
+
+
+void counters_write_row( FILE *file,
+			 const uint64_t step,
+			 const struct counters *counters )
+{
+    assert( file != NULL );
+    assert( counters != NULL );
+
+    fprintf( file, "%llu", (unsigned long long) step );
+    for( int i = 0; i < COUNTERS_NUM_EVENTS; ++i ) {
+	fprintf( file, ",%llu", (unsigned long long) counters->count[ i ] );
+    }
+    fprintf( file, "\n" );
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "common.h"
+
+
+/**
+ * \brief Per-thread event counters.
+ *
+ * The counters are only collected if the program is compiled with
+ * TERMITES_COUNTERS defined (see 'make counters'). Otherwise
+ * COUNTERS_ENABLED is 0, counters_record() and counters_add() compile
+ * to nothing, and the counters stay zero.
+ */
+#ifdef TERMITES_COUNTERS
+#define COUNTERS_ENABLED 1
+#else
+#define COUNTERS_ENABLED 0
+#endif
+
+
+/**
+ * \brief The events of one termite step, as returned by termite_step().
+ *
+ * The values are bit flags; event i is bit i.
+ */
+enum counters_event
+{
+    /** \brief The termite turned left or right. */
+    COUNTERS_TURN = 1,
+
+    /** \brief The termite moved forward. */
+    COUNTERS_MOVE = 2,
+
+    /** \brief The termite could not move because of a termite ahead. */
+    COUNTERS_BLOCKED_BY_TERMITE = 4,
+
+    /**
+     * \brief The termite could not move because it carries a chip and
+     * there is a chip ahead (and no termite).
+     */
+    COUNTERS_BLOCKED_BY_CHIP = 8,
+
+    /** \brief The termite picked up a chip. */
+    COUNTERS_PICKUP = 16,
+
+    /** \brief The termite dropped a chip. */
+    COUNTERS_DROP = 32
+};
+
+
+/** \brief The number of different events. */
+#define COUNTERS_NUM_EVENTS 6
+
+
+/**
+ * \brief The counts of each event seen by one thread.
+ *
+ * Eight counts fill one 64-byte cache line, so the counters of
+ * different threads kept in one aligned array never share a line.
+ */
+struct counters
+{
+    /** \brief The number of times event i was seen (bit i). */
+    uint64_t count[ 8 ];
+};
+
+
+/**
+ * \brief Allocates a zeroed, cache line aligned array of counters.
+ *
+ * \param [in] count The number of counters.
+ *
+ * \return The array, to be released with free().
+ */
+struct counters *counters_alloc( int count );
+
+
+/**
+ * \brief Adds the counts of an array of counters into one.
+ *
+ * \param [in,out] total The counters to add to.
+ *
+ * \param [in] counters The counters to add.
+ *
+ * \param [in] count The number of counters to add.
+ */
+void counters_sum( struct counters *total,
+		   const struct counters *counters,
+		   int count );
+
+
+/**
+ * \brief Writes the CSV header matching counters_write_row().
+ *
+ * \param [in,out] file
+ */
+void counters_write_header( FILE *file );
+
+
+/**
+ * \brief Writes one CSV row of counts.
+ *
+ * \param [in,out] file
+ *
+ * \param [in] step The time step the counts were taken at.
+ *
+ * \param [in] counters
+ */
+void counters_write_row( FILE *file,
+			 uint64_t step,
+			 const struct counters *counters );
+
+
+/**
+ * \brief Records the events of one termite step.
+ *
+ * \param [in,out] counters
+ *
+ * \param [in] events The events (a combination of counters_event flags).
+ */
+static inline void counters_record( struct counters *counters,
+				    unsigned events )
+{
+#if COUNTERS_ENABLED
+    for( int i = 0; i < COUNTERS_NUM_EVENTS; ++i ) {
+	counters->count[ i ] += (events >> i) & 1;
+    }
+#else
+    (void) counters;
+    (void) events;
+#endif
+}
+
+
+/**
+ * \brief Records an event seen a number of times.
+ *
+ * \param [in,out] counters
+ *
+ * \param [in] event The event (one counters_event flag).
+ *
+ * \param [in] times The number of times.
+ */
+static inline void counters_add( struct counters *counters,
+				 enum counters_event event,
+				 uint64_t times )
+{
+#if COUNTERS_ENABLED
+    assert( event != 0 && (event & (event - 1)) == 0 );
+    counters->count[ __builtin_ctz( (unsigned) event ) ] += times;
+#else
+    (void) counters;
+    (void) event;
+    (void) times;
+#endif
+}
@@ -0,0 +1,419 @@
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "distributed.h"
+
+#include "simulation.h"
+
+
+/**
+ * \brief A single-producer, single-consumer ring buffer of bytes in
+ * shared memory. The data follows the header.
+ */
+struct distributed_ring
+{
+    /** \brief The number of bytes written so far (by the producer). */
+    uint64_t head;
+
+    /** \brief Keeps head and tail on different cache lines. */
+    char padding_head[ 64 - sizeof( uint64_t ) ];
+
+    /** \brief The number of bytes read so far (by the consumer). */
+    uint64_t tail;
+
+    /** \brief Keeps tail and the data on different cache lines. */
+    char padding_tail[ 64 - sizeof( uint64_t ) ];
+
+    /** \brief The size of the data in bytes. */
+    uint64_t capacity;
+
+    /** \brief Keeps the data on its own cache lines. */
+    char padding_capacity[ 64 - sizeof( uint64_t ) ];
+};
+
+
+/**
+ * \brief What a process reports at the end of a run.
+ */
+struct distributed_report
+{
+    /** \brief The wood chips in the rows of the process or carried by its termites. */
+    int64_t chips;
+
+    /** \brief The termites in the rows of the process. */
+    int64_t termites;
+
+    /** \brief The events of the termites of the process. */
+    struct counters counters;
+};
+
+
+/**
+ * \brief The memory shared by the processes of a run.
+ */
+struct distributed_shared
+{
+    /** \brief The reports, one per process. */
+    struct distributed_report *reports;
+
+    /** \brief The termite plane followed by the chip plane of the result. */
+    uint64_t *planes;
+
+    /** \brief The termites of the result. */
+    struct termite *termites;
+
+    /**
+     * \brief The rings. Process r sends its top rows through ring 2 r
+     * and its bottom rows through ring 2 r + 1.
+     */
+    struct distributed_ring **rings;
+
+    /** \brief The start of the mapping. */
+    void *mapping;
+
+    /** \brief The size of the mapping in bytes. */
+    size_t mapping_size;
+};
+
+
+/**
+ * \brief Rounds a size up to a whole number of cache lines.
+ */
+static inline size_t round_up( size_t size )
+{
+    return (size + 63) / 64 * 64;
+}
+
+
+/**
+ * \brief Maps zeroed memory that is shared with forked processes.
+ *
+ * \return The memory, or NULL (with a message on stderr) on failure.
+ */
+static void *map_shared( size_t size )
+{
+    char name[ 64 ];
+    snprintf( name, sizeof( name ), "/termites-%ld", (long) getpid( ) );
+    const int fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0600 );
+    if( fd < 0 ) {
+	perror( name );
+	return NULL;
+    }
+    shm_unlink( name );
+    if( ftruncate( fd, (off_t) size ) != 0 ) {
+	perror( name );
+	close( fd );
+	return NULL;
+    }
+    void *memory = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( memory == MAP_FAILED ) {
+	perror( name );
+	return NULL;
+    }
+    return memory;
+}
+
+
+/**
+ * \brief Returns the data of a ring.
+ */
+static inline unsigned char *ring_data( struct distributed_ring *ring )
+{
+    return (unsigned char*) (ring + 1);
+}
+
+
+/**
+ * \brief Writes bytes to a ring, waiting for room as needed.
+ */
+static void ring_write( struct distributed_ring *ring,
+			const void *data,
+			size_t size )
+{
+    const unsigned char *src = (const unsigned char*) data;
+    uint64_t head = ring->head;
+    while( size > 0 ) {
+	const uint64_t room = ring->capacity - (head - __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE ));
+	if( room == 0 ) {
+	    sched_yield( );
+	    continue;
+	}
+	const uint64_t offset = head % ring->capacity;
+	size_t n = size < room ? size : room;
+	if( n > ring->capacity - offset ) {
+	    n = ring->capacity - offset;
+	}
+	memcpy( ring_data( ring ) + offset, src, n );
+	src += n;
+	size -= n;
+	head += n;
+	__atomic_store_n( &ring->head, head, __ATOMIC_RELEASE );
+    }
+}
+
+
+/**
+ * \brief Reads bytes from a ring, waiting for them as needed.
+ */
+static void ring_read( struct distributed_ring *ring,
+		       void *data,
+		       size_t size )
+{
+    unsigned char *dst = (unsigned char*) data;
+    uint64_t tail = ring->tail;
+    while( size > 0 ) {
+	const uint64_t available = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE ) - tail;
+	if( available == 0 ) {
+	    sched_yield( );
+	    continue;
+	}
+	const uint64_t offset = tail % ring->capacity;
+	size_t n = size < available ? size : available;
+	if( n > ring->capacity - offset ) {
+	    n = ring->capacity - offset;
+	}
+	memcpy( dst, ring_data( ring ) + offset, n );
+	dst += n;
+	size -= n;
+	tail += n;
+	__atomic_store_n( &ring->tail, tail, __ATOMIC_RELEASE );
+    }
+}
+
+
+/**
+ * \brief Sends rows of a window (see blocked_window_pack()) through a
+ * ring, preceded by the size of the message.
+ */
+static void send_rows( struct distributed_ring *ring,
+		       const struct blocked_window *win,
+		       int first,
+		       int rows,
+		       void *buffer )
+{
+    const uint64_t size = blocked_window_pack( win, first, rows, buffer );
+    ring_write( ring, &size, sizeof( size ) );
+    ring_write( ring, buffer, size );
+}
+
+
+/**
+ * \brief Receives rows of a window sent by send_rows().
+ */
+static void receive_rows( struct distributed_ring *ring,
+			  struct blocked_window *win,
+			  int first,
+			  int rows,
+			  void *buffer )
+{
+    uint64_t size;
+    ring_read( ring, &size, sizeof( size ) );
+    ring_read( ring, buffer, size );
+    blocked_window_unpack( win, first, rows, buffer );
+}
+
+
+/**
+ * \brief Runs process rank of a run and exits.
+ */
+static void run_process( struct simulation *sim,
+			 struct distributed_shared *shared,
+			 int rank,
+			 int num_procs,
+			 int block_steps,
+			 uint64_t last_step )
+{
+    int width, height;
+    grid_get_size( &sim->grid, &width, &height );
+    const int halo = BLOCKED_REACH * block_steps;
+    struct distributed_ring *up = shared->rings[ 2 * rank ];
+    struct distributed_ring *down = shared->rings[ 2 * rank + 1 ];
+    struct distributed_ring *from_above = shared->rings[ 2 * ((rank + num_procs - 1) % num_procs) + 1 ];
+    struct distributed_ring *from_below = shared->rings[ 2 * ((rank + 1) % num_procs) ];
+
+    struct blocked_window win;
+    blocked_window_create( &win, width,
+			   (int) ((int64_t) height * rank / num_procs),
+			   (int) ((int64_t) height * (rank + 1) / num_procs), halo );
+    blocked_window_gather( &win, sim );
+    void *buffer = malloc( blocked_window_pack_size( width, halo, sim->num_termites ) );
+    assert( buffer != NULL );
+
+    /* Count only the events of this run. */
+    struct counters counters;
+    simulation_take_counters( sim, &counters );
+
+    uint64_t step = sim->step;
+    while( step < last_step ) {
+	const int num_steps = last_step - step < (uint64_t) block_steps ? (int) (last_step - step) : block_steps;
+	for( int s = 0; s < num_steps; ++s ) {
+	    blocked_window_step( &win, sim, step + s, &sim->counters[ 0 ], NULL );
+	}
+	step += num_steps;
+	if( step == last_step ) {
+	    break;
+	}
+
+	/* Exchange the halos. */
+	send_rows( up, &win, win.own_begin, halo, buffer );
+	send_rows( down, &win, win.own_end - halo, halo, buffer );
+	blocked_window_trim( &win );
+	receive_rows( from_above, &win, 0, halo, buffer );
+	receive_rows( from_below, &win, win.own_end, halo, buffer );
+    }
+
+    /* Point the (private) simulation at the shared result, so that
+     * the window is written there, and report.
+     */
+    sim->grid.termites = shared->planes;
+    sim->grid.chips = shared->planes + grid_plane_words( width, height, sim->grid.layout );
+    sim->termites = shared->termites;
+    blocked_window_scatter( &win, sim );
+
+    struct distributed_report *report = &shared->reports[ rank ];
+    for( int r = win.own_begin; r < win.own_end; ++r ) {
+	for( int x = 0; x < width; ++x ) {
+	    report->chips += grid_test( win.grid.chips, grid_index( &win.grid, x, r ) );
+	}
+    }
+    for( int i = 0; i < win.count; ++i ) {
+	if( win.y[ i ] >= win.own_begin && win.y[ i ] < win.own_end ) {
+	    ++report->termites;
+	    report->chips += (win.state[ i ] >> 2) & 1;
+	}
+    }
+    simulation_take_counters( sim, &report->counters );
+
+    free( buffer );
+    blocked_window_destroy( &win );
+    _exit( EXIT_SUCCESS );
+}
+
+
+bool distributed_run( struct simulation *sim,
+		      int num_procs,
+		      int block_steps,
+		      uint64_t last_step,
+		      struct distributed_totals *totals )
+{
+    assert( sim != NULL );
+    assert( sim->grid.layout != GRID_LAYOUT_SPARSE );
+    assert( sim->clusters == NULL );
+    assert( num_procs >= 1 && block_steps >= 1 );
+    assert( totals != NULL );
+
+    int width, height;
+    grid_get_size( &sim->grid, &width, &height );
+    const int min_rows = height / num_procs;
+    if( min_rows < BLOCKED_REACH ) {
+	fprintf( stderr, "The grid is too small for %d processes.\n", num_procs );
+	return false;
+    }
+    if( block_steps > min_rows / BLOCKED_REACH ) {
+	block_steps = min_rows / BLOCKED_REACH;
+    }
+    const int halo = BLOCKED_REACH * block_steps;
+
+    /* Step with the termite array (and no engine state) in the
+     * processes, and restore the engine from the result.
+     */
+    const enum simulation_engine engine = sim->engine;
+    simulation_set_engine( sim, SIMULATION_ENGINE_SCALAR );
+
+    /* Lay out the shared memory. Every ring holds one message of the
+     * largest size plus its size.
+     */
+    const size_t capacity = round_up( sizeof( uint64_t ) + blocked_window_pack_size( width, halo, sim->num_termites ) );
+    const size_t plane_words = grid_plane_words( width, height, sim->grid.layout );
+    const size_t reports_size = round_up( sizeof( struct distributed_report ) * num_procs );
+    const size_t planes_size = round_up( sizeof( uint64_t ) * 2 * plane_words );
+    const size_t termites_size = round_up( sizeof( struct termite ) * sim->num_termites );
+    const size_t ring_size = sizeof( struct distributed_ring ) + capacity;
+
+    struct distributed_shared shared;
+    shared.mapping_size = reports_size + planes_size + termites_size + 2 * num_procs * ring_size;
+    shared.mapping = map_shared( shared.mapping_size );
+    if( shared.mapping == NULL ) {
+	simulation_set_engine( sim, engine );
+	return false;
+    }
+    char *memory = (char*) shared.mapping;
+    shared.reports = (struct distributed_report*) memory;
+    shared.planes = (uint64_t*) (memory + reports_size);
+    shared.termites = (struct termite*) (memory + reports_size + planes_size);
+    shared.rings = malloc( sizeof( struct distributed_ring* ) * 2 * num_procs );
+    assert( shared.rings != NULL );
+    for( int i = 0; i < 2 * num_procs; ++i ) {
+	shared.rings[ i ] = (struct distributed_ring*) (memory + reports_size + planes_size + termites_size + i * ring_size);
+	shared.rings[ i ]->capacity = capacity;
+    }
+    memcpy( shared.termites, sim->termites, sizeof( struct termite ) * sim->num_termites );
+
+    /* Fork the processes. */
+    pid_t *pids = malloc( sizeof( pid_t ) * num_procs );
+    assert( pids != NULL );
+    fflush( stdout );
+    fflush( stderr );
+    int num_forked = 0;
+    bool ok = true;
+    for( ; num_forked < num_procs; ++num_forked ) {
+	pids[ num_forked ] = fork( );
+	if( pids[ num_forked ] == 0 ) {
+	    run_process( sim, &shared, num_forked, num_procs, block_steps, last_step );
+	}
+	if( pids[ num_forked ] < 0 ) {
+	    perror( "fork" );
+	    ok = false;
+	    break;
+	}
+    }
+
+    /* Wait for them. The neighbors of a process that failed would wait
+     * for its messages forever, so then all are stopped.
+     */
+    if( ! ok ) {
+	for( int r = 0; r < num_forked; ++r ) {
+	    kill( pids[ r ], SIGKILL );
+	}
+    }
+    for( int i = 0; i < num_forked; ++i ) {
+	int status;
+	const pid_t pid = wait( &status );
+	if( pid > 0 && ok && ! (WIFEXITED( status ) && WEXITSTATUS( status ) == EXIT_SUCCESS) ) {
+	    fprintf( stderr, "A simulation process failed.\n" );
+	    ok = false;
+	    for( int r = 0; r < num_forked; ++r ) {
+		kill( pids[ r ], SIGKILL );
+	    }
+	}
+    }
+    free( pids );
+
+    /* Reduce the reports and take over the result. */
+    if( ok ) {
+	totals->chips = 0;
+	totals->termites = 0;
+	for( int r = 0; r < num_procs; ++r ) {
+	    totals->chips += shared.reports[ r ].chips;
+	    totals->termites += shared.reports[ r ].termites;
+	    counters_sum( &sim->counters[ 0 ], &shared.reports[ r ].counters, 1 );
+	}
+	memcpy( sim->grid.termites, shared.planes, sizeof( uint64_t ) * plane_words );
+	memcpy( sim->grid.chips, shared.planes + plane_words, sizeof( uint64_t ) * plane_words );
+	memcpy( sim->termites, shared.termites, sizeof( struct termite ) * sim->num_termites );
+	if( sim->grid.layout == GRID_LAYOUT_PADDED ) {
+	    grid_update_all_ghosts( &sim->grid );
+	}
+	sim->step = last_step;
+    }
+    free( shared.rings );
+    munmap( shared.mapping, shared.mapping_size );
+    simulation_set_engine( sim, engine );
+    return ok;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "common.h"
+
+
+/**
+ * \brief The state of a simulation after a multi-process run, reduced
+ * over all processes.
+ */
+struct distributed_totals
+{
+    /** \brief The number of wood chips on the grid or carried by termites. */
+    int64_t chips;
+
+    /** \brief The number of termites. */
+    int64_t termites;
+};
+
+
+/**
+ * \brief Advances a simulation to the given time step on several
+ * processes.
+ *
+ * Bands.
+ *
+ * Process r owns rows height * r / num_procs to height * (r + 1) /
+ * num_procs - 1 of the grid and steps them in a window of the blocked
+ * engine (see struct blocked_window), with a halo of BLOCKED_REACH *
+ * block_steps rows on either side. The processes are forked from the
+ * calling one, so each starts from a private copy of the simulation,
+ * and they follow the synchronous update rule: the result is
+ * identical to that of the synchronous and blocked engines.
+ *
+ * Halo exchange.
+ *
+ * After every block a process sends the top rows it owns, with the
+ * termites in them, to the process above and its bottom rows to the
+ * process below, drops the termites in its halo and replaces the halo
+ * with the rows it receives. Termites that crossed into another band
+ * during the block thereby migrate to the process owning it. The
+ * messages travel through one single-producer, single-consumer ring
+ * buffer per direction and pair of neighbors, in POSIX shared memory
+ * mapped before forking. Every ring holds a whole message, so a
+ * process never waits for room while its neighbor waits for a message.
+ *
+ * At the end every process writes its rows, its termites, its chip
+ * and termite counts and its event counts to the shared memory, and
+ * the calling process reduces them and brings the simulation up to
+ * date.
+ *
+ * The grid must not have the sparse layout and the cluster
+ * statistics must not be enabled. The calling process only waits for
+ * the others, whatever the number of threads of the simulation.
+ *
+ * \param [in,out] sim
+ *
+ * \param [in] num_procs The number of processes.
+ *
+ * \param [in] block_steps The maximal number of time steps between two
+ * exchanges. It is reduced so that every band is at least
+ * BLOCKED_REACH * block_steps rows tall.
+ *
+ * \param [in] last_step The time step to advance to.
+ *
+ * \param [out] totals The reduced counts.
+ *
+ * \return True on success, false (with a message on stderr) if the
+ * grid is too small for the number of processes or a process failed.
+ */
+bool distributed_run( struct simulation *sim,
+		      int num_procs,
+		      int block_steps,
+		      uint64_t last_step,
+		      struct distributed_totals *totals );
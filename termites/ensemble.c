@@ -0,0 +1,118 @@
+#include "ensemble.h"
+
+#include "rng.h"
+
+
+/**
+ * \brief The state shared by the workers running an ensemble.
+ */
+struct ensemble_context
+{
+    /** \brief The configuration of the replicates. */
+    const struct ensemble_config *config;
+
+    /** \brief The number of replicates. */
+    int num_replicates;
+
+    /** \brief The index of the next replicate to hand out. */
+    int next;
+
+    /** \brief Protects next. */
+    pthread_mutex_t lock;
+
+    /** \brief The outcome of each replicate. */
+    struct ensemble_result *results;
+};
+
+
+/**
+ * \brief Hands out the next replicate, or returns -1 if none is left.
+ */
+static int take_replicate( struct ensemble_context *ctx )
+{
+    pthread_mutex_lock( &ctx->lock );
+    const int r = ctx->next < ctx->num_replicates ? ctx->next++ : -1;
+    pthread_mutex_unlock( &ctx->lock );
+    return r;
+}
+
+
+/**
+ * \brief Records the final state of a replicate.
+ */
+static void measure( const struct simulation *sim,
+		     struct ensemble_result *result )
+{
+    result->chips_carried = 0;
+    for( int k = 0; k < sim->num_termites; ++k ) {
+	if( termite_carries_wood_chip( &sim->termites[ k ] ) ) {
+	    ++result->chips_carried;
+	}
+    }
+
+    result->chip_pairs = grid_count_chip_pairs( &sim->grid );
+}
+
+
+/**
+ * \brief Runs replicates until none is left (see ensemble_run()).
+ */
+static void ensemble_task( void *arg,
+			   int worker,
+			   int num_workers )
+{
+    struct ensemble_context *ctx = (struct ensemble_context*) arg;
+    const struct ensemble_config *config = ctx->config;
+    (void) num_workers;
+
+    struct simulation sim;
+    bool created = false;
+    int r;
+    while( (r = take_replicate( ctx )) >= 0 ) {
+	struct ensemble_result *result = &ctx->results[ r ];
+	result->seed = rng_draw( config->seed, RNG_STREAM_ENSEMBLE, r );
+	result->worker = worker;
+	if( created ) {
+	    simulation_reset( &sim, result->seed );
+	} else {
+	    simulation_create_with_layout( &sim, config->width, config->height,
+					   config->num_chips, config->num_termites,
+					   result->seed, 1, config->layout );
+	    simulation_set_engine( &sim, config->engine );
+	    created = true;
+	}
+
+	const double t1 = gettime( );
+	while( sim.step < (uint64_t) config->num_time_steps ) {
+	    simulation_advance( &sim, (int) (config->num_time_steps - sim.step) );
+	}
+	result->seconds = gettime( ) - t1;
+
+	simulation_sync( &sim );
+	measure( &sim, result );
+    }
+    if( created ) {
+	simulation_destroy( &sim );
+    }
+}
+
+
+void ensemble_run( const struct ensemble_config *config,
+		   const int num_replicates,
+		   struct workers *workers,
+		   struct ensemble_result *results )
+{
+    assert( config != NULL );
+    assert( num_replicates >= 0 );
+    assert( workers != NULL );
+    assert( results != NULL || num_replicates == 0 );
+
+    struct ensemble_context ctx;
+    ctx.config = config;
+    ctx.num_replicates = num_replicates;
+    ctx.next = 0;
+    pthread_mutex_init( &ctx.lock, NULL );
+    ctx.results = results;
+    workers_run( workers, ensemble_task, &ctx );
+    pthread_mutex_destroy( &ctx.lock );
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "common.h"
+
+#include "simulation.h"
+
+
+/**
+ * \brief The configuration shared by all replicates of an ensemble.
+ */
+struct ensemble_config
+{
+    /** \brief The width of the grid. */
+    int width;
+
+    /** \brief The height of the grid. */
+    int height;
+
+    /** \brief The layout of the grid. */
+    enum grid_layout layout;
+
+    /** \brief The number of wood chips. */
+    int num_chips;
+
+    /** \brief The number of termites. */
+    int num_termites;
+
+    /** \brief The number of time steps of each replicate. */
+    int num_time_steps;
+
+    /** \brief The engine stepping each replicate. */
+    enum simulation_engine engine;
+
+    /**
+     * \brief The seed of the ensemble. Replicate r is seeded with draw
+     * r of the ensemble stream (see rng.h).
+     */
+    uint64_t seed;
+};
+
+
+/**
+ * \brief The outcome of one replicate of an ensemble.
+ */
+struct ensemble_result
+{
+    /** \brief The seed of the replicate. */
+    uint64_t seed;
+
+    /** \brief The index of the worker that ran the replicate. */
+    int worker;
+
+    /** \brief The wall clock time of the time steps (in seconds). */
+    double seconds;
+
+    /** \brief The number of chips carried by termites at the end. */
+    int chips_carried;
+
+    /**
+     * \brief The number of pairs of horizontally or vertically
+     * adjacent chips at the end (a measure of clustering).
+     */
+    int64_t chip_pairs;
+};
+
+
+/**
+ * \brief Runs independent replicates of a simulation on a team of
+ * workers.
+ *
+ * Every worker owns one simulation (its slot of the pool) which is
+ * created for the first replicate the worker runs and reset with
+ * simulation_reset() for every further one, so the grid and termite
+ * allocations are reused. The replicates are handed out dynamically,
+ * one at a time. Each replicate is stepped sequentially by its worker.
+ *
+ * The replicates share no state, and their random numbers depend only
+ * on their seeds, so the results do not depend on the number of
+ * workers or on the schedule.
+ *
+ * \param [in] config The configuration of the replicates.
+ *
+ * \param [in] num_replicates The number of replicates.
+ *
+ * \param [in,out] workers The workers to run the replicates on.
+ *
+ * \param [out] results The outcome of each replicate (num_replicates
+ * items).
+ */
+void ensemble_run( const struct ensemble_config *config,
+		   int num_replicates,
+		   struct workers *workers,
+		   struct ensemble_result *results );
@@ -0,0 +1,219 @@
+#include "frames.h"
+
+
+/**
+ * \brief Returns the size in bytes of an encoded frame.
+ */
+static size_t encoded_size( enum frames_format format,
+			    int width,
+			    int height )
+{
+    if( format == FRAMES_FORMAT_ASCII ) {
+	/* A line of column indices, then one line per row, each with
+	 * a row index, a space and a newline.
+	 */
+	return (size_t) (width + 3) * (height + 1);
+    }
+    /* A header of at most 64 bytes, then the packed rows. */
+    return 64 + (size_t) (width + 7) / 8 * height;
+}
+
+
+/**
+ * \brief Encodes a frame as simulation_print_ascii() would print it.
+ *
+ * \return The number of bytes.
+ */
+static size_t encode_ascii( const struct grid *grid,
+			    char *buffer )
+{
+    char *p = buffer;
+    *p++ = ' ';
+    *p++ = ' ';
+    for( int x = 0; x < grid->width; ++x ) {
+	*p++ = '0' + x % 10;
+    }
+    *p++ = '\n';
+    for( int y = 0; y < grid->height; ++y ) {
+	*p++ = '0' + y % 10;
+	*p++ = ' ';
+	for( int x = 0; x < grid->width; ++x ) {
+	    const size_t i = grid_index( grid, x, y );
+	    *p++ = grid_test( grid->chips, i ) ? 'O' : (grid_test( grid->termites, i ) ? '+' : ' ');
+	}
+	*p++ = '\n';
+    }
+    return p - buffer;
+}
+
+
+/**
+ * \brief Encodes the chips of a frame as a binary PBM image, with the
+ * time step in a comment.
+ *
+ * \return The number of bytes.
+ */
+static size_t encode_pbm( const struct frames_frame *frame,
+			  char *buffer )
+{
+    const struct grid *grid = &frame->grid;
+    const int header = sprintf( buffer, "P4\n# step %llu\n%d %d\n",
+				(unsigned long long) frame->step, grid->width, grid->height );
+    unsigned char *p = (unsigned char*) buffer + header;
+    for( int y = 0; y < grid->height; ++y ) {
+	const size_t row = grid_index( grid, 0, y );
+	for( int x = 0; x < grid->width; x += 8 ) {
+	    unsigned char byte = 0;
+	    for( int b = 0; b < 8 && x + b < grid->width; ++b ) {
+		byte |= grid_test( grid->chips, row + x + b ) << (7 - b);
+	    }
+	    *p++ = byte;
+	}
+    }
+    return (char*) p - buffer;
+}
+
+
+/**
+ * \brief The main loop of the writer thread.
+ *
+ * \param [in,out] arg The frames.
+ *
+ * \return Always NULL.
+ */
+static void *writer_main( void *arg )
+{
+    struct frames *frames = (struct frames*) arg;
+
+    pthread_mutex_lock( &frames->lock );
+    for( ;; ) {
+	while( frames->count == 0 && ! frames->quit ) {
+	    pthread_cond_wait( &frames->queued, &frames->lock );
+	}
+	if( frames->count == 0 ) {
+	    break;
+	}
+
+	/* The frame stays out of reach of frames_push() until it is
+	 * released below.
+	 */
+	const struct frames_frame *frame = &frames->ring[ frames->first ];
+	pthread_mutex_unlock( &frames->lock );
+	const size_t size = frames->format == FRAMES_FORMAT_ASCII
+	    ? encode_ascii( &frame->grid, frames->buffer )
+	    : encode_pbm( frame, frames->buffer );
+	const bool ok = fwrite( frames->buffer, 1, size, frames->out ) == size;
+	pthread_mutex_lock( &frames->lock );
+
+	frames->failed |= ! ok;
+	frames->written += ok;
+	frames->first = (frames->first + 1) % FRAMES_RING_SIZE;
+	--frames->count;
+	pthread_cond_signal( &frames->written_one );
+    }
+    pthread_mutex_unlock( &frames->lock );
+    fflush( frames->out );
+    return NULL;
+}
+
+
+enum frames_format frames_choose_format( const int width,
+					 const int height )
+{
+    return (double) width * height <= FRAMES_MAX_ASCII_CELLS ? FRAMES_FORMAT_ASCII : FRAMES_FORMAT_PBM;
+}
+
+
+void frames_create( struct frames *frames,
+		    const struct grid *grid,
+		    const enum frames_format format,
+		    FILE *out,
+		    const bool keep_all )
+{
+    assert( frames != NULL );
+    assert( grid != NULL );
+    assert( out != NULL );
+    assert( grid->layout != GRID_LAYOUT_SPARSE );
+
+    frames->format = format;
+    frames->out = out;
+    frames->keep_all = keep_all;
+    for( int i = 0; i < FRAMES_RING_SIZE; ++i ) {
+	struct frames_frame *frame = &frames->ring[ i ];
+	frame->step = 0;
+	frame->planes = calloc( 2 * grid->num_words, sizeof( uint64_t ) );
+	assert( frame->planes != NULL );
+	grid_create_on_planes( &frame->grid, grid->width, grid->height, grid->layout, frame->planes );
+    }
+    frames->first = 0;
+    frames->count = 0;
+    frames->buffer = malloc( encoded_size( format, grid->width, grid->height ) );
+    assert( frames->buffer != NULL );
+    frames->written = 0;
+    frames->dropped = 0;
+    frames->failed = false;
+    frames->quit = false;
+    pthread_mutex_init( &frames->lock, NULL );
+    pthread_cond_init( &frames->queued, NULL );
+    pthread_cond_init( &frames->written_one, NULL );
+    const int error = pthread_create( &frames->writer, NULL, writer_main, frames );
+    assert( error == 0 );
+    (void) error;
+}
+
+
+bool frames_destroy( struct frames *frames )
+{
+    assert( frames != NULL );
+
+    pthread_mutex_lock( &frames->lock );
+    frames->quit = true;
+    pthread_cond_signal( &frames->queued );
+    pthread_mutex_unlock( &frames->lock );
+    pthread_join( frames->writer, NULL );
+
+    pthread_cond_destroy( &frames->queued );
+    pthread_cond_destroy( &frames->written_one );
+    pthread_mutex_destroy( &frames->lock );
+    for( int i = 0; i < FRAMES_RING_SIZE; ++i ) {
+	grid_destroy( &frames->ring[ i ].grid );
+	free( frames->ring[ i ].planes );
+	frames->ring[ i ].planes = NULL;
+    }
+    free( frames->buffer );
+    frames->buffer = NULL;
+    return ! frames->failed;
+}
+
+
+bool frames_push( struct frames *frames,
+		  const struct grid *grid,
+		  const uint64_t step )
+{
+    assert( frames != NULL );
+    assert( grid != NULL );
+
+    pthread_mutex_lock( &frames->lock );
+    while( frames->keep_all && frames->count == FRAMES_RING_SIZE ) {
+	pthread_cond_wait( &frames->written_one, &frames->lock );
+    }
+    const bool full = frames->count == FRAMES_RING_SIZE;
+    const int next = (frames->first + frames->count) % FRAMES_RING_SIZE;
+    pthread_mutex_unlock( &frames->lock );
+    if( full ) {
+	++frames->dropped;
+	return false;
+    }
+
+    /* The writer does not touch the next frame until it is queued. */
+    struct frames_frame *frame = &frames->ring[ next ];
+    frame->step = step;
+    memcpy( frame->grid.termites, grid->termites, grid->num_words * sizeof( uint64_t ) );
+    memcpy( frame->grid.chips, grid->chips, grid->num_words * sizeof( uint64_t ) );
+
+    pthread_mutex_lock( &frames->lock );
+    ++frames->count;
+    pthread_cond_signal( &frames->queued );
+    pthread_mutex_unlock( &frames->lock );
+    return true;
+}
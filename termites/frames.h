@@ -0,0 +1,175 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "common.h"
+
+#include "grid.h"
+
+
+/** \brief The number of frames that can wait for the writer. */
+#define FRAMES_RING_SIZE 4
+
+
+/** \brief The largest grid (in cells) written as ASCII by default. */
+#define FRAMES_MAX_ASCII_CELLS (256 * 256)
+
+
+/**
+ * \brief The encodings of a frame.
+ */
+enum frames_format
+{
+    /**
+     * \brief The grid as text, as simulation_print_ascii() prints it:
+     * 'O' for a wood chip and '+' for a termite.
+     */
+    FRAMES_FORMAT_ASCII,
+
+    /**
+     * \brief The wood chips as a binary PBM (P4) image, one pixel per
+     * cell. The images of consecutive frames follow each other in the
+     * output, which netpbm tools read as a multi-image file.
+     */
+    FRAMES_FORMAT_PBM
+};
+
+
+/**
+ * \brief One copy of the grid waiting to be written.
+ */
+struct frames_frame
+{
+    /** \brief The time step of the copy. */
+    uint64_t step;
+
+    /** \brief The copy, on the planes below. */
+    struct grid grid;
+
+    /** \brief The copied termite and chip planes. */
+    uint64_t *planes;
+};
+
+
+/**
+ * \brief Writes snapshots of the grid on a separate thread.
+ *
+ * The simulation thread only copies the bit planes of the grid into a
+ * free frame of a ring (a memcpy() per plane), and a writer thread
+ * encodes the frames and writes each with one fwrite(). If the writer
+ * falls so far behind that the whole ring waits, the new frame is
+ * dropped and counted instead, so the simulation never waits for the
+ * output, unless every frame is to be kept.
+ */
+struct frames
+{
+    /** \brief The encoding. */
+    enum frames_format format;
+
+    /** \brief The output. */
+    FILE *out;
+
+    /** \brief Flag that is true if frames are never dropped. */
+    bool keep_all;
+
+    /** \brief The ring of frames. */
+    struct frames_frame ring[ FRAMES_RING_SIZE ];
+
+    /** \brief The oldest frame waiting for the writer. */
+    int first;
+
+    /** \brief The number of frames waiting for the writer. */
+    int count;
+
+    /** \brief Buffer for one encoded frame (writer thread only). */
+    char *buffer;
+
+    /** \brief The number of frames written. */
+    uint64_t written;
+
+    /** \brief The number of frames dropped. */
+    uint64_t dropped;
+
+    /** \brief Flag that is true if writing failed. */
+    bool failed;
+
+    /** \brief Flag that is true when the writer should exit. */
+    bool quit;
+
+    /** \brief Lock protecting first, count, written, failed and quit. */
+    pthread_mutex_t lock;
+
+    /** \brief Signaled when a frame is queued or the writer should exit. */
+    pthread_cond_t queued;
+
+    /** \brief Signaled when the writer has written a frame. */
+    pthread_cond_t written_one;
+
+    /** \brief The writer thread. */
+    pthread_t writer;
+};
+
+
+/**
+ * \brief Returns the default encoding for a grid of the given size:
+ * ASCII up to FRAMES_MAX_ASCII_CELLS cells and PBM above.
+ *
+ * \param [in] width
+ *
+ * \param [in] height
+ *
+ * \return The encoding.
+ */
+enum frames_format frames_choose_format( int width,
+					 int height );
+
+
+/**
+ * \brief Creates the ring for a grid and starts the writer thread.
+ *
+ * \param [out] frames
+ *
+ * \param [in] grid The grid whose frames are written, which may not
+ * have the sparse layout.
+ *
+ * \param [in] format The encoding.
+ *
+ * \param [in,out] out The output, which must stay open until
+ * frames_destroy() returns.
+ *
+ * \param [in] keep_all If true, frames_push() waits for a free frame
+ * rather than dropping the new one.
+ */
+void frames_create( struct frames *frames,
+		    const struct grid *grid,
+		    enum frames_format format,
+		    FILE *out,
+		    bool keep_all );
+
+
+/**
+ * \brief Writes all queued frames, stops the writer thread and
+ * releases all resources.
+ *
+ * \param [in,out] frames
+ *
+ * \return False if a frame could not be written.
+ */
+bool frames_destroy( struct frames *frames );
+
+
+/**
+ * \brief Queues a copy of the grid, unless the ring is full and frames
+ * may be dropped.
+ *
+ * \param [in,out] frames
+ *
+ * \param [in] grid The grid passed to frames_create().
+ *
+ * \param [in] step The time step.
+ *
+ * \return True if the frame was queued, false if it was dropped.
+ */
+bool frames_push( struct frames *frames,
+		  const struct grid *grid,
+		  uint64_t step );
@@ -1,6 +1,14 @@
+#define _DEFAULT_SOURCE
+
+#include <sys/mman.h>
+
 #include "grid.h"
 
 
+/** \brief Whether new planes are backed by huge pages (see grid_set_huge_pages()). */
+static bool huge_pages = false;
+
+
 /**
  * \brief Wraps the coordinates around the boundaries.
  *
@@ -19,46 +27,166 @@ static void wrap_coords( const struct grid *grid,
 			 int *x, 
 			 int *y )
 {
-    if( (*x) < 0 ) {
-	(*x) += grid->width;
-    }
-    if( (*x) >= grid->width ) {
-	(*x) -= grid->width;
+    switch( grid->layout ) {
+    case GRID_LAYOUT_POW2:
+	grid_wrap( grid, GRID_LAYOUT_POW2, x, y );
+	break;
+    default:
+	grid_wrap( grid, GRID_LAYOUT_GENERIC, x, y );
+	break;
     }
-    if( (*y) < 0 ) {
-	(*y) += grid->height;
+}
+
+
+/**
+ * \brief Returns true if n is a power of two.
+ */
+static bool is_pow2( int n )
+{
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+
+enum grid_layout grid_choose_layout( const int width,
+				     const int height )
+{
+    if( (double) width * height >= GRID_SPARSE_MIN_CELLS ) {
+	return GRID_LAYOUT_SPARSE;
     }
-    if( (*y) >= grid->height ) {
-	(*y) -= grid->height;
+    if( is_pow2( width ) && is_pow2( height ) ) {
+	return GRID_LAYOUT_POW2;
     }
+    return GRID_LAYOUT_PADDED;
 }
 
 
 void grid_create( struct grid *grid,
 		  const int width,
 		  const int height )
+{
+    grid_create_with_layout( grid, width, height, grid_choose_layout( width, height ) );
+}
+
+
+/**
+ * \brief Sets up the geometry of a grid (everything except the planes).
+ *
+ * \param [out] grid
+ *
+ * \param [in] width
+ *
+ * \param [in] height
+ *
+ * \param [in] layout
+ */
+static void init_geometry( struct grid *grid,
+			   const int width,
+			   const int height,
+			   const enum grid_layout layout )
 {
     assert( grid != NULL );
     assert( width > 0 );
     assert( height > 0 );
+    assert( layout != GRID_LAYOUT_POW2 || (is_pow2( width ) && is_pow2( height )) );
 
     /* An implementation note.
      *
-     * The cells are stored in the form of an "array of arrays", which
-     * means that cells is an array of length height holding arrays of
-     * length width (one such array per row in the conceptual 2D
-     * array).
+     * The cells are stored in the form of two bit planes in one
+     * contiguous allocation (the chip plane directly follows the
+     * termite plane). Row y starts at bit origin + y * stride, so rows
+     * are not aligned to word boundaries. Looking up a cell is a
+     * multiply-add followed by a shift and a mask, with no pointer
+     * chasing.
+     *
+     * The padded layout adds a ghost column on each side and a ghost
+     * row above and below the grid.
+     *
+     * The sparse layout has no planes. Its cells live in chunks of
+     * 64-by-64 cells, one word per chunk row and plane, found by
+     * hashing the chunk coordinates.
      */
 
     grid->width = width;
     grid->height = height;
-    grid->cells = (struct cell**) malloc( sizeof( struct cell* ) * height );
-    for( int y = 0; y < height; ++y ) {
-	grid->cells[ y ] = (struct cell*) malloc( sizeof( struct cell ) * width );
-	for( int x = 0; x < width; ++x ) {
-	    cell_create( &grid->cells[ y ][ x ] );
-	}
+    grid->layout = layout;
+    if( layout == GRID_LAYOUT_PADDED ) {
+	grid->stride = width + 2;
+	grid->origin = (size_t) grid->stride + 1;
+    } else {
+	grid->stride = width;
+	grid->origin = 0;
+    }
+    grid->offset[ NORTH ] = -(ptrdiff_t) grid->stride;
+    grid->offset[ EAST ] = 1;
+    grid->offset[ SOUTH ] = grid->stride;
+    grid->offset[ WEST ] = -1;
+    grid->num_words = grid_plane_words( width, height, layout );
+}
+
+
+size_t grid_plane_words( const int width,
+			 const int height,
+			 const enum grid_layout layout )
+{
+    assert( width > 0 );
+    assert( height > 0 );
+
+    size_t num_cells = (size_t) width * height;
+    if( layout == GRID_LAYOUT_SPARSE ) {
+	return 0;
+    }
+    if( layout == GRID_LAYOUT_PADDED ) {
+	num_cells = (size_t) (width + 2) * (height + 2);
+    }
+    return (num_cells + 63) / 64;
+}
+
+
+void grid_create_with_layout( struct grid *grid,
+			      const int width,
+			      const int height,
+			      const enum grid_layout layout )
+{
+    init_geometry( grid, width, height, layout );
+    grid->owns_planes = true;
+    if( layout == GRID_LAYOUT_SPARSE ) {
+	grid->termites = NULL;
+	grid->chips = NULL;
+	chunkmap_create( &grid->chunks );
+	return;
+    }
+
+    /* Map the planes directly rather than calling calloc(), which may
+     * clear recycled memory on the calling thread. Mapped pages are
+     * zero and not placed on any node until they are first written
+     * (see grid_first_touch()).
+     */
+    const size_t size = 2 * grid->num_words * sizeof( uint64_t );
+    void *planes = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    assert( planes != MAP_FAILED );
+#ifdef MADV_HUGEPAGE
+    if( huge_pages ) {
+	madvise( planes, size, MADV_HUGEPAGE );
     }
+#endif
+    grid->termites = (uint64_t*) planes;
+    grid->chips = grid->termites + grid->num_words;
+}
+
+
+void grid_create_on_planes( struct grid *grid,
+			    const int width,
+			    const int height,
+			    const enum grid_layout layout,
+			    uint64_t *planes )
+{
+    assert( planes != NULL );
+    assert( layout != GRID_LAYOUT_SPARSE );
+
+    init_geometry( grid, width, height, layout );
+    grid->termites = planes;
+    grid->chips = planes + grid->num_words;
+    grid->owns_planes = false;
 }
 
 
@@ -66,13 +194,259 @@ void grid_destroy( struct grid *grid )
 {
     assert( grid != NULL );
 
+    if( grid->layout == GRID_LAYOUT_SPARSE ) {
+	chunkmap_destroy( &grid->chunks );
+    } else if( grid->owns_planes ) {
+	munmap( grid->termites, 2 * grid->num_words * sizeof( uint64_t ) );
+    }
+    grid->termites = NULL;
+    grid->chips = NULL;
+    grid->num_words = 0;
+}
+
+
+void grid_set_huge_pages( const bool enable )
+{
+    huge_pages = enable;
+}
+
+
+/**
+ * \brief Returns the first word of the planes that holds a cell of a
+ * band of rows (see grid_first_touch()).
+ */
+static size_t band_start( const struct grid *grid,
+			  const int part,
+			  const int num_parts )
+{
+    if( part == 0 ) {
+	return 0;
+    }
+    if( part == num_parts ) {
+	return grid->num_words;
+    }
+    const int row = (int) ((int64_t) grid->height * part / num_parts);
+    return (grid->origin + (size_t) row * grid->stride) / 64;
+}
+
+
+void grid_first_touch( struct grid *grid,
+		       const int part,
+		       const int num_parts )
+{
+    assert( grid != NULL );
+    assert( part >= 0 && part < num_parts );
+
+    if( grid->layout == GRID_LAYOUT_SPARSE ) {
+	return;
+    }
+    const size_t begin = band_start( grid, part, num_parts );
+    const size_t end = band_start( grid, part + 1, num_parts );
+    memset( &grid->termites[ begin ], 0, (end - begin) * sizeof( uint64_t ) );
+    memset( &grid->chips[ begin ], 0, (end - begin) * sizeof( uint64_t ) );
+}
+
+
+void grid_clear( struct grid *grid )
+{
+    assert( grid != NULL );
+
+    if( grid->layout == GRID_LAYOUT_SPARSE ) {
+	chunkmap_clear( &grid->chunks );
+    } else {
+	memset( grid->termites, 0, grid->num_words * sizeof( uint64_t ) );
+	memset( grid->chips, 0, grid->num_words * sizeof( uint64_t ) );
+    }
+}
+
+
+int grid_get_ghosts( const struct grid *grid,
+		     const int x,
+		     const int y,
+		     size_t ghosts[ GRID_MAX_GHOSTS ] )
+{
+    assert( grid != NULL );
+    assert( x >= 0 && x < grid->width );
+    assert( y >= 0 && y < grid->height );
+
+    if( grid->layout != GRID_LAYOUT_PADDED ) {
+	return 0;
+    }
+
+    /* The ghost columns and rows that mirror column x and row y. */
+    int xs[ 3 ], ys[ 3 ];
+    int nx = 0, ny = 0;
+    xs[ nx++ ] = x;
+    ys[ ny++ ] = y;
+    if( x == 0 ) {
+	xs[ nx++ ] = grid->width;
+    }
+    if( x == grid->width - 1 ) {
+	xs[ nx++ ] = -1;
+    }
+    if( y == 0 ) {
+	ys[ ny++ ] = grid->height;
+    }
+    if( y == grid->height - 1 ) {
+	ys[ ny++ ] = -1;
+    }
+
+    int count = 0;
+    for( int i = 0; i < ny; ++i ) {
+	for( int j = 0; j < nx; ++j ) {
+	    if( i > 0 || j > 0 ) {
+		ghosts[ count++ ] = grid->origin + (ptrdiff_t) ys[ i ] * grid->stride + xs[ j ];
+	    }
+	}
+    }
+    return count;
+}
+
+
+void grid_update_ghosts( struct grid *grid,
+			 const int x,
+			 const int y )
+{
+    assert( grid != NULL );
+
+    size_t ghosts[ GRID_MAX_GHOSTS ];
+    const int count = grid_get_ghosts( grid, x, y, ghosts );
+    if( count == 0 ) {
+	return;
+    }
+    const size_t k = grid_index( grid, x, y );
+    const bool termite = grid_test( grid->termites, k );
+    const bool chip = grid_test( grid->chips, k );
+    for( int i = 0; i < count; ++i ) {
+	const size_t g = ghosts[ i ];
+	const uint64_t bit = UINT64_C( 1 ) << (g & 63);
+	grid->termites[ g >> 6 ] = (grid->termites[ g >> 6 ] & ~bit) | (termite ? bit : 0);
+	grid->chips[ g >> 6 ] = (grid->chips[ g >> 6 ] & ~bit) | (chip ? bit : 0);
+    }
+}
+
+
+void grid_update_all_ghosts( struct grid *grid )
+{
+    assert( grid != NULL );
+
+    if( grid->layout != GRID_LAYOUT_PADDED ) {
+	return;
+    }
+    for( int x = 0; x < grid->width; ++x ) {
+	grid_update_ghosts( grid, x, 0 );
+	grid_update_ghosts( grid, x, grid->height - 1 );
+    }
     for( int y = 0; y < grid->height; ++y ) {
-	for( int x = 0; x < grid->width; ++x ) {
-	    cell_destroy( &grid->cells[ y ][ x ] );
+	grid_update_ghosts( grid, 0, y );
+	grid_update_ghosts( grid, grid->width - 1, y );
+    }
+}
+
+
+/**
+ * \brief Returns the cell bit of a chunk of a sparse grid.
+ *
+ * \param [in] grid
+ *
+ * \param [in] chip True for the chip plane, false for the termite plane.
+ *
+ * \param [in] x The wrapped x-coordinate.
+ *
+ * \param [in] y The wrapped y-coordinate.
+ */
+static bool sparse_test( const struct grid *grid,
+			 const bool chip,
+			 const int x,
+			 const int y )
+{
+    const struct chunk *chunk = chunkmap_find( &grid->chunks, chunkmap_key( x / CHUNKMAP_CHUNK_SIZE,
+									    y / CHUNKMAP_CHUNK_SIZE ) );
+    if( chunk == NULL ) {
+	return false;
+    }
+    const uint64_t word = chip ? chunk->chips[ y % CHUNKMAP_CHUNK_SIZE ] : chunk->termites[ y % CHUNKMAP_CHUNK_SIZE ];
+    return (word >> (x % CHUNKMAP_CHUNK_SIZE)) & 1;
+}
+
+
+/**
+ * \brief Sets or clears the cell bit of a chunk of a sparse grid,
+ * creating the chunk on the first set bit and releasing it when its
+ * last bit is cleared.
+ */
+static void sparse_assign( struct grid *grid,
+			   const bool chip,
+			   const int x,
+			   const int y,
+			   const bool value )
+{
+    const uint64_t key = chunkmap_key( x / CHUNKMAP_CHUNK_SIZE, y / CHUNKMAP_CHUNK_SIZE );
+    struct chunk *chunk = value ? chunkmap_insert( &grid->chunks, key ) : chunkmap_find( &grid->chunks, key );
+    if( chunk == NULL ) {
+	return;
+    }
+    uint64_t *word = chip ? &chunk->chips[ y % CHUNKMAP_CHUNK_SIZE ] : &chunk->termites[ y % CHUNKMAP_CHUNK_SIZE ];
+    const uint64_t bit = UINT64_C( 1 ) << (x % CHUNKMAP_CHUNK_SIZE);
+    if( value && ! ((*word) & bit) ) {
+	(*word) |= bit;
+	++chunk->population;
+    } else if( ! value && ((*word) & bit) ) {
+	(*word) &= ~bit;
+	if( --chunk->population == 0 ) {
+	    chunkmap_remove( &grid->chunks, key );
 	}
-	free( grid->cells[ y ] );
     }
-    free( grid->cells );
+}
+
+
+/**
+ * \brief Returns the bit of a cell.
+ *
+ * \param [in] grid
+ *
+ * \param [in] chip True for the chip plane, false for the termite plane.
+ *
+ * \param [in] x The wrapped x-coordinate.
+ *
+ * \param [in] y The wrapped y-coordinate.
+ */
+static bool test( const struct grid *grid,
+		  const bool chip,
+		  const int x,
+		  const int y )
+{
+    if( grid->layout == GRID_LAYOUT_SPARSE ) {
+	return sparse_test( grid, chip, x, y );
+    }
+    return grid_test( chip ? grid->chips : grid->termites, grid_index( grid, x, y ) );
+}
+
+
+/**
+ * \brief Sets or clears the bit of a cell.
+ *
+ * \param [in,out] grid
+ *
+ * \param [in] chip True for the chip plane, false for the termite plane.
+ *
+ * \param [in] x The wrapped x-coordinate.
+ *
+ * \param [in] y The wrapped y-coordinate.
+ *
+ * \param [in] value
+ */
+static void assign( struct grid *grid,
+		    const bool chip,
+		    const int x,
+		    const int y,
+		    const bool value )
+{
+    if( grid->layout == GRID_LAYOUT_SPARSE ) {
+	sparse_assign( grid, chip, x, y, value );
+    } else {
+	grid_assign( grid, grid->layout, chip ? grid->chips : grid->termites, x, y, value );
+    }
 }
 
 
@@ -83,9 +457,8 @@ void grid_place_termite_at( struct grid *grid,
     assert( grid != NULL );
 
     wrap_coords( grid, &x, &y );
-    struct cell *cell = &grid->cells[ y ][ x ];
-    assert( cell_has_termite( cell ) == false );
-    cell_place_termite( cell );
+    assert( test( grid, false, x, y ) == false );
+    assign( grid, false, x, y, true );
 }
 
 
@@ -96,9 +469,8 @@ void grid_place_wood_chip_at( struct grid *grid,
     assert( grid != NULL );
 
     wrap_coords( grid, &x, &y );
-    struct cell *cell = &grid->cells[ y ][ x ];
-    assert( cell_has_wood_chip( cell ) == false );
-    cell_place_wood_chip( cell );
+    assert( test( grid, true, x, y ) == false );
+    assign( grid, true, x, y, true );
 }
 
 
@@ -109,8 +481,7 @@ bool grid_has_termite_at( const struct grid *grid,
     assert( grid != NULL );
 
     wrap_coords( grid, &x, &y );
-    struct cell *cell = &grid->cells[ y ][ x ];
-    return cell_has_termite( cell );
+    return test( grid, false, x, y );
 }
 
 
@@ -121,8 +492,7 @@ bool grid_has_wood_chip_at( const struct grid *grid,
     assert( grid != NULL );
 
     wrap_coords( grid, &x, &y );
-    struct cell *cell = &grid->cells[ y ][ x ];
-    return cell_has_wood_chip( cell );
+    return test( grid, true, x, y );
 }
 
 
@@ -136,28 +506,11 @@ void grid_get_coords_in_direction( const struct grid *grid,
     assert( grid != NULL );
     assert( x_out != NULL );
     assert( y_out != NULL );
+    assert( direction >= NORTH && direction <= WEST );
 
     wrap_coords( grid, &x, &y );
-    (*x_out) = x;
-    (*y_out) = y;
-    switch( direction ) {
-    case NORTH:
-	(*y_out) -= 1;
-	break;
-    case EAST:
-	(*x_out) += 1;
-	break;
-    case SOUTH:
-	(*y_out) += 1;
-	break;
-    case WEST:
-	(*x_out) -= 1;
-	break;
-    default:
-	assert( 0 );
-	break;
-    }
-
+    (*x_out) = x + grid_dx[ direction ];
+    (*y_out) = y + grid_dy[ direction ];
     wrap_coords( grid, x_out, y_out );
 }
 
@@ -169,8 +522,8 @@ void grid_remove_termite_at( struct grid *grid,
     assert( grid != NULL );
 
     wrap_coords( grid, &x, &y );
-    struct cell *cell = &grid->cells[ y ][ x ];
-    cell_remove_termite( cell );
+    assert( test( grid, false, x, y ) == true );
+    assign( grid, false, x, y, false );
 }
 
 
@@ -181,8 +534,8 @@ void grid_remove_wood_chip_at( struct grid *grid,
     assert( grid != NULL );
 
     wrap_coords( grid, &x, &y );
-    struct cell *cell = &grid->cells[ y ][ x ];
-    cell_remove_wood_chip( cell );
+    assert( test( grid, true, x, y ) == true );
+    assign( grid, true, x, y, false );
 }
 
 
@@ -197,3 +550,60 @@ void grid_get_size( const struct grid *grid,
     (*width) = grid->width;
     (*height) = grid->height;
 }
+
+
+/**
+ * \brief Returns the number of chips right of and below the chip at
+ * (x, y) (0, 1 or 2).
+ */
+static int chip_pairs_at( const struct grid *grid,
+			  const int x,
+			  const int y )
+{
+    return grid_has_wood_chip_at( grid, x + 1 < grid->width ? x + 1 : 0, y )
+	+ grid_has_wood_chip_at( grid, x, y + 1 < grid->height ? y + 1 : 0 );
+}
+
+
+int64_t grid_count_chip_pairs( const struct grid *grid )
+{
+    assert( grid != NULL );
+
+    int64_t pairs = 0;
+    if( grid->layout == GRID_LAYOUT_SPARSE ) {
+	const struct chunkmap *map = &grid->chunks;
+	for( size_t slot = 0; slot < map->capacity; ++slot ) {
+	    const struct chunk *chunk = map->chunks[ slot ];
+	    if( chunk == NULL ) {
+		continue;
+	    }
+	    const int x0 = (int) (map->keys[ slot ] & UINT32_MAX) * CHUNKMAP_CHUNK_SIZE;
+	    const int y0 = (int) (map->keys[ slot ] >> 32) * CHUNKMAP_CHUNK_SIZE;
+	    for( int r = 0; r < CHUNKMAP_CHUNK_SIZE; ++r ) {
+		for( uint64_t bits = chunk->chips[ r ]; bits != 0; bits &= bits - 1 ) {
+		    pairs += chip_pairs_at( grid, x0 + __builtin_ctzll( bits ), y0 + r );
+		}
+	    }
+	}
+	return pairs;
+    }
+    for( int y = 0; y < grid->height; ++y ) {
+	for( int x = 0; x < grid->width; ++x ) {
+	    if( grid_test( grid->chips, grid_index( grid, x, y ) ) ) {
+		pairs += chip_pairs_at( grid, x, y );
+	    }
+	}
+    }
+    return pairs;
+}
+
+
+size_t grid_get_memory_footprint( const struct grid *grid )
+{
+    assert( grid != NULL );
+
+    if( grid->layout == GRID_LAYOUT_SPARSE ) {
+	return chunkmap_get_memory_footprint( &grid->chunks );
+    }
+    return 2 * grid->num_words * sizeof( uint64_t );
+}
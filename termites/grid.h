@@ -2,7 +2,63 @@
 
 #include "common.h"
 
-#include "cell.h"
+#include "chunkmap.h"
+
+
+/**
+ * \brief The memory layouts of the grid planes.
+ *
+ * All layouts store row y of the grid at bits origin + y * stride to
+ * origin + y * stride + width - 1 of each plane, but they differ in
+ * how coordinates outside the grid are wrapped around.
+ */
+enum grid_layout
+{
+    /**
+     * \brief Rows are stored back to back. Wrapping compares the
+     * coordinates with the boundaries.
+     */
+    GRID_LAYOUT_GENERIC = 0,
+
+    /**
+     * \brief Rows are stored back to back and both the width and the
+     * height are powers of two. Wrapping is a bitwise and.
+     */
+    GRID_LAYOUT_POW2 = 1,
+
+    /**
+     * \brief The grid is surrounded by a one cell wide ring of ghost
+     * cells that mirror the cells on the opposite boundary. The
+     * neighbor of any cell is then at a fixed index offset (see
+     * offset), without any wrapping. Every write to a boundary cell
+     * is also made to its ghost copies.
+     */
+    GRID_LAYOUT_PADDED = 2,
+
+    /**
+     * \brief The grid is divided into 64-by-64 chunks, and only the
+     * chunks holding a termite or a wood chip are stored (see struct
+     * chunkmap). The memory use scales with the number of occupied
+     * chunks instead of the area. There are no planes, so the cells
+     * can only be accessed through the grid functions, not through
+     * the inline fast paths.
+     */
+    GRID_LAYOUT_SPARSE = 3
+};
+
+
+/**
+ * \brief The number of cells from which on grid_choose_layout()
+ * picks the sparse layout.
+ */
+#define GRID_SPARSE_MIN_CELLS 4294967296.0
+
+
+/** \brief The change in x-coordinate for a step in each direction. */
+static const int grid_dx[ 4 ] = { 0, 1, 0, -1 };
+
+/** \brief The change in y-coordinate for a step in each direction. */
+static const int grid_dy[ 4 ] = { -1, 0, 1, 0 };
 
 
 /**
@@ -12,6 +68,15 @@
  * top left coordinate is x=y=0, and the bottom right coordinate is
  * x=width-1, y=height-1. The x-coordinate x=-1 wraps around to
  * x=width-1. The same applies to the other three boundaries.
+ *
+ * The state of the cells is stored in two bit planes. The cell in
+ * row y and column x has the index k = origin + y * stride + x, and
+ * it is occupied by a termite if bit k of the termite plane is set,
+ * and by a wood chip if bit k of the chip plane is set. Each cell thus
+ * takes two bits (plus the ghost cells of the padded layout).
+ *
+ * The sparse layout keeps the cells in chunks instead and has no
+ * planes.
  */
 struct grid
 {
@@ -21,11 +86,38 @@ struct grid
     /** \brief The height of the grid. */
     int height;
 
+    /** \brief The memory layout. */
+    enum grid_layout layout;
+
+    /** \brief The number of bits between the starts of two rows. */
+    int stride;
+
+    /** \brief The index of the cell in row 0 and column 0. */
+    size_t origin;
+
     /**
-     * \brief The grid cells. The object cells[ y ][ x ] is the cell
-     * in row y and column x.
+     * \brief The index offset of the neighbor in each direction
+     * (padded layout only).
      */
-    struct cell **cells;
+    ptrdiff_t offset[ 4 ];
+
+    /** \brief The number of 64-bit words in each bit plane. */
+    size_t num_words;
+
+    /** \brief The termite plane. */
+    uint64_t *termites;
+
+    /** \brief The wood chip plane. */
+    uint64_t *chips;
+
+    /** \brief The occupied chunks (sparse layout only). */
+    struct chunkmap chunks;
+
+    /**
+     * \brief Flag that is true if the planes were allocated by the
+     * grid (and are released by grid_destroy()).
+     */
+    bool owns_planes;
 };
 
 
@@ -43,6 +135,80 @@ void grid_create( struct grid *grid,
 		  int height );
 
 
+/**
+ * \brief Returns the fastest layout for a grid of the given size.
+ *
+ * The sparse layout is chosen if the grid has at least
+ * GRID_SPARSE_MIN_CELLS cells, the power-of-two layout if both
+ * dimensions are powers of two, and the padded layout otherwise.
+ *
+ * \param [in] width The width of the grid.
+ *
+ * \param [in] height The height of the grid.
+ *
+ * \return The layout.
+ */
+enum grid_layout grid_choose_layout( int width,
+				     int height );
+
+
+/**
+ * \brief Creates an empty grid of the given size with the given layout.
+ *
+ * \param [out] grid 
+ *
+ * \param [in] width The width of the grid.
+ *
+ * \param [in] height The height of the grid.
+ *
+ * \param [in] layout The layout. The power-of-two layout requires
+ * both dimensions to be powers of two.
+ */
+void grid_create_with_layout( struct grid *grid,
+			      int width,
+			      int height,
+			      enum grid_layout layout );
+
+
+/**
+ * \brief Returns the number of 64-bit words in each plane of a grid.
+ *
+ * \param [in] width The width of the grid.
+ *
+ * \param [in] height The height of the grid.
+ *
+ * \param [in] layout The layout.
+ *
+ * \return The number of words per plane (0 for the sparse layout).
+ */
+size_t grid_plane_words( int width,
+			 int height,
+			 enum grid_layout layout );
+
+
+/**
+ * \brief Creates a grid on top of existing planes.
+ *
+ * The planes are not copied and are not released by grid_destroy().
+ *
+ * \param [out] grid 
+ *
+ * \param [in] width The width of the grid.
+ *
+ * \param [in] height The height of the grid.
+ *
+ * \param [in] layout The layout (not the sparse layout).
+ *
+ * \param [in,out] planes The termite plane followed by the chip plane,
+ * both in the given layout, each with grid_plane_words() words.
+ */
+void grid_create_on_planes( struct grid *grid,
+			    int width,
+			    int height,
+			    enum grid_layout layout,
+			    uint64_t *planes );
+
+
 /**
  * \brief Destroys a grid, releasing all resources.
  *
@@ -51,6 +217,55 @@ void grid_create( struct grid *grid,
 void grid_destroy( struct grid *grid );
 
 
+/**
+ * \brief Sets whether the planes of the grids created from now on are
+ * backed by transparent huge pages (default: false).
+ *
+ * Huge pages cut the TLB misses of the random lookups into large
+ * grids, but a 2 MB page is placed on one NUMA node as a whole, which
+ * coarsens the placement by grid_first_touch(). The setting applies
+ * to the whole process.
+ *
+ * \param [in] enable
+ */
+void grid_set_huge_pages( bool enable );
+
+
+/**
+ * \brief Writes the words of both planes that hold one band of rows,
+ * so that the pages of the band are placed on the NUMA node of the
+ * calling thread.
+ *
+ * The planes of a new grid are not touched until they are written,
+ * and a page is placed on the node of the thread that writes it
+ * first. Called by worker part of a team of num_parts workers before
+ * anything else writes the grid, this places band part of the rows
+ * (rows height * part / num_parts up to height * (part + 1) /
+ * num_parts, roughly the rows of the strips the worker steps in the
+ * strips engine) near that worker.
+ * The words of the bands do not overlap, so the workers need no
+ * synchronization among themselves. Does nothing for the sparse
+ * layout.
+ *
+ * \param [in,out] grid An empty grid.
+ *
+ * \param [in] part
+ *
+ * \param [in] num_parts
+ */
+void grid_first_touch( struct grid *grid,
+		       int part,
+		       int num_parts );
+
+
+/**
+ * \brief Removes all termites and wood chips from a grid.
+ *
+ * \param [in,out] grid
+ */
+void grid_clear( struct grid *grid );
+
+
 /**
  * \brief Places a termite at the given coordinate.
  *
@@ -180,3 +395,184 @@ void grid_get_coords_in_direction( const struct grid *grid,
 void grid_get_size( const struct grid *grid,
 		    int *width,
 		    int *height );
+
+
+/**
+ * \brief Returns the number of bytes used to store the grid cells.
+ *
+ * \param [in] grid
+ *
+ * \return The memory footprint of the grid in bytes.
+ */
+size_t grid_get_memory_footprint( const struct grid *grid );
+
+
+/**
+ * \brief Returns the number of pairs of horizontally or vertically
+ * adjacent wood chips.
+ *
+ * Takes time proportional to the number of occupied chunks for the
+ * sparse layout, and to the area otherwise.
+ *
+ * \param [in] grid
+ *
+ * \return The number of pairs.
+ */
+int64_t grid_count_chip_pairs( const struct grid *grid );
+
+
+/** \brief The largest number of ghost copies of a cell. */
+#define GRID_MAX_GHOSTS 8
+
+
+/**
+ * \brief Returns the indices of the ghost copies of a cell.
+ *
+ * Only the padded layout has ghost copies: a boundary cell has one,
+ * and a corner cell three (more if the grid is one cell wide or high).
+ *
+ * \param [in] grid
+ *
+ * \param [in] x The x-coordinate (in the range 0 to width-1).
+ *
+ * \param [in] y The y-coordinate (in the range 0 to height-1).
+ *
+ * \param [out] ghosts The indices of the ghost copies.
+ *
+ * \return The number of ghost copies (0 to GRID_MAX_GHOSTS).
+ */
+int grid_get_ghosts( const struct grid *grid,
+		     int x,
+		     int y,
+		     size_t ghosts[ GRID_MAX_GHOSTS ] );
+
+
+/**
+ * \brief Copies the bits of a boundary cell to its ghost copies.
+ *
+ * Only does something for the padded layout.
+ *
+ * \param [in,out] grid
+ *
+ * \param [in] x The x-coordinate (in the range 0 to width-1).
+ *
+ * \param [in] y The y-coordinate (in the range 0 to height-1).
+ */
+void grid_update_ghosts( struct grid *grid,
+			 int x,
+			 int y );
+
+
+/**
+ * \brief Copies the bits of all boundary cells to their ghost copies.
+ *
+ * Only needed after writing to the planes directly, bypassing the
+ * grid functions.
+ *
+ * \param [in,out] grid
+ */
+void grid_update_all_ghosts( struct grid *grid );
+
+
+/*
+ * Inline fast paths.
+ *
+ * The functions below are used by the engines in their inner loops.
+ * They take the layout as a separate argument so that a caller that
+ * passes a constant (after switching on grid->layout once) gets code
+ * specialized for that layout.
+ */
+
+
+/**
+ * \brief Wraps coordinates that overshoot the grid by less than its
+ * size around the boundaries.
+ */
+static inline void grid_wrap( const struct grid *grid,
+			      const enum grid_layout layout,
+			      int *x,
+			      int *y )
+{
+    if( layout == GRID_LAYOUT_POW2 ) {
+	(*x) &= grid->width - 1;
+	(*y) &= grid->height - 1;
+    } else {
+	if( (*x) < 0 ) {
+	    (*x) += grid->width;
+	} else if( (*x) >= grid->width ) {
+	    (*x) -= grid->width;
+	}
+	if( (*y) < 0 ) {
+	    (*y) += grid->height;
+	} else if( (*y) >= grid->height ) {
+	    (*y) -= grid->height;
+	}
+    }
+}
+
+
+/**
+ * \brief Returns the index of the cell at the given coordinates
+ * (which must lie within the grid).
+ */
+static inline size_t grid_index( const struct grid *grid,
+				 int x,
+				 int y )
+{
+    return grid->origin + (size_t) y * grid->stride + x;
+}
+
+
+/**
+ * \brief Returns the index of the neighbor in the given direction of
+ * the cell at (x, y), which has index k.
+ *
+ * For the padded layout the index might refer to a ghost cell, which
+ * can be read but must not be written.
+ */
+static inline size_t grid_neighbor( const struct grid *grid,
+				    const enum grid_layout layout,
+				    int x,
+				    int y,
+				    size_t k,
+				    enum direction direction )
+{
+    if( layout == GRID_LAYOUT_PADDED ) {
+	return k + grid->offset[ direction ];
+    }
+    x += grid_dx[ direction ];
+    y += grid_dy[ direction ];
+    grid_wrap( grid, layout, &x, &y );
+    return grid_index( grid, x, y );
+}
+
+
+/**
+ * \brief Returns bit k of a plane.
+ */
+static inline bool grid_test( const uint64_t *plane,
+			      size_t k )
+{
+    return (plane[ k >> 6 ] >> (k & 63)) & 1;
+}
+
+
+/**
+ * \brief Sets or clears the bit of the cell at (x, y) in a plane of
+ * the grid (and in its ghost copies).
+ */
+static inline void grid_assign( struct grid *grid,
+				const enum grid_layout layout,
+				uint64_t *plane,
+				int x,
+				int y,
+				bool value )
+{
+    const size_t k = grid_index( grid, x, y );
+    const uint64_t bit = UINT64_C( 1 ) << (k & 63);
+    plane[ k >> 6 ] = (plane[ k >> 6 ] & ~bit) | (value ? bit : 0);
+    if( layout == GRID_LAYOUT_PADDED
+	&& (x == 0 || y == 0 || x == grid->width - 1 || y == grid->height - 1) ) {
+	grid_update_ghosts( grid, x, y );
+    }
+}
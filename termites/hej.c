@@ -1 +0,0 @@
-hej.c is cool
@@ -0,0 +1,90 @@
+#include "intlist.h"
+
+
+/**
+ * \brief Makes sure that the list can hold at least the given number
+ * of items.
+ *
+ * \param [in,out] list
+ *
+ * \param [in] capacity
+ */
+static void intlist_reserve( struct intlist *list,
+			     int capacity )
+{
+    if( capacity <= list->capacity ) {
+	return;
+    }
+    int new_capacity = list->capacity > 0 ? 2 * list->capacity : 16;
+    while( new_capacity < capacity ) {
+	new_capacity *= 2;
+    }
+    list->items = realloc( list->items, sizeof( int ) * new_capacity );
+    assert( list->items != NULL );
+    list->capacity = new_capacity;
+}
+
+
+void intlist_create( struct intlist *list )
+{
+    assert( list != NULL );
+
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+
+void intlist_destroy( struct intlist *list )
+{
+    assert( list != NULL );
+
+    free( list->items );
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+
+void intlist_push( struct intlist *list,
+		   const int item )
+{
+    assert( list != NULL );
+
+    intlist_reserve( list, list->count + 1 );
+    list->items[ list->count++ ] = item;
+}
+
+
+void intlist_append( struct intlist *list,
+		     const struct intlist *other )
+{
+    assert( list != NULL );
+    assert( other != NULL );
+
+    if( other->count == 0 ) {
+	return;
+    }
+    intlist_reserve( list, list->count + other->count );
+    memcpy( list->items + list->count, other->items, sizeof( int ) * other->count );
+    list->count += other->count;
+}
+
+
+void intlist_resize( struct intlist *list,
+		     const int count )
+{
+    assert( list != NULL );
+    assert( count >= 0 );
+
+    intlist_reserve( list, count );
+    list->count = count;
+}
+
+
+void intlist_clear( struct intlist *list )
+{
+    assert( list != NULL );
+
+    list->count = 0;
+}
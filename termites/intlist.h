@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common.h"
+
+
+/**
+ * \brief Represents a growable array of integers.
+ *
+ * Used to hold lists of termite indices.
+ */
+struct intlist
+{
+    /** \brief The items. */
+    int *items;
+
+    /** \brief The number of items in the list. */
+    int count;
+
+    /** \brief The number of items that fit in the allocation. */
+    int capacity;
+};
+
+
+/**
+ * \brief Creates an empty list.
+ *
+ * \param [out] list
+ */
+void intlist_create( struct intlist *list );
+
+
+/**
+ * \brief Destroys a list, releasing all resources.
+ *
+ * \param [in,out] list
+ */
+void intlist_destroy( struct intlist *list );
+
+
+/**
+ * \brief Appends an item to the end of the list.
+ *
+ * \param [in,out] list
+ *
+ * \param [in] item
+ */
+void intlist_push( struct intlist *list,
+		   int item );
+
+
+/**
+ * \brief Appends all items of another list to the end of the list.
+ *
+ * \param [in,out] list
+ *
+ * \param [in] other
+ */
+void intlist_append( struct intlist *list,
+		     const struct intlist *other );
+
+
+/**
+ * \brief Sets the number of items of the list. Items added this way
+ * are left uninitialized.
+ *
+ * \param [in,out] list
+ *
+ * \param [in] count The new number of items.
+ */
+void intlist_resize( struct intlist *list,
+		     int count );
+
+
+/**
+ * \brief Removes all items from the list (keeps the allocation).
+ *
+ * \param [in,out] list
+ */
+void intlist_clear( struct intlist *list );
@@ -0,0 +1,301 @@
+#include "leap.h"
+
+#include "simulation.h"
+
+
+/**
+ * \brief Returns the block of the cell at (x, y).
+ */
+static inline int block_of( const struct leap *leap,
+			    int x,
+			    int y )
+{
+    return (y / LEAP_BLOCK_SIZE) * leap->blocks_x + x / LEAP_BLOCK_SIZE;
+}
+
+
+/**
+ * \brief Finds the ranges of blocks along one side of the grid that
+ * cover the cells within the given distance of a cell, wrapping
+ * around the boundaries.
+ *
+ * \param [in] center The coordinate of the cell.
+ *
+ * \param [in] distance The distance.
+ *
+ * \param [in] size The size of the grid along the side.
+ *
+ * \param [in] num_blocks The number of blocks along the side.
+ *
+ * \param [out] ranges The first and last block of each range.
+ *
+ * \return The number of ranges (1 or 2).
+ */
+static int block_ranges( int center,
+			 int distance,
+			 int size,
+			 int num_blocks,
+			 int ranges[ 2 ][ 2 ] )
+{
+    const int low = center - distance;
+    const int high = center + distance;
+    if( 2 * distance + 1 < size ) {
+	if( low >= 0 && high < size ) {
+	    ranges[ 0 ][ 0 ] = low / LEAP_BLOCK_SIZE;
+	    ranges[ 0 ][ 1 ] = high / LEAP_BLOCK_SIZE;
+	    return 1;
+	}
+	ranges[ 0 ][ 0 ] = 0;
+	ranges[ 0 ][ 1 ] = (low < 0 ? high : high - size) / LEAP_BLOCK_SIZE;
+	ranges[ 1 ][ 0 ] = (low < 0 ? low + size : low) / LEAP_BLOCK_SIZE;
+	ranges[ 1 ][ 1 ] = num_blocks - 1;
+	if( ranges[ 1 ][ 0 ] > ranges[ 0 ][ 1 ] ) {
+	    return 2;
+	}
+    }
+    ranges[ 0 ][ 0 ] = 0;
+    ranges[ 0 ][ 1 ] = num_blocks - 1;
+    return 1;
+}
+
+
+/**
+ * \brief Returns true if the blocks within the given distance of the
+ * cell at (x, y) hold at most the given number of items in total.
+ *
+ * \param [in] leap
+ *
+ * \param [in] counts The number of items in each block.
+ *
+ * \param [in] x
+ *
+ * \param [in] y
+ *
+ * \param [in] distance
+ *
+ * \param [in] limit
+ */
+static inline bool at_most( const struct leap *leap,
+		     const uint8_t *counts,
+		     int x,
+		     int y,
+		     int distance,
+		     int limit )
+{
+    /* Most cells are far from the boundaries. */
+    if( x >= distance && x + distance < leap->width && y >= distance && y + distance < leap->height ) {
+	const int last_x = (x + distance) / LEAP_BLOCK_SIZE;
+	const int last_y = (y + distance) / LEAP_BLOCK_SIZE;
+	int count = 0;
+	for( int by = (y - distance) / LEAP_BLOCK_SIZE; by <= last_y; ++by ) {
+	    const uint8_t *row = &counts[ (size_t) by * leap->blocks_x ];
+	    for( int bx = (x - distance) / LEAP_BLOCK_SIZE; bx <= last_x; ++bx ) {
+		count += row[ bx ];
+	    }
+	    if( count > limit ) {
+		return false;
+	    }
+	}
+	return true;
+    }
+
+    int columns[ 2 ][ 2 ], rows[ 2 ][ 2 ];
+    const int num_columns = block_ranges( x, distance, leap->width, leap->blocks_x, columns );
+    const int num_rows = block_ranges( y, distance, leap->height, leap->blocks_y, rows );
+    int count = 0;
+    for( int i = 0; i < num_rows; ++i ) {
+	for( int by = rows[ i ][ 0 ]; by <= rows[ i ][ 1 ]; ++by ) {
+	    const uint8_t *row = &counts[ (size_t) by * leap->blocks_x ];
+	    for( int j = 0; j < num_columns; ++j ) {
+		for( int bx = columns[ j ][ 0 ]; bx <= columns[ j ][ 1 ]; ++bx ) {
+		    count += row[ bx ];
+		}
+	    }
+	    if( count > limit ) {
+		return false;
+	    }
+	}
+    }
+    return true;
+}
+
+
+/**
+ * \brief Replays the random walk of an isolated termite through the
+ * given time steps and moves it on the grid.
+ *
+ * \param [in,out] leap
+ *
+ * \param [in] k The index of the termite.
+ *
+ * \param [in] step The first time step.
+ *
+ * \param [in] num_steps The number of time steps.
+ *
+ * \param [in,out] counters The counters to record the events in.
+ */
+static void leap_termite( struct leap *leap,
+			  int k,
+			  uint64_t step,
+			  int num_steps,
+			  struct counters *counters )
+{
+    struct simulation *sim = leap->sim;
+    struct termite *term = &sim->termites[ k ];
+    int x0, y0;
+    termite_get_coords( term, &x0, &y0 );
+
+    /* Turn as in termite_step() and move; nothing is in the way. */
+    int direction = termite_get_direction( term );
+    int x = x0;
+    int y = y0;
+    uint64_t turns = 0;
+    for( int i = 0; i < num_steps; ++i ) {
+	const unsigned quarters = rng_turn( rng_draw( sim->seed, k, step + i ) );
+	direction = (direction + quarters) % 4;
+	turns += quarters != 0;
+	x += grid_dx[ direction ];
+	y += grid_dy[ direction ];
+    }
+    while( x < 0 ) {
+	x += leap->width;
+    }
+    while( x >= leap->width ) {
+	x -= leap->width;
+    }
+    while( y < 0 ) {
+	y += leap->height;
+    }
+    while( y >= leap->height ) {
+	y -= leap->height;
+    }
+    counters_add( counters, COUNTERS_TURN, turns );
+    counters_add( counters, COUNTERS_MOVE, num_steps );
+
+    grid_remove_termite_at( &sim->grid, x0, y0 );
+    grid_place_termite_at( &sim->grid, x, y );
+    termite_set_state( term, x, y, direction, false );
+}
+
+
+void leap_create( struct leap *leap,
+		  struct simulation *sim )
+{
+    assert( leap != NULL );
+    assert( sim != NULL );
+    assert( sim->grid.layout != GRID_LAYOUT_SPARSE );
+
+    int width, height;
+    grid_get_size( &sim->grid, &width, &height );
+
+    leap->sim = sim;
+    leap->width = width;
+    leap->height = height;
+    leap->blocks_x = (width + LEAP_BLOCK_SIZE - 1) / LEAP_BLOCK_SIZE;
+    leap->blocks_y = (height + LEAP_BLOCK_SIZE - 1) / LEAP_BLOCK_SIZE;
+    const size_t num_blocks = (size_t) leap->blocks_x * leap->blocks_y;
+    leap->chips = calloc( num_blocks, sizeof( uint8_t ) );
+    leap->termites = calloc( num_blocks, sizeof( uint8_t ) );
+    leap->others = malloc( sizeof( int ) * sim->num_termites );
+    assert( leap->chips != NULL && leap->termites != NULL && leap->others != NULL );
+
+    /* Count the chips. A block holds at most LEAP_BLOCK_SIZE^2 of
+     * them, which fits in a byte.
+     */
+    const struct grid *grid = &sim->grid;
+    for( int y = 0; y < height; ++y ) {
+	for( int x = 0; x < width; ++x ) {
+	    leap->chips[ block_of( leap, x, y ) ] += grid_test( grid->chips, grid_index( grid, x, y ) );
+	}
+    }
+}
+
+
+void leap_destroy( struct leap *leap )
+{
+    assert( leap != NULL );
+
+    free( leap->chips );
+    free( leap->termites );
+    free( leap->others );
+    leap->chips = NULL;
+    leap->termites = NULL;
+    leap->others = NULL;
+    leap->sim = NULL;
+}
+
+
+void leap_step( struct leap *leap,
+		int num_steps )
+{
+    assert( leap != NULL );
+    assert( num_steps >= 1 );
+
+    struct simulation *sim = leap->sim;
+    struct counters *counters = &sim->counters[ 0 ];
+    struct intlist *log = sim->clusters != NULL ? clusters_log( sim->clusters, 0 ) : NULL;
+    const int n = sim->num_termites;
+
+    /* Pick the isolated termites and let them leap. Leaping does not
+     * pay off for a single step.
+     */
+    leap->num_others = 0;
+    if( num_steps > 1 ) {
+	for( int k = 0; k < n; ++k ) {
+	    int x, y;
+	    termite_get_coords( &sim->termites[ k ], &x, &y );
+	    ++leap->termites[ block_of( leap, x, y ) ];
+	}
+	for( int k = 0; k < n; ++k ) {
+	    const struct termite *term = &sim->termites[ k ];
+	    int x, y;
+	    termite_get_coords( term, &x, &y );
+	    if( termite_carries_wood_chip( term )
+		|| ! at_most( leap, leap->chips, x, y, num_steps - 1, 0 )
+		|| ! at_most( leap, leap->termites, x, y, 2 * num_steps, 1 ) ) {
+		leap->others[ leap->num_others++ ] = k;
+	    }
+	}
+	for( int k = 0, i = 0; k < n; ++k ) {
+	    int x, y;
+	    termite_get_coords( &sim->termites[ k ], &x, &y );
+	    --leap->termites[ block_of( leap, x, y ) ];
+	    if( i < leap->num_others && leap->others[ i ] == k ) {
+		++i;
+	    } else {
+		leap_termite( leap, k, sim->step, num_steps, counters );
+	    }
+	}
+    } else {
+	for( int k = 0; k < n; ++k ) {
+	    leap->others[ k ] = k;
+	}
+	leap->num_others = n;
+    }
+
+    /* Step the others one time step at a time. */
+    for( int s = 0; s < num_steps; ++s ) {
+	rng_fill_turns( sim->seed, 0, sim->step + s, n, sim->turns );
+	for( int i = 0; i < leap->num_others; ++i ) {
+	    const int k = leap->others[ i ];
+	    struct termite *term = &sim->termites[ k ];
+	    const unsigned events = termite_step( term, &sim->grid, sim->turns[ k ] );
+	    counters_record( counters, events );
+	    if( log != NULL ) {
+		clusters_record( log, &sim->grid, term, events );
+	    }
+
+	    /* The chip was picked up or dropped in the cell the termite
+	     * started from (see clusters_record()).
+	     */
+	    if( events & (COUNTERS_PICKUP | COUNTERS_DROP) ) {
+		int x, y;
+		termite_get_coords( term, &x, &y );
+		if( events & COUNTERS_MOVE ) {
+		    grid_get_coords_in_direction( &sim->grid, x, y, &x, &y, (termite_get_direction( term ) + 2) % 4 );
+		}
+		leap->chips[ block_of( leap, x, y ) ] += (events & COUNTERS_DROP) ? 1 : -1;
+	    }
+	}
+    }
+}
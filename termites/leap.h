@@ -0,0 +1,112 @@
+#pragma once
+
+#include "common.h"
+
+
+/** \brief The width and height (in cells) of a block of struct leap. */
+#define LEAP_BLOCK_SIZE 8
+
+
+/**
+ * \brief Represents the state of the leap engine.
+ *
+ * Leaping.
+ *
+ * An empty-handed termite that stands on no chip only picks up a chip
+ * once it steps onto one, and only stops once a termite blocks its
+ * way. Until then it performs a random walk that does not depend on
+ * the grid. Over n time steps a termite stays within distance n of
+ * its cell (and looks at most n cells ahead), so if there is no chip
+ * within distance n - 1 and no other termite within distance 2n of
+ * it, nothing can meet it during the steps: neither a chip (one
+ * dropped by another termite included), nor another termite, whether
+ * or not that termite leaps as well. Such an isolated termite leaps:
+ * its walk is replayed in registers from its own random numbers, and
+ * the grid is only updated once at the end.
+ *
+ * The other termites are stepped one time step at a time as usual,
+ * in the order of the termite array. They never see the difference,
+ * so the result is identical to that of the scalar engine, and so
+ * are the event counts.
+ *
+ * Occupancy.
+ *
+ * To find the isolated termites quickly, the grid is divided into
+ * blocks of LEAP_BLOCK_SIZE by LEAP_BLOCK_SIZE cells. The engine keeps
+ * the number of chips in each block up to date from the pick ups and
+ * drops, which are rare, and counts the termites, which move in almost
+ * every step, only at the start of the steps. A termite is isolated if
+ * the blocks within distance n - 1 of it hold no chip and those within
+ * distance 2n hold no other termite. The test is conservative: blocks
+ * that only partially overlap a neighborhood count as a whole.
+ */
+struct leap
+{
+    /** \brief The simulation being stepped. */
+    struct simulation *sim;
+
+    /** \brief The width of the grid. */
+    int width;
+
+    /** \brief The height of the grid. */
+    int height;
+
+    /** \brief The number of blocks across. */
+    int blocks_x;
+
+    /** \brief The number of blocks down. */
+    int blocks_y;
+
+    /** \brief The number of chips in each block (y * blocks_x + x). */
+    uint8_t *chips;
+
+    /**
+     * \brief The number of termites in each block, only counted
+     * while the isolated termites are picked.
+     */
+    uint8_t *termites;
+
+    /**
+     * \brief The termites that do not leap through the current steps,
+     * in increasing order.
+     */
+    int *others;
+
+    /** \brief The number of such termites. */
+    int num_others;
+};
+
+
+/**
+ * \brief Creates the leap engine for a simulation.
+ *
+ * The grid must not have the sparse layout.
+ *
+ * \param [out] leap
+ *
+ * \param [in,out] sim
+ */
+void leap_create( struct leap *leap,
+		  struct simulation *sim );
+
+
+/**
+ * \brief Destroys the engine, releasing all resources.
+ *
+ * \param [in,out] leap
+ */
+void leap_destroy( struct leap *leap );
+
+
+/**
+ * \brief Advances the simulation the given number of time steps, with
+ * isolated termites leaping through all of them at once.
+ *
+ * The caller advances the step counter of the simulation.
+ *
+ * \param [in,out] leap
+ *
+ * \param [in] num_steps The number of time steps (at least 1).
+ */
+void leap_step( struct leap *leap,
+		int num_steps );
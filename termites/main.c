@@ -1,23 +1,33 @@
-#include <sys/time.h>
-
 #include "common.h"
 
+#include "convergence.h"
+#include "distributed.h"
+#include "ensemble.h"
+#include "frames.h"
 #include "simulation.h"
 
 
 
 
+
+/** \brief The names of the grid layouts (see enum grid_layout). */
+static const char *layout_names[ 4 ] = { "generic", "pow2", "padded", "sparse" };
+
+
+
 /**
- * \brief Return the current time as a double (in seconds) with high
- * resolution.
- *
- * \return The current time (in seconds) since some fixed point.
+ * \brief Returns the number of time steps from step to the next
+ * multiple of every, or limit if that is sooner or every is not set.
  */
-static double gettime( void )
+static uint64_t steps_until( uint64_t step,
+			     int every,
+			     uint64_t limit )
 {
-    struct timeval tv;
-    gettimeofday( &tv, NULL );
-    return tv.tv_sec + 1e-6 * tv.tv_usec;
+    if( every <= 0 ) {
+	return limit;
+    }
+    const uint64_t steps = every - step % every;
+    return steps < limit ? steps : limit;
 }
 
 
@@ -39,7 +49,35 @@ static void usage( const char *program )
     fprintf( stderr, "  -t F         Set the fraction of grid cells occupied by termites to F (default: 0.01)\n" );
     fprintf( stderr, "  -c F         Set the fraction of grid cells occupied by wood chips to F (default: 0.10)\n" );
     fprintf( stderr, "  -s N         Set the number of time steps to N (default: 5000)\n" );
-    fprintf( stderr, "  -v           Print partial state information to stdout (default: OFF). Warning: Use only for small grids.\n" );
+    fprintf( stderr, "  -n N         Set the number of threads to N (default: 1)\n" );
+    fprintf( stderr, "  -threads N   Same as -n\n" );
+    fprintf( stderr, "  -procs N     Step the simulation on N processes, each owning a band of the grid (requires -e sync or blocked, default: OFF)\n" );
+    fprintf( stderr, "  -ensemble K  Run K independent replicates with seeds derived from -S, one per thread at a time (default: OFF)\n" );
+    fprintf( stderr, "  -e NAME      Set the engine to NAME, one of: strips, scalar, soa, sync, async, tiles, blocked, leap (default: scalar)\n" );
+    fprintf( stderr, "  -block-steps N       Let the blocked and leap engines take up to N time steps at once (default: 4)\n" );
+    fprintf( stderr, "  -pin LIST    Pin worker k of every thread team to the k-th CPU of LIST (modulo its length), e.g. 0-7,16-23 (default: OFF)\n" );
+    fprintf( stderr, "  -huge-pages  Back the grid with transparent huge pages (default: OFF)\n" );
+    fprintf( stderr, "  -layout NAME Set the grid layout to NAME, one of: auto, generic, pow2, padded, sparse (default: auto)\n" );
+    fprintf( stderr, "  -S N         Set the seed of the random number generator to N (default: the current time)\n" );
+    fprintf( stderr, "  -reorder-every N     Sort the termites along a space-filling curve every N time steps (default: OFF)\n" );
+    fprintf( stderr, "  -checkpoint-every N  Save a snapshot every N time steps (default: OFF)\n" );
+    fprintf( stderr, "  -checkpoint-file F   Set the name of the snapshot file to F (default: termites.ckpt)\n" );
+    fprintf( stderr, "  -counters-every N    Write the event counts of every N time steps as a CSV row (default: OFF, requires 'make counters')\n" );
+    fprintf( stderr, "  -counters-file F     Set the name of the event count file to F (default: termites_counters.csv)\n" );
+    fprintf( stderr, "  -clusters-every N    Write the wood chip cluster statistics every N time steps as a CSV row (default: OFF)\n" );
+    fprintf( stderr, "  -clusters-file F     Set the name of the cluster statistics file to F (default: termites_clusters.csv)\n" );
+    fprintf( stderr, "  -clusters-region N   Set the width and height of the regions whose chips are counted to N (default: 64)\n" );
+    fprintf( stderr, "  -relabel-every N     Label the clusters from scratch every N time steps (default: OFF)\n" );
+    fprintf( stderr, "  -until-converged     Stop before the time step set by -s once the number of adjacent wood chips has settled (default: OFF)\n" );
+    fprintf( stderr, "  -converge-every N    Sample the number of adjacent wood chips every N time steps (default: 100)\n" );
+    fprintf( stderr, "  -converge-window N   Require the last N samples to agree (default: 10)\n" );
+    fprintf( stderr, "  -converge-tol F      Set the relative tolerance of the samples to F (default: 0.01)\n" );
+    fprintf( stderr, "  -resume F    Resume the simulation from the snapshot file F and run it up to the time step set by -s\n" );
+    fprintf( stderr, "  -frames-every N      Write the grid every N time steps on a separate thread, dropping frames while the writer is behind (default: OFF)\n" );
+    fprintf( stderr, "  -frames-all          Wait for the writer rather than drop frames (default: OFF)\n" );
+    fprintf( stderr, "  -frames-file F       Set the name of the frame file to F (default: stdout)\n" );
+    fprintf( stderr, "  -frames-format NAME  Set the frame format to NAME, one of: auto, ascii, pbm (default: auto, ascii up to 256-by-256 cells)\n" );
+    fprintf( stderr, "  -v           Print the grid as ASCII to stdout after every time step (same as -frames-every 1 -frames-all, default: OFF). Warning: Use only for small grids.\n" );
     fprintf( stderr, "  -?           Print this help.\n" );
     fprintf( stderr, "\n" );
     exit( EXIT_SUCCESS );
@@ -47,6 +85,149 @@ static void usage( const char *program )
 
 
 
+/**
+ * \brief Parses a list of CPUs such as 0-7,16-23.
+ *
+ * \param [in] list The comma-separated CPUs or ranges of CPUs.
+ *
+ * \param [out] cpus The CPUs, with room for max_cpus of them.
+ *
+ * \param [in] max_cpus
+ *
+ * \return The number of CPUs, or -1 if the list is invalid.
+ */
+static int parse_cpus( const char *list,
+		       int *cpus,
+		       int max_cpus )
+{
+    int count = 0;
+    const char *p = list;
+    for( ;; ) {
+	char *end;
+	const long first = strtol( p, &end, 10 );
+	long last = first;
+	if( end == p || first < 0 ) {
+	    return -1;
+	}
+	p = end;
+	if( *p == '-' ) {
+	    last = strtol( p + 1, &end, 10 );
+	    if( end == p + 1 || last < first ) {
+		return -1;
+	    }
+	    p = end;
+	}
+	for( long cpu = first; cpu <= last; ++cpu ) {
+	    if( count == max_cpus ) {
+		return -1;
+	    }
+	    cpus[ count++ ] = (int) cpu;
+	}
+	if( *p == '\0' ) {
+	    return count;
+	}
+	if( *p != ',' ) {
+	    return -1;
+	}
+	++p;
+    }
+}
+
+
+
+/**
+ * \brief Runs an ensemble of replicates and prints its summary.
+ *
+ * \return EXIT_SUCCESS.
+ */
+static int run_ensemble( int width,
+			 int height,
+			 enum grid_layout layout,
+			 int num_chips,
+			 int num_termites,
+			 int num_time_steps,
+			 enum simulation_engine engine,
+			 const char *engine_name,
+			 uint64_t seed,
+			 int num_replicates,
+			 int num_of_threads )
+{
+    struct ensemble_config config;
+    config.width = width;
+    config.height = height;
+    config.layout = layout;
+    config.num_chips = num_chips;
+    config.num_termites = num_termites;
+    config.num_time_steps = num_time_steps;
+    config.engine = engine;
+    config.seed = seed;
+
+    /* More threads than replicates would only sit idle. */
+    if( num_of_threads > num_replicates ) {
+	num_of_threads = num_replicates;
+    }
+    struct ensemble_result *results = malloc( sizeof( struct ensemble_result ) * num_replicates );
+    struct workers workers;
+    workers_create( &workers, num_of_threads );
+
+    double t1 = gettime( );
+    ensemble_run( &config, num_replicates, &workers, results );
+    double t2 = gettime( );
+    double duration = t2 - t1;
+
+    workers_destroy( &workers );
+
+    /* Aggregate the replicates. */
+    double sum = 0.0;
+    double min = results[ 0 ].seconds;
+    double max = results[ 0 ].seconds;
+    double carried = 0.0;
+    double pairs = 0.0;
+    for( int r = 0; r < num_replicates; ++r ) {
+	sum += results[ r ].seconds;
+	min = results[ r ].seconds < min ? results[ r ].seconds : min;
+	max = results[ r ].seconds > max ? results[ r ].seconds : max;
+	carried += results[ r ].chips_carried;
+	pairs += results[ r ].chip_pairs;
+    }
+
+    /* Print ensemble summary. */
+    printf( "\n" );
+    printf( "     TERMITE SIMULATION ENSEMBLE SUMMARY\n" );
+    printf( "============================================\n" );
+    printf( "\n" );
+    printf( "            Grid size: %d-by-%d\n", width, height );
+    printf( " Number of time steps: %d\n", num_time_steps );
+    printf( "   Number of termites: %d\n", num_termites );
+    printf( " Number of wood chips: %d\n", num_chips );
+    printf( " Number of replicates: %d\n", num_replicates );
+    printf( "    Number of threads: %d\n", num_of_threads );
+    printf( "               Engine: %s\n", engine_name );
+    printf( "        Ensemble seed: %llu\n", (unsigned long long) seed );
+    printf( "          Grid layout: %s\n", layout_names[ layout ] );
+    printf( "  Total ensemble time: %.6lf [s]\n", duration );
+    printf( " Time per replicate (min/mean/max): %.6lf / %.6lf / %.6lf [s]\n",
+	    min, sum / num_replicates, max );
+    printf( " Replicates per second: %.3lf\n", duration > 0 ? num_replicates / duration : 0.0 );
+    printf( "   Mean chips carried: %.3lf\n", carried / num_replicates );
+    printf( " Mean adjacent chip pairs: %.3lf\n", pairs / num_replicates );
+    printf( "\n" );
+    printf( "%9s %20s %7s %12s %14s %16s\n",
+	    "replicate", "seed", "thread", "time [s]", "chips carried", "adjacent pairs" );
+    for( int r = 0; r < num_replicates; ++r ) {
+	printf( "%9d %20llu %7d %12.6lf %14d %16lld\n",
+		r, (unsigned long long) results[ r ].seed, results[ r ].worker,
+		results[ r ].seconds, results[ r ].chips_carried,
+		(long long) results[ r ].chip_pairs );
+    }
+    printf( "\n" );
+
+    free( results );
+    return EXIT_SUCCESS;
+}
+
+
+
 /**
  * \brief The entry point of the program.
  *
@@ -75,8 +256,67 @@ int main( int argc,
 
     /* Flag controlling verbose output (default: OFF). */
     int verbose = 0;
-	/* Number of allowed threads */
-	int num_of_threads = 0;
+
+    /* Frame output (default: OFF, or every step with -v). */
+    int frames_every = 0;
+    bool frames_all = false;
+    const char *frames_file = NULL;
+    bool auto_frames_format = true;
+    enum frames_format frames_format = FRAMES_FORMAT_ASCII;
+
+    /* The number of threads (default value). */
+    int num_of_threads = 1;
+
+    /* The number of replicates (default: OFF). */
+    int num_replicates = 0;
+
+    /* The number of processes (default: OFF). */
+    int num_procs = 0;
+
+    /* The engine (default value). */
+    enum simulation_engine engine = SIMULATION_ENGINE_SCALAR;
+    const char *engine_name = "scalar";
+
+    /* The time steps per block of the blocked engine (default value). */
+    int block_steps = 4;
+
+    /* The grid layout (default: chosen from the size). */
+    bool auto_layout = true;
+    enum grid_layout layout = GRID_LAYOUT_GENERIC;
+
+    /* The seed of the random number generator (default: the time). */
+    uint64_t seed = (uint64_t) time( NULL );
+
+    /* Checkpointing (default: OFF) and the snapshot to resume from. */
+    int checkpoint_every = 0;
+    const char *checkpoint_file = "termites.ckpt";
+    const char *resume_file = NULL;
+
+    /* Reordering of the termites (default: OFF). */
+    int reorder_every = 0;
+
+    /* Event counting (default: OFF). */
+    int counters_every = 0;
+    const char *counters_file = "termites_counters.csv";
+
+    /* Cluster statistics (default: OFF). */
+    int clusters_every = 0;
+    const char *clusters_file = "termites_clusters.csv";
+    int clusters_region = 64;
+    int relabel_every = 0;
+
+    /* Pinning of the worker threads (default: OFF). */
+    const char *pin_list = NULL;
+
+    /* Huge pages for the grid (default: OFF). */
+    bool huge_pages = false;
+
+    /* Early termination on convergence (default: OFF). */
+    bool until_converged = false;
+    int converge_every = 100;
+    int converge_window = 10;
+    double converge_tolerance = 0.01;
+
     /* Parse the command line options. */
     int optind = 1;
     while( optind < argc ) {
@@ -100,74 +340,517 @@ int main( int argc,
 	    assert( optind + 1 < argc );
 	    num_time_steps = atoi( argv[ optind + 1 ] );
 	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-S" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    seed = strtoull( argv[ optind + 1 ], NULL, 10 );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-e" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    if( strcmp( argv[ optind + 1 ], "strips" ) == 0 ) {
+		engine = SIMULATION_ENGINE_STRIPS;
+	    } else if( strcmp( argv[ optind + 1 ], "scalar" ) == 0 ) {
+		engine = SIMULATION_ENGINE_SCALAR;
+	    } else if( strcmp( argv[ optind + 1 ], "soa" ) == 0 ) {
+		engine = SIMULATION_ENGINE_SOA;
+	    } else if( strcmp( argv[ optind + 1 ], "sync" ) == 0 ) {
+		engine = SIMULATION_ENGINE_SYNCHRONOUS;
+	    } else if( strcmp( argv[ optind + 1 ], "async" ) == 0 ) {
+		engine = SIMULATION_ENGINE_ASYNCHRONOUS;
+	    } else if( strcmp( argv[ optind + 1 ], "tiles" ) == 0 ) {
+		engine = SIMULATION_ENGINE_TILES;
+	    } else if( strcmp( argv[ optind + 1 ], "blocked" ) == 0 ) {
+		engine = SIMULATION_ENGINE_BLOCKED;
+	    } else if( strcmp( argv[ optind + 1 ], "leap" ) == 0 ) {
+		engine = SIMULATION_ENGINE_LEAP;
+	    } else {
+		usage( argv[ 0 ] );
+	    }
+	    engine_name = argv[ optind + 1 ];
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-block-steps" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    block_steps = atoi( argv[ optind + 1 ] );
+	    if( block_steps < 1 ) {
+		usage( argv[ 0 ] );
+	    }
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-pin" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    pin_list = argv[ optind + 1 ];
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-huge-pages" ) == 0 ) {
+	    huge_pages = true;
+	    optind += 1;
+	} else if( strcmp( argv[ optind ], "-layout" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    auto_layout = false;
+	    if( strcmp( argv[ optind + 1 ], "auto" ) == 0 ) {
+		auto_layout = true;
+	    } else if( strcmp( argv[ optind + 1 ], "generic" ) == 0 ) {
+		layout = GRID_LAYOUT_GENERIC;
+	    } else if( strcmp( argv[ optind + 1 ], "pow2" ) == 0 ) {
+		layout = GRID_LAYOUT_POW2;
+	    } else if( strcmp( argv[ optind + 1 ], "padded" ) == 0 ) {
+		layout = GRID_LAYOUT_PADDED;
+	    } else if( strcmp( argv[ optind + 1 ], "sparse" ) == 0 ) {
+		layout = GRID_LAYOUT_SPARSE;
+	    } else {
+		usage( argv[ 0 ] );
+	    }
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-checkpoint-every" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    checkpoint_every = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-checkpoint-file" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    checkpoint_file = argv[ optind + 1 ];
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-reorder-every" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    reorder_every = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-counters-every" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    counters_every = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-counters-file" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    counters_file = argv[ optind + 1 ];
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-clusters-every" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    clusters_every = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-clusters-file" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    clusters_file = argv[ optind + 1 ];
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-clusters-region" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    clusters_region = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-relabel-every" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    relabel_every = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-until-converged" ) == 0 ) {
+	    until_converged = true;
+	    optind += 1;
+	} else if( strcmp( argv[ optind ], "-converge-every" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    converge_every = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-converge-window" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    converge_window = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-converge-tol" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    converge_tolerance = atof( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-resume" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    resume_file = argv[ optind + 1 ];
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-frames-every" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    frames_every = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-frames-all" ) == 0 ) {
+	    frames_all = true;
+	    optind += 1;
+	} else if( strcmp( argv[ optind ], "-frames-file" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    frames_file = argv[ optind + 1 ];
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-frames-format" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    auto_frames_format = false;
+	    if( strcmp( argv[ optind + 1 ], "auto" ) == 0 ) {
+		auto_frames_format = true;
+	    } else if( strcmp( argv[ optind + 1 ], "ascii" ) == 0 ) {
+		frames_format = FRAMES_FORMAT_ASCII;
+	    } else if( strcmp( argv[ optind + 1 ], "pbm" ) == 0 ) {
+		frames_format = FRAMES_FORMAT_PBM;
+	    } else {
+		usage( argv[ 0 ] );
+	    }
+	    optind += 2;
 	} else if( strcmp( argv[ optind ], "-v" ) == 0 ) {
 	    verbose = 1;
 	    optind += 1;
 	} else if( strcmp( argv[ optind ], "-?" ) == 0 ) {
 	    usage( argv[ 0 ] );
-	} else if( strcmp( argv[ optind ], "-n" ) == 0 ) {
-		assert( optind +1 < argc);
-		num_of_threads = atoi( argv[ optin +1 ] );
+	} else if( strcmp( argv[ optind ], "-n" ) == 0
+		   || strcmp( argv[ optind ], "-threads" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    num_of_threads = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-ensemble" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    num_replicates = atoi( argv[ optind + 1 ] );
+	    optind += 2;
+	} else if( strcmp( argv[ optind ], "-procs" ) == 0 ) {
+	    assert( optind + 1 < argc );
+	    num_procs = atoi( argv[ optind + 1 ] );
+	    optind += 2;
 	} else {
 	    usage( argv[ 0 ] );
 	}
     }
 
+    /* -v writes every step through the frame writer, unless frames
+     * are requested explicitly.
+     */
+    if( frames_every > 0 ) {
+	verbose = 0;
+    }
+    if( verbose ) {
+	frames_every = 1;
+	frames_all = true;
+    }
+
     /* Partially check the validity of the inputs. */
     assert( width > 0 );
     assert( height > 0 );
     assert( termite_fraction > 0.0 && termite_fraction < 1.0 );
     assert( chip_fraction > 0.0 && chip_fraction < 1.0 );
     assert( num_time_steps > 0 );
-    /* Compute the actual number of termites and wood chips. */
-    int num_termites = (int) (width * height * termite_fraction);
-    int num_chips = (int) (width * height * chip_fraction);
+    assert( num_of_threads > 0 );
+    assert( checkpoint_every >= 0 );
+    assert( counters_every >= 0 );
+    assert( reorder_every >= 0 );
+    assert( clusters_every >= 0 );
+    assert( clusters_region > 0 );
+    assert( relabel_every >= 0 );
+    assert( converge_every > 0 );
+    assert( converge_window >= 2 );
+    assert( converge_tolerance >= 0.0 );
+    assert( frames_every >= 0 );
+    assert( num_replicates >= 0 );
+    assert( num_procs >= 0 );
+    if( num_replicates > 0 && (resume_file != NULL || reorder_every > 0 || checkpoint_every > 0 || counters_every > 0
+			       || clusters_every > 0 || until_converged || frames_every > 0) ) {
+	fprintf( stderr, "An ensemble cannot be combined with -resume, -reorder-every, -checkpoint-every, "
+		 "-counters-every, -clusters-every, -until-converged, -frames-every or -v.\n" );
+	return EXIT_FAILURE;
+    }
+    if( num_procs > 0 && (num_replicates > 0 || num_of_threads > 1 || reorder_every > 0 || checkpoint_every > 0
+			  || counters_every > 0 || clusters_every > 0 || until_converged || frames_every > 0) ) {
+	fprintf( stderr, "Several processes cannot be combined with -ensemble, -n, -reorder-every, -checkpoint-every, "
+		 "-counters-every, -clusters-every, -until-converged, -frames-every or -v.\n" );
+	return EXIT_FAILURE;
+    }
+    if( num_procs > 0 && engine != SIMULATION_ENGINE_SYNCHRONOUS && engine != SIMULATION_ENGINE_BLOCKED ) {
+	fprintf( stderr, "Several processes follow the synchronous update rule. Use -e sync or -e blocked.\n" );
+	return EXIT_FAILURE;
+    }
+    if( num_replicates == 0 && num_of_threads > 1
+	&& (engine == SIMULATION_ENGINE_SCALAR || engine == SIMULATION_ENGINE_SOA || engine == SIMULATION_ENGINE_LEAP) ) {
+	fprintf( stderr, "The %s engine steps on one thread. Use -n 1, or -e strips for several threads.\n", engine_name );
+	return EXIT_FAILURE;
+    }
+    if( counters_every > 0 && ! COUNTERS_ENABLED ) {
+	fprintf( stderr, "Event counters are not compiled in. Build with 'make counters'.\n" );
+	return EXIT_FAILURE;
+    }
+    if( pin_list != NULL ) {
+	int cpus[ 1024 ];
+	const int num_cpus = parse_cpus( pin_list, cpus, 1024 );
+	if( num_cpus < 0 || ! workers_set_cpus( cpus, num_cpus ) ) {
+	    fprintf( stderr, "Cannot pin the threads to the CPUs '%s'.\n", pin_list );
+	    return EXIT_FAILURE;
+	}
+    }
+    grid_set_huge_pages( huge_pages );
 
-    /* Initialize the pseudo-random number generator. */
-    srand( time( NULL ) );
+    if( width >= TERMITE_MAX_WIDTH ) {
+	fprintf( stderr, "The width must be less than %d.\n", TERMITE_MAX_WIDTH );
+	return EXIT_FAILURE;
+    }
+
+    /* Compute the actual number of termites and wood chips. The area
+     * can exceed the range of int, but the counts may not.
+     */
+    const double area = (double) width * height;
+    if( area * termite_fraction > INT_MAX || area * chip_fraction > INT_MAX ) {
+	fprintf( stderr, "At most %d termites and %d wood chips are supported.\n", INT_MAX, INT_MAX );
+	return EXIT_FAILURE;
+    }
+    int num_termites = (int) (area * termite_fraction);
+    int num_chips = (int) (area * chip_fraction);
+    if( auto_layout ) {
+	layout = grid_choose_layout( width, height );
+    }
+    assert( layout != GRID_LAYOUT_POW2 || ((width & (width - 1)) == 0 && (height & (height - 1)) == 0) );
+    if( (engine == SIMULATION_ENGINE_SYNCHRONOUS || engine == SIMULATION_ENGINE_ASYNCHRONOUS
+	 || engine == SIMULATION_ENGINE_TILES || engine == SIMULATION_ENGINE_BLOCKED
+	 || engine == SIMULATION_ENGINE_LEAP) && layout == GRID_LAYOUT_SPARSE ) {
+	fprintf( stderr, "The %s engine does not support the sparse grid layout.\n", engine_name );
+	return EXIT_FAILURE;
+    }
 
-    /* Initialize the termite simulation. */
+    if( num_replicates > 0 ) {
+	return run_ensemble( width, height, layout, num_chips, num_termites, num_time_steps,
+			     engine, engine_name, seed, num_replicates, num_of_threads );
+    }
+
+    /* Initialize the termite simulation, either from scratch or from
+     * a snapshot. A resumed run continues from the step at which the
+     * snapshot was taken up to num_time_steps.
+     */
     struct simulation sim;
-    simulation_create( &sim, width, height, num_chips, num_termites );
+    if( resume_file != NULL ) {
+	if( ! simulation_load( &sim, resume_file ) ) {
+	    return EXIT_FAILURE;
+	}
+	grid_get_size( &sim.grid, &width, &height );
+	num_termites = sim.num_termites;
+	num_chips = sim.num_chips;
+	seed = sim.seed;
+    } else {
+	simulation_create_with_layout( &sim, width, height, num_chips, num_termites, seed, num_of_threads, layout );
+    }
+    const uint64_t first_step = sim.step;
+    num_of_threads = simulation_set_num_threads( &sim, num_of_threads );
+    simulation_set_block_steps( &sim, block_steps );
+    simulation_set_engine( &sim, engine );
+
+    /* Open the event count file, if requested. */
+    FILE *counters_out = NULL;
+    struct counters counters;
+    if( counters_every > 0 ) {
+	counters_out = fopen( counters_file, "w" );
+	if( counters_out == NULL ) {
+	    perror( counters_file );
+	    simulation_destroy( &sim );
+	    return EXIT_FAILURE;
+	}
+	counters_write_header( counters_out );
+	simulation_take_counters( &sim, &counters );
+    }
 
-    /* Simulate for the given number of time steps and measure the
-     * duration of the simulation.
+    /* Start keeping the cluster statistics, if requested. The
+     * convergence test samples the number of adjacent chips from them.
+     */
+    FILE *clusters_out = NULL;
+    if( (clusters_every > 0 || until_converged) && sim.grid.layout == GRID_LAYOUT_SPARSE ) {
+	fprintf( stderr, "Cluster statistics are not supported by the sparse grid layout.\n" );
+	simulation_destroy( &sim );
+	return EXIT_FAILURE;
+    }
+    /* A sparse grid has no planes to copy, so -v prints it between
+     * the steps instead.
+     */
+    bool print_ascii = false;
+    if( frames_every > 0 && sim.grid.layout == GRID_LAYOUT_SPARSE ) {
+	if( ! verbose ) {
+	    fprintf( stderr, "Frames are not supported by the sparse grid layout.\n" );
+	    simulation_destroy( &sim );
+	    return EXIT_FAILURE;
+	}
+	print_ascii = true;
+	frames_every = 0;
+    }
+    if( until_converged ) {
+	simulation_enable_clusters( &sim, clusters_region );
+    }
+    if( clusters_every > 0 ) {
+	clusters_out = fopen( clusters_file, "w" );
+	if( clusters_out == NULL ) {
+	    perror( clusters_file );
+	    simulation_destroy( &sim );
+	    return EXIT_FAILURE;
+	}
+	clusters_write_header( clusters_out );
+	if( sim.clusters == NULL ) {
+	    simulation_enable_clusters( &sim, clusters_region );
+	}
+	clusters_write_row( clusters_out, sim.step, sim.clusters );
+    }
+
+    /* Start the frame writer, if requested. */
+    FILE *frames_out = NULL;
+    struct frames frames;
+    if( frames_every > 0 ) {
+	frames_out = frames_file != NULL ? fopen( frames_file, "wb" ) : stdout;
+	if( frames_out == NULL ) {
+	    perror( frames_file );
+	    simulation_destroy( &sim );
+	    return EXIT_FAILURE;
+	}
+	if( auto_frames_format ) {
+	    frames_format = frames_choose_format( width, height );
+	}
+	frames_create( &frames, &sim.grid, frames_format, frames_out, frames_all );
+    }
+
+    /* Set up the convergence test, if requested. */
+    struct convergence conv;
+    bool converged = false;
+    if( until_converged ) {
+	convergence_create( &conv, converge_window, converge_tolerance );
+    }
+
+    /* Simulate for the given number of time steps (or until
+     * convergence) and measure the duration of the simulation.
      */
 
     /* Start the clock. */
     double t1 = gettime( );
 
+    /* Run on several processes, if requested, which leaves nothing for
+     * the loop below to do.
+     */
+    struct distributed_totals totals;
+    if( num_procs > 0 && ! distributed_run( &sim, num_procs, block_steps, num_time_steps, &totals ) ) {
+	simulation_destroy( &sim );
+	return EXIT_FAILURE;
+    }
+
     /* Simulation loop. */
-    for( int time_step = 0; time_step < num_time_steps; ++time_step ) {
-	/* Advance the simulation one time step. */
-	simulation_step( &sim );
+    while( sim.step < (uint64_t) num_time_steps && ! converged ) {
+	/* Sort the termites, if requested. */
+	if( reorder_every > 0 && sim.step % reorder_every == 0 ) {
+	    simulation_reorder( &sim );
+	}
+
+	/* Advance the simulation up to the next time step at which
+	 * something is due (one step at a time, unless the engine takes
+	 * several at once).
+	 */
+	uint64_t max_steps = num_time_steps - sim.step;
+	max_steps = steps_until( sim.step, reorder_every, max_steps );
+	max_steps = steps_until( sim.step, counters_every, max_steps );
+	if( clusters_every > 0 ) {
+	    max_steps = steps_until( sim.step, clusters_every, max_steps );
+	    max_steps = steps_until( sim.step, relabel_every, max_steps );
+	}
+	if( until_converged ) {
+	    max_steps = steps_until( sim.step, converge_every, max_steps );
+	}
+	max_steps = steps_until( sim.step, checkpoint_every, max_steps );
+	max_steps = steps_until( sim.step, frames_every, max_steps );
+	if( print_ascii ) {
+	    max_steps = 1;
+	}
+	simulation_advance( &sim, (int) max_steps );
 
-	/* Print partial state information to stdout, if requested. */
-	if( verbose ) {
+	/* Print the grid to stdout, if requested. */
+	if( print_ascii ) {
 	    simulation_print_ascii( &sim );
 	}
+
+	/* Hand a copy of the grid to the frame writer, if requested. */
+	if( frames_every > 0 && sim.step % frames_every == 0 ) {
+	    frames_push( &frames, &sim.grid, sim.step );
+	}
+
+	/* Write the event counts, if requested. */
+	if( counters_every > 0 && sim.step % counters_every == 0 ) {
+	    simulation_take_counters( &sim, &counters );
+	    counters_write_row( counters_out, sim.step, &counters );
+	}
+
+	/* Write the cluster statistics, if requested. */
+	if( clusters_every > 0 && relabel_every > 0 && sim.step % relabel_every == 0 ) {
+	    simulation_relabel_clusters( &sim );
+	}
+	if( clusters_every > 0 && sim.step % clusters_every == 0 ) {
+	    clusters_write_row( clusters_out, sim.step, sim.clusters );
+	}
+
+	/* Test for convergence, if requested. */
+	if( until_converged && sim.step % converge_every == 0 ) {
+	    converged = convergence_sample( &conv, sim.clusters->adjacencies );
+	}
+
+	/* Save a snapshot, if requested. */
+	if( checkpoint_every > 0 && sim.step % checkpoint_every == 0 ) {
+	    if( ! simulation_save( &sim, checkpoint_file ) ) {
+		simulation_destroy( &sim );
+		return EXIT_FAILURE;
+	    }
+	}
     }
+    const int steps_taken = (int) (sim.step - first_step);
 
     /* Stop the clock and calculate duration. */
     double t2 = gettime( );
     double duration = t2 - t1;
 
+    /* Let the writer finish before the summary goes to stdout. */
+    bool frames_ok = true;
+    if( frames_every > 0 ) {
+	frames_ok = frames_destroy( &frames );
+	if( frames_out != stdout ) {
+	    frames_ok &= fclose( frames_out ) == 0;
+	}
+	if( ! frames_ok ) {
+	    fprintf( stderr, "Could not write the frames to %s\n", frames_file != NULL ? frames_file : "stdout" );
+	}
+    }
+
     /* Print simulation summary. */
     printf( "\n" );
     printf( "         TERMITE SIMULATION SUMMARY\n" );
     printf( "============================================\n" );
     printf( "\n" );
     printf( "            Grid size: %d-by-%d\n", width, height );
-    printf( " Number of time steps: %d\n", num_time_steps );
+    printf( " Number of time steps: %d\n", steps_taken );
+    if( resume_file != NULL ) {
+	printf( "         Resumed from: %s (step %llu)\n", resume_file, (unsigned long long) first_step );
+    }
+    if( until_converged ) {
+	if( converged ) {
+	    printf( "    Converged at step: %llu\n", (unsigned long long) sim.step );
+	} else {
+	    printf( "    Converged at step: not converged\n" );
+	}
+    }
     printf( "   Number of termites: %d\n", num_termites );
     printf( " Number of wood chips: %d\n", num_chips );
+    printf( "    Number of threads: %d\n", num_of_threads );
+    if( num_procs > 0 ) {
+	printf( "  Number of processes: %d\n", num_procs );
+	printf( "   Termites (reduced): %lld\n", (long long) totals.termites );
+	printf( " Wood chips (reduced): %lld\n", (long long) totals.chips );
+    }
+    if( frames_every > 0 ) {
+	printf( "       Frames written: %llu (%llu dropped)\n",
+		(unsigned long long) frames.written, (unsigned long long) frames.dropped );
+    }
+    printf( "               Engine: %s\n", engine_name );
+    printf( "                 Seed: %llu\n", (unsigned long long) seed );
+    printf( "          Grid layout: %s\n", layout_names[ sim.grid.layout ] );
+    printf( "   Grid memory in use: %.3lf [MB]\n", grid_get_memory_footprint( &sim.grid ) / 1e6 );
     printf( "Total simulation time: %.6lf [s]\n", duration );
-    printf( "   Time per time step: %.6lf [ms]\n", duration / num_time_steps * 1e3 );
+    printf( "   Time per time step: %.6lf [ms]\n", steps_taken > 0 ? duration / steps_taken * 1e3 : 0.0 );
     printf( "\n" );
 
     /* Cleanup. */
+    if( counters_out != NULL ) {
+	fclose( counters_out );
+    }
+    if( clusters_out != NULL ) {
+	fclose( clusters_out );
+    }
+    if( until_converged ) {
+	convergence_destroy( &conv );
+    }
     simulation_destroy( &sim );
 
+    if( ! frames_ok ) {
+	return EXIT_FAILURE;
+    }
+
+    /* The processes must have accounted for every termite and chip. */
+    if( num_procs > 0 && (totals.termites != num_termites || totals.chips != num_chips) ) {
+	fprintf( stderr, "The processes lost termites or wood chips.\n" );
+	return EXIT_FAILURE;
+    }
+
     /* Exit the program normally. */
     return EXIT_SUCCESS;
 }
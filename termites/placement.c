@@ -0,0 +1,262 @@
+#include "placement.h"
+
+#include "intlist.h"
+#include "rng.h"
+
+
+/**
+ * \brief Context for scatter_task().
+ */
+struct scatter_context
+{
+    /** \brief The grid. */
+    struct grid *grid;
+
+    /** \brief The seed of the random number generator. */
+    uint64_t seed;
+
+    /** \brief A cell gets a chip if the low half of its draw is below this. */
+    uint32_t chip_threshold;
+
+    /** \brief A cell gets a termite if the high half of its draw is below this. */
+    uint32_t termite_threshold;
+
+    /** \brief The number of chips placed by each worker. */
+    int64_t *num_chips;
+
+    /** \brief The x-coordinates of the termites found by each worker. */
+    struct intlist *xs;
+
+    /** \brief The y-coordinates of the termites found by each worker. */
+    struct intlist *ys;
+};
+
+
+/**
+ * \brief Returns the threshold below which a uniform 32-bit number
+ * falls with probability count / cells.
+ */
+static uint32_t threshold( const struct grid *grid,
+			   int count )
+{
+    const double cells = (double) grid->width * grid->height;
+    return (uint32_t) ((double) count / cells * 4294967296.0);
+}
+
+
+/**
+ * \brief Fills one band of rows per worker.
+ *
+ * Chip bits are collected into whole words before they are written.
+ * The words at the edges of a band can be shared with the neighboring
+ * bands, so they are merged into the plane atomically. Termites are
+ * only recorded here and placed by the correction pass.
+ *
+ * \param [in,out] arg The scatter_context.
+ *
+ * \param [in] worker
+ *
+ * \param [in] num_workers
+ */
+static void scatter_task( void *arg,
+			  int worker,
+			  int num_workers )
+{
+    struct scatter_context *ctx = (struct scatter_context*) arg;
+    const struct grid *grid = ctx->grid;
+    uint64_t *chips = grid->chips;
+    const int row_begin = (int) ((int64_t) worker * grid->height / num_workers);
+    const int row_end = (int) ((int64_t) (worker + 1) * grid->height / num_workers);
+
+    int64_t count = 0;
+    size_t word = SIZE_MAX;
+    uint64_t bits = 0;
+    for( int y = row_begin; y < row_end; ++y ) {
+	for( int x = 0; x < grid->width; ++x ) {
+	    const uint64_t random = rng_draw( ctx->seed, RNG_STREAM_CELLS, (uint64_t) y * grid->width + x );
+	    if( (uint32_t) (random >> 32) < ctx->termite_threshold ) {
+		intlist_push( &ctx->xs[ worker ], x );
+		intlist_push( &ctx->ys[ worker ], y );
+	    }
+	    if( (uint32_t) random >= ctx->chip_threshold ) {
+		continue;
+	    }
+	    ++count;
+	    const size_t k = grid_index( grid, x, y );
+	    if( (k >> 6) != word ) {
+		if( bits != 0 ) {
+		    __atomic_fetch_or( &chips[ word ], bits, __ATOMIC_RELAXED );
+		}
+		word = k >> 6;
+		bits = 0;
+	    }
+	    bits |= UINT64_C( 1 ) << (k & 63);
+	}
+    }
+    if( bits != 0 ) {
+	__atomic_fetch_or( &chips[ word ], bits, __ATOMIC_RELAXED );
+    }
+    ctx->num_chips[ worker ] = count;
+}
+
+
+/**
+ * \brief Returns a random coordinate pair from the correction stream.
+ */
+static void random_cell( const struct grid *grid,
+			 uint64_t seed,
+			 uint64_t *counter,
+			 int *x,
+			 int *y )
+{
+    (*x) = rng_range( rng_draw( seed, RNG_STREAM_FIXUP, (*counter)++ ), grid->width );
+    (*y) = rng_range( rng_draw( seed, RNG_STREAM_FIXUP, (*counter)++ ), grid->height );
+}
+
+
+/**
+ * \brief Places the chips and then the termites one by one on random
+ * free cells (rejection sampling).
+ *
+ * Takes time proportional to the counts instead of the area, which is
+ * what the sparse layout needs.
+ */
+static void scatter_by_rejection( struct grid *grid,
+				  int num_chips,
+				  int num_termites,
+				  uint64_t seed,
+				  int *xs,
+				  int *ys )
+{
+    uint64_t counter = 0;
+    for( int k = 0; k < num_chips; ) {
+	int x, y;
+	random_cell( grid, seed, &counter, &x, &y );
+	if( ! grid_has_wood_chip_at( grid, x, y ) ) {
+	    grid_place_wood_chip_at( grid, x, y );
+	    ++k;
+	}
+    }
+    for( int k = 0; k < num_termites; ) {
+	int x, y;
+	random_cell( grid, seed, &counter, &x, &y );
+	if( ! grid_has_termite_at( grid, x, y ) ) {
+	    grid_place_termite_at( grid, x, y );
+	    xs[ k ] = x;
+	    ys[ k ] = y;
+	    ++k;
+	}
+    }
+}
+
+
+void placement_scatter( struct grid *grid,
+			const int num_chips,
+			const int num_termites,
+			const uint64_t seed,
+			struct workers *workers,
+			int *xs,
+			int *ys )
+{
+    assert( grid != NULL );
+    assert( workers != NULL );
+    assert( xs != NULL );
+    assert( ys != NULL );
+    assert( num_chips >= 0 && num_chips < (double) grid->width * grid->height / 2 );
+    assert( num_termites >= 0 && num_termites < (double) grid->width * grid->height / 2 );
+
+    /* A sparse grid is too large to visit every cell. */
+    if( grid->layout == GRID_LAYOUT_SPARSE ) {
+	scatter_by_rejection( grid, num_chips, num_termites, seed, xs, ys );
+	return;
+    }
+
+    /* Choose the cells independently. */
+    const int num_workers = workers->num_workers;
+    struct scatter_context ctx;
+    ctx.grid = grid;
+    ctx.seed = seed;
+    ctx.chip_threshold = threshold( grid, num_chips );
+    ctx.termite_threshold = threshold( grid, num_termites );
+    ctx.num_chips = malloc( sizeof( int64_t ) * num_workers );
+    ctx.xs = malloc( sizeof( struct intlist ) * num_workers );
+    ctx.ys = malloc( sizeof( struct intlist ) * num_workers );
+    for( int w = 0; w < num_workers; ++w ) {
+	intlist_create( &ctx.xs[ w ] );
+	intlist_create( &ctx.ys[ w ] );
+    }
+    workers_run( workers, scatter_task, &ctx );
+    grid_update_all_ghosts( grid );
+
+    int64_t chips = 0;
+    struct intlist all_xs, all_ys;
+    intlist_create( &all_xs );
+    intlist_create( &all_ys );
+    for( int w = 0; w < num_workers; ++w ) {
+	chips += ctx.num_chips[ w ];
+	intlist_append( &all_xs, &ctx.xs[ w ] );
+	intlist_append( &all_ys, &ctx.ys[ w ] );
+	intlist_destroy( &ctx.xs[ w ] );
+	intlist_destroy( &ctx.ys[ w ] );
+    }
+    free( ctx.num_chips );
+    free( ctx.xs );
+    free( ctx.ys );
+
+    /* Correct the number of chips on randomly chosen cells. */
+    uint64_t counter = 0;
+    while( chips != num_chips ) {
+	int x, y;
+	random_cell( grid, seed, &counter, &x, &y );
+	const bool chip = grid_has_wood_chip_at( grid, x, y );
+	if( chips > num_chips && chip ) {
+	    grid_remove_wood_chip_at( grid, x, y );
+	    --chips;
+	} else if( chips < num_chips && ! chip ) {
+	    grid_place_wood_chip_at( grid, x, y );
+	    ++chips;
+	}
+    }
+
+    /* Drop randomly chosen surplus termites. */
+    while( all_xs.count > num_termites ) {
+	const int k = rng_range( rng_draw( seed, RNG_STREAM_FIXUP, counter++ ), all_xs.count );
+	all_xs.items[ k ] = all_xs.items[ all_xs.count - 1 ];
+	all_ys.items[ k ] = all_ys.items[ all_ys.count - 1 ];
+	--all_xs.count;
+	--all_ys.count;
+    }
+
+    /* Place the termites, and then add missing termites on randomly
+     * chosen free cells.
+     */
+    for( int k = 0; k < all_xs.count; ++k ) {
+	grid_place_termite_at( grid, all_xs.items[ k ], all_ys.items[ k ] );
+    }
+    while( all_xs.count < num_termites ) {
+	int x, y;
+	random_cell( grid, seed, &counter, &x, &y );
+	if( ! grid_has_termite_at( grid, x, y ) ) {
+	    grid_place_termite_at( grid, x, y );
+	    intlist_push( &all_xs, x );
+	    intlist_push( &all_ys, y );
+	}
+    }
+
+    /* The termites were found in row order. Shuffle them (Fisher-Yates)
+     * so that they are stepped in random order.
+     */
+    for( int k = num_termites - 1; k > 0; --k ) {
+	const int j = rng_range( rng_draw( seed, RNG_STREAM_FIXUP, counter++ ), k + 1 );
+	xs[ k ] = all_xs.items[ j ];
+	ys[ k ] = all_ys.items[ j ];
+	all_xs.items[ j ] = all_xs.items[ k ];
+	all_ys.items[ j ] = all_ys.items[ k ];
+    }
+    if( num_termites > 0 ) {
+	xs[ 0 ] = all_xs.items[ 0 ];
+	ys[ 0 ] = all_ys.items[ 0 ];
+    }
+    intlist_destroy( &all_xs );
+    intlist_destroy( &all_ys );
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common.h"
+
+#include "grid.h"
+#include "workers.h"
+
+
+/**
+ * \brief Places wood chips and termites on cells chosen uniformly at
+ * random.
+ *
+ * No two chips share a cell and no two termites share a cell, but a
+ * termite can start on a chip.
+ *
+ * The placement runs in linear time, in parallel over bands of rows.
+ * First every cell independently receives a chip with probability
+ * num_chips / cells and a termite with probability num_termites /
+ * cells. Both are decided by one hash of the seed and the cell
+ * coordinates, so the result does not depend on the number of
+ * workers. A sequential correction pass then removes or adds chips
+ * and termites on randomly chosen cells until the counts are exact.
+ * The expected number of corrections is of the order of the square
+ * root of the counts. By symmetry every set of cells is equally
+ * likely, as with sampling without replacement.
+ *
+ * A grid with the sparse layout is filled by rejection sampling
+ * instead, one chip or termite at a time, in time proportional to
+ * the counts. The result then differs from that of a dense layout.
+ *
+ * \param [in,out] grid An empty grid.
+ *
+ * \param [in] num_chips The number of chips (less than half the cells).
+ *
+ * \param [in] num_termites The number of termites (less than half the cells).
+ *
+ * \param [in] seed The seed of the random number generator.
+ *
+ * \param [in,out] workers The workers to run the placement on.
+ *
+ * \param [out] xs The x-coordinates of the termites (num_termites
+ * items, in random order).
+ *
+ * \param [out] ys The y-coordinates of the termites.
+ */
+void placement_scatter( struct grid *grid,
+			int num_chips,
+			int num_termites,
+			uint64_t seed,
+			struct workers *workers,
+			int *xs,
+			int *ys );
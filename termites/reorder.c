@@ -0,0 +1,156 @@
+#include "reorder.h"
+
+
+/** \brief The number of different values of a digit. */
+#define REORDER_RADIX 256
+
+
+/**
+ * \brief Context for reorder_task().
+ */
+struct reorder_context
+{
+    /** \brief The termites. */
+    struct termite *termites;
+
+    /** \brief A copy of the termites in their original order. */
+    struct termite *original;
+
+    /** \brief The number of termites. */
+    int count;
+
+    /** \brief The number of digits of the keys. */
+    int num_digits;
+
+    /** \brief Two buffers of keys, swapped in every pass. */
+    uint64_t *keys[ 2 ];
+
+    /** \brief Two buffers of original indices, swapped in every pass. */
+    int *index[ 2 ];
+
+    /** \brief The digit counts of each worker (REORDER_RADIX per worker). */
+    int *histogram;
+
+    /** \brief The workers. */
+    struct workers *workers;
+};
+
+
+/**
+ * \brief Sorts the termites on all workers (see reorder_termites()).
+ *
+ * \param [in,out] arg The reorder_context.
+ *
+ * \param [in] worker
+ *
+ * \param [in] num_workers
+ */
+static void reorder_task( void *arg,
+			  int worker,
+			  int num_workers )
+{
+    struct reorder_context *ctx = (struct reorder_context*) arg;
+    const int begin = (int) ((int64_t) worker * ctx->count / num_workers);
+    const int end = (int) ((int64_t) (worker + 1) * ctx->count / num_workers);
+    int *histogram = &ctx->histogram[ worker * REORDER_RADIX ];
+
+    /* Compute the keys of the chunk. */
+    for( int k = begin; k < end; ++k ) {
+	int x, y;
+	termite_get_coords( &ctx->termites[ k ], &x, &y );
+	ctx->original[ k ] = ctx->termites[ k ];
+	ctx->keys[ 0 ][ k ] = reorder_morton( x, y );
+	ctx->index[ 0 ][ k ] = k;
+    }
+
+    int src = 0;
+    for( int digit = 0; digit < ctx->num_digits; ++digit ) {
+	const int shift = 8 * digit;
+	const uint64_t *keys = ctx->keys[ src ];
+	const int *index = ctx->index[ src ];
+
+	/* Count the digits of the chunk. */
+	memset( histogram, 0, sizeof( int ) * REORDER_RADIX );
+	for( int k = begin; k < end; ++k ) {
+	    ++histogram[ (keys[ k ] >> shift) & (REORDER_RADIX - 1) ];
+	}
+	workers_barrier( ctx->workers );
+
+	/* The chunk's items with digit d go after all items with a
+	 * smaller digit and after the items with digit d of the
+	 * preceding chunks.
+	 */
+	int offset[ REORDER_RADIX ];
+	int position = 0;
+	for( int d = 0; d < REORDER_RADIX; ++d ) {
+	    for( int w = 0; w < num_workers; ++w ) {
+		if( w == worker ) {
+		    offset[ d ] = position;
+		}
+		position += ctx->histogram[ w * REORDER_RADIX + d ];
+	    }
+	}
+
+	/* Scatter the chunk. */
+	uint64_t *out_keys = ctx->keys[ 1 - src ];
+	int *out_index = ctx->index[ 1 - src ];
+	for( int k = begin; k < end; ++k ) {
+	    const int target = offset[ (keys[ k ] >> shift) & (REORDER_RADIX - 1) ]++;
+	    out_keys[ target ] = keys[ k ];
+	    out_index[ target ] = index[ k ];
+	}
+	src = 1 - src;
+	workers_barrier( ctx->workers );
+    }
+
+    /* Move the termites into their sorted positions. */
+    const int *index = ctx->index[ src ];
+    for( int k = begin; k < end; ++k ) {
+	ctx->termites[ k ] = ctx->original[ index[ k ] ];
+    }
+}
+
+
+void reorder_termites( struct termite *termites,
+		       const int count,
+		       const struct grid *grid,
+		       struct workers *workers )
+{
+    assert( termites != NULL || count == 0 );
+    assert( grid != NULL );
+    assert( workers != NULL );
+
+    /* Only the bytes that can be nonzero need a pass. */
+    const uint64_t largest = reorder_morton( grid->width - 1, grid->height - 1 );
+    int num_digits = 0;
+    while( num_digits < 8 && (largest >> (8 * num_digits)) != 0 ) {
+	++num_digits;
+    }
+
+    struct reorder_context ctx;
+    ctx.termites = termites;
+    ctx.original = malloc( sizeof( struct termite ) * count );
+    ctx.count = count;
+    ctx.num_digits = num_digits;
+    ctx.keys[ 0 ] = malloc( sizeof( uint64_t ) * count );
+    ctx.keys[ 1 ] = malloc( sizeof( uint64_t ) * count );
+    ctx.index[ 0 ] = malloc( sizeof( int ) * count );
+    ctx.index[ 1 ] = malloc( sizeof( int ) * count );
+    ctx.histogram = malloc( sizeof( int ) * REORDER_RADIX * workers->num_workers );
+    assert( ctx.original != NULL && ctx.keys[ 0 ] != NULL && ctx.keys[ 1 ] != NULL
+	    && ctx.index[ 0 ] != NULL && ctx.index[ 1 ] != NULL && ctx.histogram != NULL );
+    ctx.workers = workers;
+
+    /* Every worker copies its own chunk of the original array before
+     * the first barrier and reads arbitrary items of the copy only
+     * after the last one.
+     */
+    workers_run( workers, reorder_task, &ctx );
+
+    free( ctx.original );
+    free( ctx.keys[ 0 ] );
+    free( ctx.keys[ 1 ] );
+    free( ctx.index[ 0 ] );
+    free( ctx.index[ 1 ] );
+    free( ctx.histogram );
+}
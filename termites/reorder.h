@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.h"
+
+#include "grid.h"
+#include "termite.h"
+#include "workers.h"
+
+
+/**
+ * \brief Returns the Morton (Z-order) key of a cell.
+ *
+ * The key interleaves the bits of the coordinates, x in the even bits
+ * and y in the odd bits, so cells that are close on the grid tend to
+ * have close keys.
+ *
+ * \param [in] x
+ *
+ * \param [in] y
+ *
+ * \return The key.
+ */
+static inline uint64_t reorder_morton( uint32_t x,
+				       uint32_t y )
+{
+    uint64_t k[ 2 ] = { x, y };
+    for( int i = 0; i < 2; ++i ) {
+	k[ i ] = (k[ i ] | (k[ i ] << 16)) & UINT64_C( 0x0000ffff0000ffff );
+	k[ i ] = (k[ i ] | (k[ i ] << 8)) & UINT64_C( 0x00ff00ff00ff00ff );
+	k[ i ] = (k[ i ] | (k[ i ] << 4)) & UINT64_C( 0x0f0f0f0f0f0f0f0f );
+	k[ i ] = (k[ i ] | (k[ i ] << 2)) & UINT64_C( 0x3333333333333333 );
+	k[ i ] = (k[ i ] | (k[ i ] << 1)) & UINT64_C( 0x5555555555555555 );
+    }
+    return k[ 0 ] | (k[ 1 ] << 1);
+}
+
+
+/**
+ * \brief Sorts an array of termites by the Morton keys of their cells.
+ *
+ * Consecutive termites of the sorted array are then close on the grid
+ * and touch the same cache lines and pages of the grid planes when
+ * they are stepped one after the other.
+ *
+ * The sort is a stable least significant digit radix sort on 8-bit
+ * digits, with as many passes as the keys of the grid have bytes. In
+ * each pass every worker counts the digits of one contiguous chunk
+ * of the array, the counts are turned into disjoint output ranges,
+ * and every worker scatters its chunk. The result does not depend on
+ * the number of workers.
+ *
+ * \param [in,out] termites The termites.
+ *
+ * \param [in] count The number of termites.
+ *
+ * \param [in] grid The grid in which the termites wander.
+ *
+ * \param [in,out] workers The workers to sort on.
+ */
+void reorder_termites( struct termite *termites,
+		       int count,
+		       const struct grid *grid,
+		       struct workers *workers );
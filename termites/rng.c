@@ -0,0 +1,31 @@
+#include "rng.h"
+
+
+void rng_fill( const uint64_t seed,
+	       const uint64_t first_stream,
+	       const uint64_t counter,
+	       const int count,
+	       uint64_t *restrict out )
+{
+    assert( count >= 0 );
+    assert( out != NULL || count == 0 );
+
+    for( int k = 0; k < count; ++k ) {
+	out[ k ] = rng_draw( seed, first_stream + (uint64_t) k, counter );
+    }
+}
+
+
+void rng_fill_turns( const uint64_t seed,
+		     const uint64_t first_stream,
+		     const uint64_t counter,
+		     const int count,
+		     uint8_t *restrict out )
+{
+    assert( count >= 0 );
+    assert( out != NULL || count == 0 );
+
+    for( int k = 0; k < count; ++k ) {
+	out[ k ] = rng_turn( rng_draw( seed, first_stream + (uint64_t) k, counter ) );
+    }
+}
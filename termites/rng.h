@@ -0,0 +1,159 @@
+#pragma once
+
+#include "common.h"
+
+
+/**
+ * \brief A counter-based pseudo-random number generator.
+ *
+ * There is no generator state. A draw is a pure function of a seed,
+ * a stream and a counter, computed by a SplitMix64-style hash. Every
+ * termite draws from its own stream (its index) with the time step
+ * as the counter, so its random numbers do not depend on the order in
+ * which the termites are stepped or on which thread steps them.
+ */
+
+
+/** \brief The stream used while setting up a simulation. */
+#define RNG_STREAM_SETUP (UINT64_C( 1 ) << 63)
+
+/** \brief The stream deciding the initial chip and termite of each cell. */
+#define RNG_STREAM_CELLS (RNG_STREAM_SETUP + 1)
+
+/** \brief The stream used to correct the initial counts and order. */
+#define RNG_STREAM_FIXUP (RNG_STREAM_SETUP + 2)
+
+/** \brief The stream deciding the initial direction of each termite. */
+#define RNG_STREAM_DIRECTIONS (RNG_STREAM_SETUP + 3)
+
+/** \brief The stream deriving the seeds of the replicates of an ensemble. */
+#define RNG_STREAM_ENSEMBLE (RNG_STREAM_SETUP + 4)
+
+/** \brief The stream deciding which of several termites claiming a cell moves. */
+#define RNG_STREAM_PRIORITY (RNG_STREAM_SETUP + 5)
+
+
+/**
+ * \brief Turn thresholds for termite_step(). A draw below
+ * RNG_TURN_LEFT (probability 0.1) turns left, a draw below
+ * RNG_TURN_RIGHT (probability 0.1) turns right, and anything else
+ * (probability 0.8) keeps the course.
+ */
+#define RNG_TURN_LEFT UINT64_C( 0x1999999999999999 )
+#define RNG_TURN_RIGHT UINT64_C( 0x3333333333333333 )
+
+
+/**
+ * \brief Maps a random number to the turn of a termite.
+ *
+ * \param [in] random A uniformly distributed 64-bit random number.
+ *
+ * \return The number of quarter turns to the right: 3 (left), 1
+ * (right) or 0 (straight on), see RNG_TURN_LEFT and RNG_TURN_RIGHT.
+ */
+static inline uint8_t rng_turn( uint64_t random )
+{
+    return 3 * (random < RNG_TURN_LEFT) + (random >= RNG_TURN_LEFT && random < RNG_TURN_RIGHT);
+}
+
+
+/**
+ * \brief The SplitMix64 finalizer (a bijective 64-bit mixing function).
+ *
+ * \param [in] z
+ *
+ * \return The mixed value.
+ */
+static inline uint64_t rng_mix( uint64_t z )
+{
+    z = (z ^ (z >> 30)) * UINT64_C( 0xbf58476d1ce4e5b9 );
+    z = (z ^ (z >> 27)) * UINT64_C( 0x94d049bb133111eb );
+    return z ^ (z >> 31);
+}
+
+
+/**
+ * \brief Returns the random number for a given seed, stream and counter.
+ *
+ * \param [in] seed The seed of the simulation.
+ *
+ * \param [in] stream The stream (e.g., the index of a termite).
+ *
+ * \param [in] counter The counter (e.g., the time step).
+ *
+ * \return A uniformly distributed 64-bit random number.
+ */
+static inline uint64_t rng_draw( uint64_t seed,
+				 uint64_t stream,
+				 uint64_t counter )
+{
+    const uint64_t key = rng_mix( seed + stream * UINT64_C( 0x9e3779b97f4a7c15 ) );
+    return rng_mix( key ^ (counter * UINT64_C( 0xd1b54a32d192ed03 )) );
+}
+
+
+/**
+ * \brief Maps a random number to the range 0 to n-1.
+ *
+ * \param [in] random A uniformly distributed 64-bit random number.
+ *
+ * \param [in] n The size of the range.
+ *
+ * \return A number in the range 0 to n-1.
+ */
+static inline uint32_t rng_range( uint64_t random,
+				  uint32_t n )
+{
+    return (uint32_t) (((random >> 32) * n) >> 32);
+}
+
+
+/**
+ * \brief Computes the random numbers of consecutive streams for one
+ * counter value.
+ *
+ * Sets out[ k ] = rng_draw( seed, first_stream + k, counter ) for k
+ * = 0, ..., count-1. The loop has no dependencies between iterations
+ * and is vectorized by the compiler.
+ *
+ * \param [in] seed
+ *
+ * \param [in] first_stream
+ *
+ * \param [in] counter
+ *
+ * \param [in] count
+ *
+ * \param [out] out
+ */
+void rng_fill( uint64_t seed,
+	       uint64_t first_stream,
+	       uint64_t counter,
+	       int count,
+	       uint64_t *out );
+
+
+/**
+ * \brief Computes the turns of consecutive streams for one counter
+ * value.
+ *
+ * Sets out[ k ] = rng_turn( rng_draw( seed, first_stream + k, counter
+ * ) ) for k = 0, ..., count-1. Like rng_fill(), the loop is
+ * vectorized, and the turns are narrowed to bytes in the vector
+ * registers, so a step reads one byte per termite instead of eight.
+ *
+ * \param [in] seed
+ *
+ * \param [in] first_stream
+ *
+ * \param [in] counter
+ *
+ * \param [in] count
+ *
+ * \param [out] out
+ */
+void rng_fill_turns( uint64_t seed,
+		     uint64_t first_stream,
+		     uint64_t counter,
+		     int count,
+		     uint8_t *out );
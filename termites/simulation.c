@@ -1,54 +1,226 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "simulation.h"
 
+#include "placement.h"
+#include "reorder.h"
+
+
+/** \brief The magic bytes at the start of a snapshot file. */
+static const char snapshot_magic[ 8 ] = { 'T', 'E', 'R', 'M', 'S', 'N', 'A', 'P' };
+
+/** \brief The version of the snapshot format. */
+#define SNAPSHOT_VERSION 1
+
+/** \brief The alignment of the planes in a snapshot file. */
+#define SNAPSHOT_ALIGNMENT 4096
+
+
+/**
+ * \brief The header of a snapshot file.
+ */
+struct snapshot_header
+{
+    /** \brief Always snapshot_magic. */
+    char magic[ 8 ];
+
+    /** \brief Always SNAPSHOT_VERSION. */
+    uint32_t version;
+
+    /** \brief The size of this header (guards against ABI changes). */
+    uint32_t header_size;
+
+    /** \brief The width of the grid. */
+    int32_t width;
+
+    /** \brief The height of the grid. */
+    int32_t height;
+
+    /** \brief The layout of the planes. */
+    int32_t layout;
+
+    /** \brief Padding. */
+    int32_t reserved;
+
+    /** \brief The number of wood chips. */
+    int64_t num_chips;
+
+    /** \brief The number of termites. */
+    int64_t num_termites;
+
+    /** \brief The seed of the random number generator. */
+    uint64_t seed;
+
+    /** \brief The step counter. */
+    uint64_t step;
+
+    /** \brief The number of words in each plane. */
+    uint64_t num_words;
+
+    /** \brief The file offset of the planes. */
+    uint64_t planes_offset;
+
+    /** \brief The file offset of the termite arrays. */
+    uint64_t termites_offset;
+
+    /** \brief The total size of the file. */
+    uint64_t file_size;
+};
+
+
+
+/**
+ * \brief Writes one band of the grid and one chunk of the termite
+ * arrays of a new simulation, so that their pages are placed on the
+ * NUMA node of the worker (see grid_first_touch()).
+ *
+ * The chunks match those of the engines that split the termites by
+ * index.
+ *
+ * \param [in,out] arg The simulation.
+ *
+ * \param [in] worker
+ *
+ * \param [in] num_workers
+ */
+static void first_touch_task( void *arg,
+			      int worker,
+			      int num_workers )
+{
+    struct simulation *sim = (struct simulation*) arg;
+    const int begin = (int) ((int64_t) sim->num_termites * worker / num_workers);
+    const int end = (int) ((int64_t) sim->num_termites * (worker + 1) / num_workers);
+    grid_first_touch( &sim->grid, worker, num_workers );
+    memset( &sim->termites[ begin ], 0, sizeof( struct termite ) * (end - begin) );
+    memset( &sim->turns[ begin ], 0, sizeof( uint8_t ) * (end - begin) );
+}
+
+
+/**
+ * \brief Returns the number of threads that can step the simulation:
+ * num_threads, but at least 1 and at most strips_max_count( sim ).
+ */
+static int clamp_num_threads( const struct simulation *sim,
+			      int num_threads )
+{
+    if( num_threads > strips_max_count( sim ) ) {
+	num_threads = strips_max_count( sim );
+    }
+    if( num_threads < 1 ) {
+	num_threads = 1;
+    }
+    return num_threads;
+}
+
+
+/**
+ * \brief Places the wood chips and the termites randomly on an empty
+ * grid (see placement.h) and creates the termites.
+ *
+ * \param [in,out] sim A simulation with an empty grid and an
+ * allocated termite array.
+ *
+ * \param [in] num_threads The number of threads to use.
+ */
+static void populate( struct simulation *sim,
+		      int num_threads )
+{
+    const int n = sim->num_termites;
+    struct workers workers;
+    workers_create( &workers, num_threads );
+    workers_run( &workers, first_touch_task, sim );
+    int *xs = malloc( sizeof( int ) * n );
+    int *ys = malloc( sizeof( int ) * n );
+    placement_scatter( &sim->grid, sim->num_chips, n, sim->seed, &workers, xs, ys );
+    workers_destroy( &workers );
+    for( int k = 0; k < n; ++k ) {
+	const enum direction direction = rng_range( rng_draw( sim->seed, RNG_STREAM_DIRECTIONS, k ), 4 );
+	termite_restore( &sim->termites[ k ], &sim->grid, xs[ k ], ys[ k ], direction, false );
+    }
+    free( xs );
+    free( ys );
+}
 
 
 void simulation_create( struct simulation *sim,
 			int width,
 			int height,
 			int num_chips,
-			int num_termites )
+			int num_termites,
+			uint64_t seed,
+			int num_threads )
+{
+    simulation_create_with_layout( sim, width, height, num_chips, num_termites, seed, num_threads,
+				   grid_choose_layout( width, height ) );
+}
+
+
+void simulation_create_with_layout( struct simulation *sim,
+				    int width,
+				    int height,
+				    int num_chips,
+				    int num_termites,
+				    uint64_t seed,
+				    int num_threads,
+				    enum grid_layout layout )
 {
     assert( sim != NULL );
     assert( width > 0 );
     assert( height > 0 );
     assert( num_chips > 0 );
     assert( num_termites > 0 );
-    assert( num_chips + num_termites < width * height / 2 );
+    assert( (double) num_chips + num_termites < (double) width * height / 2 );
+    assert( num_threads > 0 );
 
     sim->num_chips = num_chips;
     sim->num_termites = num_termites;
-    grid_create( &sim->grid, 
-		 width,
-		 height );
+    sim->num_threads = 1;
+    sim->seed = seed;
+    sim->step = 0;
+    sim->mapping = NULL;
+    sim->mapping_size = 0;
+    sim->engine = SIMULATION_ENGINE_SCALAR;
+    sim->block_steps = 4;
+    sim->counters = counters_alloc( 1 );
+    sim->clusters = NULL;
+    grid_create_with_layout( &sim->grid,
+			     width,
+			     height,
+			     layout );
     sim->termites = malloc( sizeof( struct termite ) * num_termites );
+    sim->turns = malloc( sizeof( uint8_t ) * num_termites );
+    /* Touch the grid first with the threads that will step it. */
+    num_threads = clamp_num_threads( sim, num_threads );
+    populate( sim, num_threads );
+    simulation_set_num_threads( sim, num_threads );
+}
 
-    /* Place the wood chips randomly on the grid. */
-    for( int k = 0; k < num_chips; ++k ) {
-	int x, y;
 
-	/* An implementation note.
-	 *
-	 * If the randomly chosen coordinate already contains a wood
-	 * chip, then a new coordinate is chosen at random. For a very
-	 * heavily populated grid, this could become quite
-	 * expensive. The same holds for termites below.
-	 */
+void simulation_reset( struct simulation *sim,
+		       uint64_t seed )
+{
+    assert( sim != NULL );
+    assert( sim->mapping == NULL );
 
-	do {
-	    x = (int) (width * ( (double) rand( ) / RAND_MAX ));
-	    y = (int) (height * ( (double) rand( ) / RAND_MAX ));
-	} while( grid_has_wood_chip_at( &sim->grid, x, y ) );
-	grid_place_wood_chip_at( &sim->grid, x, y );
-    }
+    /* Restart the engine state from the new termites. */
+    const enum simulation_engine engine = sim->engine;
+    const int num_threads = sim->num_threads;
+    simulation_set_engine( sim, SIMULATION_ENGINE_SCALAR );
+    simulation_set_num_threads( sim, 1 );
 
-    /* Place the termites randomly on the grid. */
-    for( int k = 0; k < num_termites; ++k ) {
-	int x, y;
-	do {
-	    x = (int) (width * ( (double) rand( ) / RAND_MAX ));
-	    y = (int) (height * ( (double) rand( ) / RAND_MAX ));
-	} while( grid_has_termite_at( &sim->grid, x, y ) );
- 	termite_create( &sim->termites[ k ], &sim->grid, x, y, rand( ) % 4 );
+    grid_clear( &sim->grid );
+    sim->seed = seed;
+    sim->step = 0;
+    populate( sim, num_threads );
+    memset( sim->counters, 0, sizeof( struct counters ) );
+
+    simulation_set_num_threads( sim, num_threads );
+    simulation_set_engine( sim, engine );
+    if( sim->clusters != NULL ) {
+	simulation_relabel_clusters( sim );
     }
 }
 
@@ -57,6 +229,9 @@ void simulation_destroy( struct simulation *sim )
 {
     assert( sim != NULL );
 
+    simulation_set_num_threads( sim, 1 );
+    simulation_set_engine( sim, SIMULATION_ENGINE_SCALAR );
+
     sim->num_chips = 0;
     sim->num_termites = 0;
     grid_destroy( &sim->grid );
@@ -65,6 +240,115 @@ void simulation_destroy( struct simulation *sim )
     }
     free( sim->termites );
     sim->termites = NULL;
+    free( sim->turns );
+    sim->turns = NULL;
+    free( sim->counters );
+    sim->counters = NULL;
+    if( sim->clusters != NULL ) {
+	clusters_destroy( sim->clusters );
+	free( sim->clusters );
+	sim->clusters = NULL;
+    }
+    if( sim->mapping != NULL ) {
+	munmap( sim->mapping, sim->mapping_size );
+	sim->mapping = NULL;
+	sim->mapping_size = 0;
+    }
+}
+
+
+int simulation_set_num_threads( struct simulation *sim,
+				int num_threads )
+{
+    assert( sim != NULL );
+
+    num_threads = clamp_num_threads( sim, num_threads );
+    simulation_sync( sim );
+    if( sim->num_threads > 1 ) {
+	workers_destroy( &sim->workers );
+    }
+
+    /* Keep the counts taken so far in the counters of the first thread. */
+    struct counters *counters = counters_alloc( num_threads );
+    counters_sum( &counters[ 0 ], sim->counters, sim->num_threads );
+    free( sim->counters );
+    sim->counters = counters;
+    if( sim->clusters != NULL ) {
+	clusters_set_num_logs( sim->clusters, num_threads );
+    }
+
+    sim->num_threads = num_threads;
+    if( sim->num_threads > 1 ) {
+	workers_create( &sim->workers, num_threads );
+    }
+    return num_threads;
+}
+
+
+void simulation_set_engine( struct simulation *sim,
+			    const enum simulation_engine engine )
+{
+    assert( sim != NULL );
+
+    if( engine == sim->engine ) {
+	return;
+    }
+    simulation_sync( sim );
+    if( sim->engine == SIMULATION_ENGINE_SOA ) {
+	soa_destroy( &sim->soa );
+    } else if( sim->engine == SIMULATION_ENGINE_SYNCHRONOUS ) {
+	synchronous_destroy( &sim->synchronous );
+    } else if( sim->engine == SIMULATION_ENGINE_ASYNCHRONOUS ) {
+	asynchronous_destroy( &sim->asynchronous );
+    } else if( sim->engine == SIMULATION_ENGINE_TILES ) {
+	tiles_destroy( &sim->tiles );
+    } else if( sim->engine == SIMULATION_ENGINE_BLOCKED ) {
+	blocked_destroy( &sim->blocked );
+    } else if( sim->engine == SIMULATION_ENGINE_LEAP ) {
+	leap_destroy( &sim->leap );
+    } else if( sim->engine == SIMULATION_ENGINE_STRIPS ) {
+	strips_destroy( &sim->strips );
+    }
+    sim->engine = engine;
+    if( sim->engine == SIMULATION_ENGINE_SOA ) {
+	soa_create( &sim->soa, sim->termites, sim->num_termites );
+    } else if( sim->engine == SIMULATION_ENGINE_SYNCHRONOUS ) {
+	synchronous_create( &sim->synchronous, sim );
+    } else if( sim->engine == SIMULATION_ENGINE_ASYNCHRONOUS ) {
+	asynchronous_create( &sim->asynchronous, sim );
+    } else if( sim->engine == SIMULATION_ENGINE_TILES ) {
+	tiles_create( &sim->tiles, sim );
+    } else if( sim->engine == SIMULATION_ENGINE_BLOCKED ) {
+	blocked_create( &sim->blocked, sim, sim->block_steps );
+    } else if( sim->engine == SIMULATION_ENGINE_LEAP ) {
+	leap_create( &sim->leap, sim );
+    } else if( sim->engine == SIMULATION_ENGINE_STRIPS ) {
+	strips_create( &sim->strips, sim );
+    }
+}
+
+
+void simulation_set_block_steps( struct simulation *sim,
+				 int block_steps )
+{
+    assert( sim != NULL );
+    assert( block_steps >= 1 );
+
+    sim->block_steps = block_steps;
+    if( sim->engine == SIMULATION_ENGINE_BLOCKED ) {
+	blocked_destroy( &sim->blocked );
+	blocked_create( &sim->blocked, sim, block_steps );
+    }
+}
+
+
+void simulation_sync( struct simulation *sim )
+{
+    assert( sim != NULL );
+
+    if( sim->engine == SIMULATION_ENGINE_SOA ) {
+	soa_store( &sim->soa, sim->termites );
+    }
 }
 
 
@@ -72,11 +356,344 @@ void simulation_step( struct simulation *sim )
 {
     assert( sim != NULL );
 
-    /* Process the termites one by one. */
-    for( int k = 0; k < sim->num_termites; ++k ) {
-	struct termite *t = &sim->termites[ k ];
-	termite_step( t );
+    if( sim->engine == SIMULATION_ENGINE_SOA ) {
+	soa_step( &sim->soa, &sim->grid, sim->seed, sim->step, &sim->counters[ 0 ],
+		  sim->clusters != NULL ? clusters_log( sim->clusters, 0 ) : NULL );
+    } else if( sim->engine == SIMULATION_ENGINE_SYNCHRONOUS ) {
+	synchronous_step( &sim->synchronous, sim->num_threads > 1 ? &sim->workers : NULL );
+    } else if( sim->engine == SIMULATION_ENGINE_ASYNCHRONOUS ) {
+	asynchronous_step( &sim->asynchronous, sim->num_threads > 1 ? &sim->workers : NULL );
+    } else if( sim->engine == SIMULATION_ENGINE_TILES ) {
+	tiles_step( &sim->tiles, sim->num_threads > 1 ? &sim->workers : NULL );
+    } else if( sim->engine == SIMULATION_ENGINE_BLOCKED ) {
+	blocked_step( &sim->blocked, sim->num_threads > 1 ? &sim->workers : NULL, 1 );
+    } else if( sim->engine == SIMULATION_ENGINE_LEAP ) {
+	leap_step( &sim->leap, 1 );
+    } else if( sim->engine == SIMULATION_ENGINE_STRIPS ) {
+	strips_step( &sim->strips, sim->num_threads > 1 ? &sim->workers : NULL );
+    } else {
+	/* Draw the turns of all termites in one go. */
+	rng_fill_turns( sim->seed, 0, sim->step, sim->num_termites, sim->turns );
+
+	/* Process the termites one by one. */
+	struct intlist *log = sim->clusters != NULL ? clusters_log( sim->clusters, 0 ) : NULL;
+	for( int k = 0; k < sim->num_termites; ++k ) {
+	    struct termite *t = &sim->termites[ k ];
+	    const unsigned events = termite_step( t, &sim->grid, sim->turns[ k ] );
+	    counters_record( &sim->counters[ 0 ], events );
+	    if( log != NULL ) {
+		clusters_record( log, &sim->grid, t, events );
+	    }
+	}
+    }
+    if( sim->clusters != NULL ) {
+	clusters_apply( sim->clusters );
+    }
+    ++sim->step;
+}
+
+
+int simulation_advance( struct simulation *sim,
+			int max_steps )
+{
+    assert( sim != NULL );
+    assert( max_steps >= 1 );
+
+    if( sim->engine != SIMULATION_ENGINE_BLOCKED && sim->engine != SIMULATION_ENGINE_LEAP ) {
+	simulation_step( sim );
+	return 1;
+    }
+
+    /* The cluster statistics only need the cells toggled an odd
+     * number of times, so one update covers the whole block.
+     */
+    const int num_steps = max_steps < sim->block_steps ? max_steps : sim->block_steps;
+    if( sim->engine == SIMULATION_ENGINE_LEAP ) {
+	leap_step( &sim->leap, num_steps );
+    } else {
+	blocked_step( &sim->blocked, sim->num_threads > 1 ? &sim->workers : NULL, num_steps );
+    }
+    if( sim->clusters != NULL ) {
+	clusters_apply( sim->clusters );
+    }
+    sim->step += num_steps;
+    return num_steps;
+}
+
+
+void simulation_reorder( struct simulation *sim )
+{
+    assert( sim != NULL );
+
+    simulation_sync( sim );
+    if( sim->num_threads > 1 ) {
+	reorder_termites( sim->termites, sim->num_termites, &sim->grid, &sim->workers );
+    } else {
+	struct workers workers;
+	workers_create( &workers, 1 );
+	reorder_termites( sim->termites, sim->num_termites, &sim->grid, &workers );
+	workers_destroy( &workers );
+    }
+    if( sim->engine == SIMULATION_ENGINE_SOA ) {
+	soa_destroy( &sim->soa );
+	soa_create( &sim->soa, sim->termites, sim->num_termites );
+    } else if( sim->engine == SIMULATION_ENGINE_STRIPS ) {
+	strips_assign( &sim->strips );
+    }
+}
+
+
+void simulation_take_counters( struct simulation *sim,
+			       struct counters *counters )
+{
+    assert( sim != NULL );
+    assert( counters != NULL );
+
+    memset( counters, 0, sizeof( struct counters ) );
+    counters_sum( counters, sim->counters, sim->num_threads );
+    memset( sim->counters, 0, sizeof( struct counters ) * sim->num_threads );
+}
+
+
+void simulation_enable_clusters( struct simulation *sim,
+				 int region_size )
+{
+    assert( sim != NULL );
+    assert( sim->clusters == NULL );
+    assert( sim->grid.layout != GRID_LAYOUT_SPARSE );
+    assert( region_size > 0 );
+
+    sim->clusters = malloc( sizeof( struct clusters ) );
+    assert( sim->clusters != NULL );
+    if( sim->num_threads > 1 ) {
+	clusters_create( sim->clusters, &sim->grid, region_size, sim->num_threads, &sim->workers );
+    } else {
+	struct workers workers;
+	workers_create( &workers, 1 );
+	clusters_create( sim->clusters, &sim->grid, region_size, 1, &workers );
+	workers_destroy( &workers );
+    }
+}
+
+
+void simulation_relabel_clusters( struct simulation *sim )
+{
+    assert( sim != NULL );
+    assert( sim->clusters != NULL );
+
+    if( sim->num_threads > 1 ) {
+	clusters_relabel( sim->clusters, &sim->workers );
+    } else {
+	struct workers workers;
+	workers_create( &workers, 1 );
+	clusters_relabel( sim->clusters, &workers );
+	workers_destroy( &workers );
+    }
+}
+
+
+/**
+ * \brief Writes a block of bytes to a file.
+ *
+ * \return True on success.
+ */
+static bool write_all( FILE *file,
+		       const void *data,
+		       size_t size )
+{
+    return size == 0 || fwrite( data, 1, size, file ) == size;
+}
+
+
+bool simulation_save( struct simulation *sim,
+		      const char *path )
+{
+    assert( sim != NULL );
+    assert( path != NULL );
+
+    if( sim->grid.layout == GRID_LAYOUT_SPARSE ) {
+	fprintf( stderr, "Snapshots of sparse grids are not supported\n" );
+	return false;
+    }
+    simulation_sync( sim );
+
+    const size_t n = sim->num_termites;
+    const size_t planes_size = 2 * sim->grid.num_words * sizeof( uint64_t );
+    struct snapshot_header header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, snapshot_magic, sizeof( header.magic ) );
+    header.version = SNAPSHOT_VERSION;
+    header.header_size = sizeof( header );
+    header.width = sim->grid.width;
+    header.height = sim->grid.height;
+    header.layout = sim->grid.layout;
+    header.num_chips = sim->num_chips;
+    header.num_termites = sim->num_termites;
+    header.seed = sim->seed;
+    header.step = sim->step;
+    header.num_words = sim->grid.num_words;
+    header.planes_offset = SNAPSHOT_ALIGNMENT;
+    header.termites_offset = header.planes_offset + planes_size;
+    header.file_size = header.termites_offset + n * (2 * sizeof( int32_t ) + sizeof( uint8_t ));
+
+    /* Pack the termites. */
+    int32_t *xs = malloc( sizeof( int32_t ) * (n + 1) );
+    int32_t *ys = malloc( sizeof( int32_t ) * (n + 1) );
+    uint8_t *states = malloc( sizeof( uint8_t ) * (n + 1) );
+    for( size_t k = 0; k < n; ++k ) {
+	int x, y;
+	termite_get_coords( &sim->termites[ k ], &x, &y );
+	xs[ k ] = x;
+	ys[ k ] = y;
+	states[ k ] = termite_get_direction( &sim->termites[ k ] )
+	    | (termite_carries_wood_chip( &sim->termites[ k ] ) ? 4 : 0);
+    }
+
+    /* Write to a temporary file and rename it when complete. */
+    const size_t path_length = strlen( path );
+    char *tmp_path = malloc( path_length + 5 );
+    memcpy( tmp_path, path, path_length );
+    memcpy( tmp_path + path_length, ".tmp", 5 );
+    static const char zeros[ SNAPSHOT_ALIGNMENT ] = { 0 };
+    bool ok = false;
+    FILE *file = fopen( tmp_path, "wb" );
+    if( file != NULL ) {
+	ok = write_all( file, &header, sizeof( header ) )
+	    && write_all( file, zeros, header.planes_offset - sizeof( header ) )
+	    && write_all( file, sim->grid.termites, planes_size / 2 )
+	    && write_all( file, sim->grid.chips, planes_size / 2 )
+	    && write_all( file, xs, sizeof( int32_t ) * n )
+	    && write_all( file, ys, sizeof( int32_t ) * n )
+	    && write_all( file, states, sizeof( uint8_t ) * n );
+	ok = (fclose( file ) == 0) && ok;
+	ok = ok && rename( tmp_path, path ) == 0;
+    }
+    if( ! ok ) {
+	fprintf( stderr, "Failed to write snapshot '%s'\n", path );
+	remove( tmp_path );
+    }
+
+    free( tmp_path );
+    free( xs );
+    free( ys );
+    free( states );
+    return ok;
+}
+
+
+/**
+ * \brief Returns true if a snapshot header is valid for a file of
+ * the given size.
+ *
+ * \param [in] header
+ *
+ * \param [in] file_size
+ *
+ * \return True if the header is valid.
+ */
+static bool check_header( const struct snapshot_header *header,
+			  size_t file_size )
+{
+    if( memcmp( header->magic, snapshot_magic, sizeof( header->magic ) ) != 0
+	|| header->version != SNAPSHOT_VERSION
+	|| header->header_size != sizeof( *header ) ) {
+	return false;
+    }
+    if( header->width <= 0 || header->height <= 0
+	|| header->num_chips <= 0 || header->num_termites <= 0
+	|| header->num_termites > INT32_MAX || header->num_chips > INT32_MAX ) {
+	return false;
+    }
+    if( header->layout != GRID_LAYOUT_GENERIC
+	&& header->layout != GRID_LAYOUT_POW2
+	&& header->layout != GRID_LAYOUT_PADDED ) {
+	return false;
+    }
+    if( header->layout == GRID_LAYOUT_POW2
+	&& ((header->width & (header->width - 1)) != 0 || (header->height & (header->height - 1)) != 0) ) {
+	return false;
+    }
+
+    /* The planes must be page aligned for the mapping, and the file
+     * must be as large as the header claims.
+     */
+    const size_t num_words = grid_plane_words( header->width, header->height, header->layout );
+    const size_t planes_size = 2 * num_words * sizeof( uint64_t );
+    const size_t termites_size = header->num_termites * (2 * sizeof( int32_t ) + sizeof( uint8_t ));
+    return header->num_words == num_words
+	&& header->planes_offset % SNAPSHOT_ALIGNMENT == 0
+	&& header->planes_offset >= sizeof( *header )
+	&& header->termites_offset == header->planes_offset + planes_size
+	&& header->file_size == header->termites_offset + termites_size
+	&& header->file_size <= file_size;
+}
+
+
+bool simulation_load( struct simulation *sim,
+		      const char *path )
+{
+    assert( sim != NULL );
+    assert( path != NULL );
+
+    /* Map the whole file. */
+    const int fd = open( path, O_RDONLY );
+    if( fd < 0 ) {
+	fprintf( stderr, "Failed to open snapshot '%s'\n", path );
+	return false;
+    }
+    struct stat st;
+    void *mapping = MAP_FAILED;
+    if( fstat( fd, &st ) == 0 && (size_t) st.st_size >= sizeof( struct snapshot_header ) ) {
+	mapping = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    }
+    close( fd );
+    if( mapping == MAP_FAILED ) {
+	fprintf( stderr, "Failed to map snapshot '%s'\n", path );
+	return false;
+    }
+    const struct snapshot_header *header = (const struct snapshot_header*) mapping;
+    if( ! check_header( header, st.st_size ) ) {
+	fprintf( stderr, "Invalid snapshot '%s'\n", path );
+	munmap( mapping, st.st_size );
+	return false;
+    }
+
+    /* The grid works directly on the planes in the mapping. */
+    char *base = (char*) mapping;
+    grid_create_on_planes( &sim->grid,
+			   header->width,
+			   header->height,
+			   header->layout,
+			   (uint64_t*) (base + header->planes_offset) );
+    sim->num_chips = header->num_chips;
+    sim->num_termites = header->num_termites;
+    sim->num_threads = 1;
+    sim->seed = header->seed;
+    sim->step = header->step;
+    sim->engine = SIMULATION_ENGINE_SCALAR;
+    sim->block_steps = 4;
+    sim->counters = counters_alloc( 1 );
+    sim->clusters = NULL;
+    sim->mapping = mapping;
+    sim->mapping_size = st.st_size;
+
+    /* Recreate the termites. */
+    const int n = sim->num_termites;
+    const int32_t *xs = (const int32_t*) (base + header->termites_offset);
+    const int32_t *ys = xs + n;
+    const uint8_t *states = (const uint8_t*) (ys + n);
+    sim->termites = malloc( sizeof( struct termite ) * n );
+    sim->turns = malloc( sizeof( uint8_t ) * n );
+    for( int k = 0; k < n; ++k ) {
+	if( xs[ k ] < 0 || xs[ k ] >= header->width || ys[ k ] < 0 || ys[ k ] >= header->height ) {
+	    fprintf( stderr, "Invalid snapshot '%s'\n", path );
+	    sim->num_termites = k;
+	    simulation_destroy( sim );
+	    return false;
+	}
+	termite_restore( &sim->termites[ k ], &sim->grid, xs[ k ], ys[ k ], states[ k ] & 3, (states[ k ] & 4) != 0 );
     }
+    return true;
 }
 
 
@@ -2,11 +2,79 @@
 
 #include "common.h"
 
+#include "asynchronous.h"
+#include "blocked.h"
+#include "clusters.h"
+#include "counters.h"
 #include "grid.h"
+#include "leap.h"
+#include "soa.h"
+#include "strips.h"
+#include "synchronous.h"
+#include "tiles.h"
 #include "termite.h"
+#include "workers.h"
 
 
 
+/**
+ * \brief The engines that can step a simulation.
+ */
+enum simulation_engine
+{
+    /**
+     * \brief Steps the termite array one termite at a time, in the
+     * order of their indices, on one thread.
+     */
+    SIMULATION_ENGINE_SCALAR = 0,
+
+    /** \brief Steps a structure of arrays in SIMD batches (see struct soa). */
+    SIMULATION_ENGINE_SOA = 1,
+
+    /**
+     * \brief Steps all termites at once against the grid at the start
+     * of the step (see struct synchronous). Unlike the other engines
+     * this changes the update rule and thus the course of the
+     * simulation.
+     */
+    SIMULATION_ENGINE_SYNCHRONOUS = 2,
+
+    /**
+     * \brief Steps disjoint ranges of termites on several threads at
+     * once on an atomically updated grid (see struct asynchronous).
+     * Not deterministic with more than one thread.
+     */
+    SIMULATION_ENGINE_ASYNCHRONOUS = 3,
+
+    /**
+     * \brief Steps the grid tile by tile on several threads, with work
+     * stealing (see struct tiles).
+     */
+    SIMULATION_ENGINE_TILES = 4,
+
+    /**
+     * \brief Follows the synchronous update rule, but synchronizes the
+     * threads only once per block of time steps (see struct blocked).
+     * The result is identical to that of the synchronous engine.
+     */
+    SIMULATION_ENGINE_BLOCKED = 5,
+
+    /**
+     * \brief Lets the termites that nothing can meet leap through
+     * several time steps at once (see struct leap). The result is
+     * identical to that of the scalar engine.
+     */
+    SIMULATION_ENGINE_LEAP = 6,
+
+    /**
+     * \brief Steps the termites strip by strip on several threads (see
+     * struct strips). The result does not depend on the number of
+     * threads, but differs from that of the scalar engine.
+     */
+    SIMULATION_ENGINE_STRIPS = 7
+};
+
+
 /**
  * \brief Represents the state of a termite simulation.
  *
@@ -30,6 +98,100 @@ struct simulation
 
     /** \brief The actual termites. */
     struct termite *termites;
+
+    /** \brief The seed of the random number generator. */
+    uint64_t seed;
+
+    /**
+     * \brief The number of time steps taken so far. Termite k draws
+     * its random numbers from stream k with the step as the counter.
+     */
+    uint64_t step;
+
+    /** \brief Buffer for the turns of one step (see rng_turn()). */
+    uint8_t *turns;
+
+    /**
+     * \brief The snapshot file mapped by simulation_load() (or NULL).
+     * The grid planes live inside the mapping.
+     */
+    void *mapping;
+
+    /** \brief The size of the mapping in bytes. */
+    size_t mapping_size;
+
+    /**
+     * \brief The number of threads stepping the simulation. The
+     * simulation is stepped sequentially if this is 1.
+     */
+    int num_threads;
+
+    /** \brief The worker threads (valid if num_threads > 1). */
+    struct workers workers;
+
+    /**
+     * \brief The decomposition of the grid into strips (valid if the
+     * engine is SIMULATION_ENGINE_STRIPS).
+     */
+    struct strips strips;
+
+    /** \brief The engine stepping the simulation. */
+    enum simulation_engine engine;
+
+    /**
+     * \brief The termites as a structure of arrays (valid if the
+     * engine is SIMULATION_ENGINE_SOA). While valid, the termite
+     * array is only brought up to date by simulation_sync().
+     */
+    struct soa soa;
+
+    /**
+     * \brief The state of the synchronous engine (valid if the engine
+     * is SIMULATION_ENGINE_SYNCHRONOUS).
+     */
+    struct synchronous synchronous;
+
+    /**
+     * \brief The state of the asynchronous engine (valid if the engine
+     * is SIMULATION_ENGINE_ASYNCHRONOUS).
+     */
+    struct asynchronous asynchronous;
+
+    /**
+     * \brief The tiles of the tile engine (valid if the engine is
+     * SIMULATION_ENGINE_TILES).
+     */
+    struct tiles tiles;
+
+    /**
+     * \brief The state of the blocked engine (valid if the engine is
+     * SIMULATION_ENGINE_BLOCKED).
+     */
+    struct blocked blocked;
+
+    /**
+     * \brief The state of the leap engine (valid if the engine is
+     * SIMULATION_ENGINE_LEAP).
+     */
+    struct leap leap;
+
+    /**
+     * \brief The maximal number of time steps the blocked and leap
+     * engines take at once (see simulation_set_block_steps()).
+     */
+    int block_steps;
+
+    /**
+     * \brief The event counters of each thread (num_threads items, see
+     * counters.h). They are only updated if COUNTERS_ENABLED.
+     */
+    struct counters *counters;
+
+    /**
+     * \brief The wood chip cluster statistics, kept up to date after
+     * every step (NULL unless enabled by simulation_enable_clusters()).
+     */
+    struct clusters *clusters;
 };
 
 
@@ -51,12 +213,55 @@ struct simulation
  * \param [in] num_chips The number of wood chips.
  *
  * \param [in] num_termites The number of termites.
+ *
+ * \param [in] seed The seed of the random number generator. Two
+ * simulations created with the same arguments evolve identically.
+ *
+ * \param [in] num_threads The number of threads used to set up the
+ * grid (which takes linear time) and to step the simulation (see
+ * simulation_set_num_threads()). The initial state does not depend
+ * on the number of threads.
  */
 void simulation_create( struct simulation *sim,
 			int width,
 			int height,
 			int num_chips,
-			int num_termites );
+			int num_termites,
+			uint64_t seed,
+			int num_threads );
+
+
+/**
+ * \brief Creates a new simulation object with the given grid layout.
+ *
+ * Same as simulation_create(), which picks the layout with
+ * grid_choose_layout().
+ *
+ * \param [in] layout The layout of the grid (see enum grid_layout).
+ */
+void simulation_create_with_layout( struct simulation *sim,
+				    int width,
+				    int height,
+				    int num_chips,
+				    int num_termites,
+				    uint64_t seed,
+				    int num_threads,
+				    enum grid_layout layout );
+
+
+/**
+ * \brief Restarts a simulation from a new random initial state.
+ *
+ * Equivalent to destroying the simulation and creating it again with
+ * the same arguments but a different seed, except that all memory is
+ * reused. The number of threads and the engine are kept.
+ *
+ * \param [in,out] sim A simulation created by simulation_create().
+ *
+ * \param [in] seed The new seed.
+ */
+void simulation_reset( struct simulation *sim,
+		       uint64_t seed );
 
 
 /**
@@ -67,6 +272,67 @@ void simulation_create( struct simulation *sim,
 void simulation_destroy( struct simulation *sim );
 
 
+/**
+ * \brief Sets the number of threads used to step the simulation.
+ *
+ * The parallel engines need a few rows of the grid per thread (see
+ * strips_max_count()), so fewer threads than requested might be used
+ * on small grids. The scalar, soa and leap engines step on one thread
+ * whatever the number.
+ *
+ * \param [in,out] sim 
+ *
+ * \param [in] num_threads The requested number of threads.
+ *
+ * \return The number of threads actually used.
+ */
+int simulation_set_num_threads( struct simulation *sim,
+				int num_threads );
+
+
+/**
+ * \brief Sets the engine used to step the simulation.
+ *
+ * The SoA and leap engines are single-threaded and ignore the number
+ * of threads. The synchronous, asynchronous, tile, blocked and leap
+ * engines do not support the sparse grid layout.
+ *
+ * \param [in,out] sim 
+ *
+ * \param [in] engine
+ */
+void simulation_set_engine( struct simulation *sim,
+			    enum simulation_engine engine );
+
+
+/**
+ * \brief Sets the maximal number of time steps the blocked and leap
+ * engines take at once (default: 4).
+ *
+ * Longer blocks synchronize the threads less often but step wider
+ * halos (see struct blocked), and let fewer termites leap further
+ * (see struct leap). The result does not depend on it.
+ *
+ * \param [in,out] sim 
+ *
+ * \param [in] block_steps The number of time steps (at least 1).
+ */
+void simulation_set_block_steps( struct simulation *sim,
+				 int block_steps );
+
+
+/**
+ * \brief Brings the termite array up to date.
+ *
+ * Engines that keep the termites in a representation of their own
+ * only copy it back to the termite array on request. Call this
+ * before reading sim->termites directly.
+ *
+ * \param [in,out] sim 
+ */
+void simulation_sync( struct simulation *sim );
+
+
 /**
  * \brief Advance the simulation one time step.
  *
@@ -75,6 +341,122 @@ void simulation_destroy( struct simulation *sim );
 void simulation_step( struct simulation *sim );
 
 
+/**
+ * \brief Advances the simulation by up to the given number of time
+ * steps.
+ *
+ * The blocked and leap engines take up to block_steps time steps at
+ * once, the other engines take one. Either way the simulation ends up in the
+ * same state as after the same number of calls to simulation_step().
+ *
+ * \param [in,out] sim 
+ *
+ * \param [in] max_steps The maximal number of time steps (at least 1).
+ *
+ * \return The number of time steps taken.
+ */
+int simulation_advance( struct simulation *sim,
+			int max_steps );
+
+
+/**
+ * \brief Sorts the termite array along a space-filling curve.
+ *
+ * The termites are sorted by the Morton keys of their cells (see
+ * reorder_termites()), so termites that are stepped one after the
+ * other are close on the grid. Termite k draws its random numbers
+ * from stream k, and the termites are stepped in the order of the
+ * array, so reordering changes the course of the simulation (like a
+ * different seed would), but it remains deterministic and does not
+ * depend on the number of threads.
+ *
+ * \param [in,out] sim
+ */
+void simulation_reorder( struct simulation *sim );
+
+
+/**
+ * \brief Returns the events counted since the last call (summed over
+ * all threads) and restarts the counting.
+ *
+ * \param [in,out] sim
+ *
+ * \param [out] counters The counts.
+ */
+void simulation_take_counters( struct simulation *sim,
+			       struct counters *counters );
+
+
+/**
+ * \brief Starts keeping the wood chip cluster statistics (see struct
+ * clusters) up to date after every step.
+ *
+ * The grid must not have the sparse layout.
+ *
+ * \param [in,out] sim
+ *
+ * \param [in] region_size The width and height of the regions whose
+ * chips are counted.
+ */
+void simulation_enable_clusters( struct simulation *sim,
+				 int region_size );
+
+
+/**
+ * \brief Labels the wood chip clusters from scratch, which undoes the
+ * drift of the incremental updates (see struct clusters).
+ *
+ * \param [in,out] sim
+ */
+void simulation_relabel_clusters( struct simulation *sim );
+
+
+/**
+ * \brief Saves the state of a simulation to a snapshot file.
+ *
+ * The snapshot holds the grid planes, the termites, the seed and the
+ * step counter, which together determine the rest of the run. The
+ * file is first written under a temporary name and then renamed, so
+ * an existing snapshot is never left half-written.
+ *
+ * Snapshot format (version 1, native byte order):
+ *
+ * - A header (see struct snapshot_header in simulation.c).
+ * - The termite plane followed by the chip plane, in the layout of
+ *   the grid, starting at a page boundary.
+ * - The x-coordinates (int32), the y-coordinates (int32) and the
+ *   states (uint8: direction in bits 0-1, carry flag in bit 2) of
+ *   the termites.
+ *
+ * \param [in,out] sim 
+ *
+ * \param [in] path The name of the snapshot file.
+ *
+ * Grids with the sparse layout cannot be saved.
+ *
+ * \return True on success, false (with a message on stderr) on failure.
+ */
+bool simulation_save( struct simulation *sim,
+		      const char *path );
+
+
+/**
+ * \brief Creates a simulation from a snapshot file.
+ *
+ * The file is mapped into memory and the grid works directly on the
+ * planes in the (private, copy-on-write) mapping, so loading does not
+ * read or parse the planes up front.
+ *
+ * \param [out] sim 
+ *
+ * \param [in] path The name of the snapshot file.
+ *
+ * \return True on success, false (with a message on stderr) on failure.
+ */
+bool simulation_load( struct simulation *sim,
+		      const char *path );
+
+
 /**
  * \brief Print the grid to stdout in ASCII form.
  *
@@ -0,0 +1,408 @@
+#include "soa.h"
+
+#include "rng.h"
+#include "termite.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+
+/** \brief Bit 2 of the state is the carry flag. */
+#define SOA_CARRY 4
+
+
+void soa_create( struct soa *soa,
+		 const struct termite *termites,
+		 const int count )
+{
+    assert( soa != NULL );
+    assert( termites != NULL );
+    assert( count >= 0 );
+
+    soa->count = count;
+    soa->x = malloc( sizeof( int32_t ) * count );
+    soa->y = malloc( sizeof( int32_t ) * count );
+    soa->state = malloc( sizeof( uint8_t ) * count );
+    soa->turns = malloc( sizeof( uint8_t ) * count );
+    for( int k = 0; k < count; ++k ) {
+	int x, y;
+	termite_get_coords( &termites[ k ], &x, &y );
+	soa->x[ k ] = x;
+	soa->y[ k ] = y;
+	soa->state[ k ] = termite_get_direction( &termites[ k ] )
+	    | (termite_carries_wood_chip( &termites[ k ] ) ? SOA_CARRY : 0);
+    }
+}
+
+
+void soa_destroy( struct soa *soa )
+{
+    assert( soa != NULL );
+
+    free( soa->x );
+    free( soa->y );
+    free( soa->state );
+    free( soa->turns );
+    soa->x = NULL;
+    soa->y = NULL;
+    soa->state = NULL;
+    soa->turns = NULL;
+    soa->count = 0;
+}
+
+
+void soa_store( const struct soa *soa,
+		struct termite *termites )
+{
+    assert( soa != NULL );
+    assert( termites != NULL );
+
+    for( int k = 0; k < soa->count; ++k ) {
+	termite_set_state( &termites[ k ],
+			   soa->x[ k ],
+			   soa->y[ k ],
+			   soa->state[ k ] & 3,
+			   (soa->state[ k ] & SOA_CARRY) != 0 );
+    }
+}
+
+
+/**
+ * \brief Advances termite k one time step (scalar code).
+ *
+ * Implements the same rules as termite_step().
+ *
+ * \param [in,out] soa
+ *
+ * \param [in,out] grid
+ *
+ * \param [in] k The index of the termite.
+ *
+ * \return The events of the step (see termite_step()).
+ */
+static unsigned soa_step_one( struct soa *soa,
+			      struct grid *grid,
+			      int k )
+{
+    const int x = soa->x[ k ];
+    const int y = soa->y[ k ];
+    enum direction direction = (soa->state[ k ] + soa->turns[ k ]) & 3;
+    bool carries_chip = (soa->state[ k ] & SOA_CARRY) != 0;
+    unsigned events = soa->turns[ k ] != 0 ? COUNTERS_TURN : 0;
+
+    int ax, ay;
+    grid_get_coords_in_direction( grid, x, y, &ax, &ay, direction );
+    if( carries_chip && grid_has_wood_chip_at( grid, ax, ay ) ) {
+	/* Drop chip. */
+	grid_place_wood_chip_at( grid, x, y );
+	carries_chip = false;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_DROP;
+    } else if( ! carries_chip && grid_has_wood_chip_at( grid, x, y ) ) {
+	/* Pick up chip. */
+	grid_remove_wood_chip_at( grid, x, y );
+	carries_chip = true;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_PICKUP;
+    }
+
+    /* Move forward. */
+    grid_get_coords_in_direction( grid, x, y, &ax, &ay, direction );
+    if( grid_has_termite_at( grid, ax, ay ) ) {
+	events |= COUNTERS_BLOCKED_BY_TERMITE;
+    } else if( carries_chip && grid_has_wood_chip_at( grid, ax, ay ) ) {
+	events |= COUNTERS_BLOCKED_BY_CHIP;
+    } else {
+	grid_remove_termite_at( grid, x, y );
+	grid_place_termite_at( grid, ax, ay );
+	soa->x[ k ] = ax;
+	soa->y[ k ] = ay;
+	events |= COUNTERS_MOVE;
+    }
+    soa->state[ k ] = direction | (carries_chip ? SOA_CARRY : 0);
+    return events;
+}
+
+
+/**
+ * \brief Advances termite k one time step (scalar code) and records
+ * its events.
+ */
+static inline void step_one( struct soa *soa,
+			     struct grid *grid,
+			     int k,
+			     struct counters *counters,
+			     struct intlist *log )
+{
+    const int x = soa->x[ k ];
+    const int y = soa->y[ k ];
+    const unsigned events = soa_step_one( soa, grid, k );
+    counters_record( counters, events );
+    if( log != NULL && (events & (COUNTERS_PICKUP | COUNTERS_DROP)) ) {
+	intlist_push( log, x );
+	intlist_push( log, y );
+    }
+}
+
+
+#ifdef __AVX2__
+
+/**
+ * \brief Returns true if (x, y) lies on the boundary of the grid.
+ */
+static inline bool on_boundary( const struct grid *grid,
+				int x,
+				int y )
+{
+    return x == 0 || y == 0 || x == grid->width - 1 || y == grid->height - 1;
+}
+
+
+/**
+ * \brief Wraps eight coordinates into the range 0 to n-1 (the
+ * coordinates must lie in the range -1 to n).
+ */
+static inline __m256i wrap8( __m256i v,
+			     __m256i n )
+{
+    const __m256i n_minus_one = _mm256_sub_epi32( n, _mm256_set1_epi32( 1 ) );
+    v = _mm256_add_epi32( v, _mm256_and_si256( _mm256_cmpgt_epi32( _mm256_setzero_si256( ), v ), n ) );
+    v = _mm256_sub_epi32( v, _mm256_and_si256( _mm256_cmpgt_epi32( v, n_minus_one ), n ) );
+    return v;
+}
+
+
+/**
+ * \brief Returns the periodic distance between eight pairs of
+ * coordinates in the range 0 to n-1.
+ */
+static inline __m256i distance8( __m256i a,
+				 __m256i b,
+				 __m256i n )
+{
+    const __m256i d = _mm256_abs_epi32( _mm256_sub_epi32( a, b ) );
+    return _mm256_min_epi32( d, _mm256_sub_epi32( n, d ) );
+}
+
+
+/**
+ * \brief Returns the bits of eight cells (0 or 1 per lane) of a plane.
+ *
+ * The plane is read as 32-bit words, which on a little-endian machine
+ * holds the same bits in the same order as the 64-bit words.
+ */
+static inline __m256i gather8( const uint64_t *plane,
+			       __m256i k )
+{
+    const __m256i words = _mm256_i32gather_epi32( (const int*) plane, _mm256_srli_epi32( k, 5 ), 4 );
+    const __m256i bits = _mm256_srlv_epi32( words, _mm256_and_si256( k, _mm256_set1_epi32( 31 ) ) );
+    return _mm256_and_si256( bits, _mm256_set1_epi32( 1 ) );
+}
+
+
+/**
+ * \brief Returns the number of lanes set in a mask of eight lanes.
+ */
+static inline int count8( __m256i mask )
+{
+    return __builtin_popcount( _mm256_movemask_ps( _mm256_castsi256_ps( mask ) ) );
+}
+
+
+/**
+ * \brief Advances termites k to k+7 one time step (vector code).
+ *
+ * \param [in,out] soa
+ *
+ * \param [in,out] grid
+ *
+ * \param [in] k The index of the first termite.
+ *
+ * \param [in,out] counters The counters to record the events in.
+ *
+ * \param [in,out] log The log of pick ups and drops, or NULL.
+ *
+ * \return False (without changing anything) if two termites of the
+ * batch are too close to each other to be stepped at once.
+ */
+static bool soa_step_batch( struct soa *soa,
+			    struct grid *grid,
+			    int k,
+			    struct counters *counters,
+			    struct intlist *log )
+{
+    const __m256i zero = _mm256_setzero_si256( );
+    const __m256i one = _mm256_set1_epi32( 1 );
+    const __m256i three = _mm256_set1_epi32( 3 );
+    const __m256i width = _mm256_set1_epi32( grid->width );
+    const __m256i height = _mm256_set1_epi32( grid->height );
+    const __m256i stride = _mm256_set1_epi32( grid->stride );
+    const __m256i origin = _mm256_set1_epi32( (int32_t) grid->origin );
+
+    const __m256i x = _mm256_loadu_si256( (const __m256i*) &soa->x[ k ] );
+    const __m256i y = _mm256_loadu_si256( (const __m256i*) &soa->y[ k ] );
+
+    /* Look for pairs within distance two. Comparing each lane with
+     * the lanes one to four positions further on (cyclically) covers
+     * every pair.
+     */
+    __m256i close = zero;
+    for( int r = 1; r <= 4; ++r ) {
+	const __m256i rotate = _mm256_setr_epi32( r & 7, (r + 1) & 7, (r + 2) & 7, (r + 3) & 7,
+						  (r + 4) & 7, (r + 5) & 7, (r + 6) & 7, (r + 7) & 7 );
+	const __m256i dx = distance8( x, _mm256_permutevar8x32_epi32( x, rotate ), width );
+	const __m256i dy = distance8( y, _mm256_permutevar8x32_epi32( y, rotate ), height );
+	close = _mm256_or_si256( close, _mm256_and_si256( _mm256_cmpgt_epi32( three, dx ),
+							  _mm256_cmpgt_epi32( three, dy ) ) );
+    }
+    if( ! _mm256_testz_si256( close, close ) ) {
+	return false;
+    }
+
+    /* Unpack the state and apply the turn. */
+    const __m256i state = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*) &soa->state[ k ] ) );
+    const __m256i turn = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*) &soa->turns[ k ] ) );
+    const __m256i direction = _mm256_and_si256( _mm256_add_epi32( state, turn ), three );
+    const __m256i carry = _mm256_and_si256( _mm256_srli_epi32( state, 2 ), one );
+
+    /* The cells ahead (a) and behind (b). */
+    const __m256i step_x = _mm256_permutevar8x32_epi32( _mm256_setr_epi32( 0, 1, 0, -1, 0, 1, 0, -1 ), direction );
+    const __m256i step_y = _mm256_permutevar8x32_epi32( _mm256_setr_epi32( -1, 0, 1, 0, -1, 0, 1, 0 ), direction );
+    const __m256i ax = wrap8( _mm256_add_epi32( x, step_x ), width );
+    const __m256i ay = wrap8( _mm256_add_epi32( y, step_y ), height );
+    const __m256i bx = wrap8( _mm256_sub_epi32( x, step_x ), width );
+    const __m256i by = wrap8( _mm256_sub_epi32( y, step_y ), height );
+    const __m256i here = _mm256_add_epi32( origin, _mm256_add_epi32( _mm256_mullo_epi32( y, stride ), x ) );
+    const __m256i ahead = _mm256_add_epi32( origin, _mm256_add_epi32( _mm256_mullo_epi32( ay, stride ), ax ) );
+    const __m256i behind = _mm256_add_epi32( origin, _mm256_add_epi32( _mm256_mullo_epi32( by, stride ), bx ) );
+
+    /* Gather the occupancy. */
+    const __m256i chip_here = gather8( grid->chips, here );
+    const __m256i chip_ahead = gather8( grid->chips, ahead );
+    const __m256i chip_behind = gather8( grid->chips, behind );
+    const __m256i termite_ahead = gather8( grid->termites, ahead );
+    const __m256i termite_behind = gather8( grid->termites, behind );
+
+    /* Drop or pick up a chip and turn around (all masks are 0 or 1). */
+    const __m256i drop = _mm256_and_si256( carry, chip_ahead );
+    const __m256i pick = _mm256_andnot_si256( carry, chip_here );
+    const __m256i flip = _mm256_or_si256( drop, pick );
+    const __m256i new_carry = _mm256_xor_si256( carry, flip );
+    const __m256i new_direction = _mm256_xor_si256( direction, _mm256_slli_epi32( flip, 1 ) );
+
+    /* Move forward, to the cell behind if the termite turned around. */
+    const __m256i flip_mask = _mm256_cmpeq_epi32( flip, one );
+    const __m256i target = _mm256_blendv_epi8( ahead, behind, flip_mask );
+    const __m256i tx = _mm256_blendv_epi8( ax, bx, flip_mask );
+    const __m256i ty = _mm256_blendv_epi8( ay, by, flip_mask );
+    const __m256i chip_target = _mm256_blendv_epi8( chip_ahead, chip_behind, flip_mask );
+    const __m256i termite_target = _mm256_blendv_epi8( termite_ahead, termite_behind, flip_mask );
+    const __m256i blocked = _mm256_or_si256( termite_target, _mm256_and_si256( new_carry, chip_target ) );
+    const __m256i move = _mm256_xor_si256( blocked, one );
+    const __m256i move_mask = _mm256_cmpeq_epi32( move, one );
+
+    _mm256_storeu_si256( (__m256i*) &soa->x[ k ], _mm256_blendv_epi8( x, tx, move_mask ) );
+    _mm256_storeu_si256( (__m256i*) &soa->y[ k ], _mm256_blendv_epi8( y, ty, move_mask ) );
+    const __m256i new_state = _mm256_or_si256( new_direction, _mm256_slli_epi32( new_carry, 2 ) );
+    const __m128i packed16 = _mm_packus_epi32( _mm256_castsi256_si128( new_state ),
+					       _mm256_extracti128_si256( new_state, 1 ) );
+    _mm_storel_epi64( (__m128i*) &soa->state[ k ], _mm_packus_epi16( packed16, packed16 ) );
+
+#if COUNTERS_ENABLED
+    counters_add( counters, COUNTERS_TURN, 8 - count8( _mm256_cmpeq_epi32( turn, zero ) ) );
+    counters_add( counters, COUNTERS_MOVE, count8( move_mask ) );
+    counters_add( counters, COUNTERS_BLOCKED_BY_TERMITE, count8( _mm256_cmpeq_epi32( termite_target, one ) ) );
+    counters_add( counters, COUNTERS_BLOCKED_BY_CHIP,
+		  count8( _mm256_cmpeq_epi32( _mm256_andnot_si256( termite_target, blocked ), one ) ) );
+    counters_add( counters, COUNTERS_PICKUP, count8( _mm256_cmpeq_epi32( pick, one ) ) );
+    counters_add( counters, COUNTERS_DROP, count8( _mm256_cmpeq_epi32( drop, one ) ) );
+#else
+    (void) counters;
+#endif
+
+    /* Write the grid. A drop sets the chip bit of the own cell and a
+     * pick up clears it, so both are a toggle. A move toggles the
+     * termite bits of the own cell and of the target cell.
+     */
+    int32_t here_k[ 8 ], target_k[ 8 ], flip_k[ 8 ], move_k[ 8 ];
+    _mm256_storeu_si256( (__m256i*) here_k, here );
+    _mm256_storeu_si256( (__m256i*) target_k, target );
+    _mm256_storeu_si256( (__m256i*) flip_k, flip );
+    _mm256_storeu_si256( (__m256i*) move_k, move );
+    for( int lane = 0; lane < 8; ++lane ) {
+	const uint32_t h = here_k[ lane ];
+	const uint32_t t = target_k[ lane ];
+	grid->chips[ h >> 6 ] ^= (uint64_t) flip_k[ lane ] << (h & 63);
+	grid->termites[ h >> 6 ] ^= (uint64_t) move_k[ lane ] << (h & 63);
+	grid->termites[ t >> 6 ] ^= (uint64_t) move_k[ lane ] << (t & 63);
+    }
+
+    /* Log the cells of the pick ups and drops. */
+    if( log != NULL && ! _mm256_testz_si256( flip, flip ) ) {
+	int32_t flip_x[ 8 ], flip_y[ 8 ];
+	_mm256_storeu_si256( (__m256i*) flip_x, x );
+	_mm256_storeu_si256( (__m256i*) flip_y, y );
+	for( int lane = 0; lane < 8; ++lane ) {
+	    if( flip_k[ lane ] ) {
+		intlist_push( log, flip_x[ lane ] );
+		intlist_push( log, flip_y[ lane ] );
+	    }
+	}
+    }
+
+    /* Boundary cells of the padded layout have ghost copies. */
+    if( grid->layout == GRID_LAYOUT_PADDED ) {
+	int32_t old_x[ 8 ], old_y[ 8 ], target_x[ 8 ], target_y[ 8 ];
+	_mm256_storeu_si256( (__m256i*) old_x, x );
+	_mm256_storeu_si256( (__m256i*) old_y, y );
+	_mm256_storeu_si256( (__m256i*) target_x, tx );
+	_mm256_storeu_si256( (__m256i*) target_y, ty );
+	for( int lane = 0; lane < 8; ++lane ) {
+	    if( (flip_k[ lane ] | move_k[ lane ]) && on_boundary( grid, old_x[ lane ], old_y[ lane ] ) ) {
+		grid_update_ghosts( grid, old_x[ lane ], old_y[ lane ] );
+	    }
+	    if( move_k[ lane ] && on_boundary( grid, target_x[ lane ], target_y[ lane ] ) ) {
+		grid_update_ghosts( grid, target_x[ lane ], target_y[ lane ] );
+	    }
+	}
+    }
+    return true;
+}
+
+#endif
+
+
+void soa_step( struct soa *soa,
+	       struct grid *grid,
+	       const uint64_t seed,
+	       const uint64_t step,
+	       struct counters *counters,
+	       struct intlist *log )
+{
+    assert( soa != NULL );
+    assert( grid != NULL );
+    assert( counters != NULL );
+
+    /* Decide all turns up front. */
+    rng_fill_turns( seed, 0, step, soa->count, soa->turns );
+
+    int k = 0;
+#ifdef __AVX2__
+    /* The vector code reads the planes and computes cell indices in
+     * 32-bit lanes.
+     */
+    if( grid->layout != GRID_LAYOUT_SPARSE && grid->num_words * 64 < (UINT64_C( 1 ) << 31) ) {
+	for( ; k + 8 <= soa->count; k += 8 ) {
+	    if( ! soa_step_batch( soa, grid, k, counters, log ) ) {
+		for( int lane = 0; lane < 8; ++lane ) {
+		    step_one( soa, grid, k + lane, counters, log );
+		}
+	    }
+	}
+    }
+#endif
+    for( ; k < soa->count; ++k ) {
+	step_one( soa, grid, k, counters, log );
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common.h"
+
+#include "counters.h"
+#include "grid.h"
+#include "intlist.h"
+
+
+/**
+ * \brief Represents the termites of a simulation as a structure of
+ * arrays.
+ *
+ * Termite k is at (x[ k ], y[ k ]). Bits 0-1 of state[ k ] hold its
+ * direction and bit 2 is set if it carries a wood chip.
+ *
+ * Batch stepping.
+ *
+ * When compiled with AVX2 support, the termites are stepped in
+ * batches of eight. The cells ahead and behind are computed, the
+ * grid planes are read with gather instructions, and the turn, drop,
+ * pick up and move decisions are evaluated in vector registers
+ * without branches. A termite only reads and writes cells within
+ * distance one of its own cell, so if no two termites of a batch are
+ * within distance two of each other the batch can be evaluated at
+ * once with the same result as stepping the termites one by one.
+ * Batches that contain closer pairs are stepped one by one by the
+ * scalar code instead. Either way the result is identical to that of
+ * simulation_step() with the scalar engine.
+ */
+struct soa
+{
+    /** \brief The number of termites. */
+    int count;
+
+    /** \brief The x-coordinates. */
+    int32_t *x;
+
+    /** \brief The y-coordinates. */
+    int32_t *y;
+
+    /** \brief The packed direction and carry flag. */
+    uint8_t *state;
+
+    /**
+     * \brief Buffer for the turns of one step (0 = straight, 1 =
+     * right, 3 = left; the amount added to the direction).
+     */
+    uint8_t *turns;
+};
+
+
+/**
+ * \brief Creates the structure of arrays for the termites of a simulation.
+ *
+ * \param [out] soa
+ *
+ * \param [in] termites The termites.
+ *
+ * \param [in] count The number of termites.
+ */
+void soa_create( struct soa *soa,
+		 const struct termite *termites,
+		 int count );
+
+
+/**
+ * \brief Destroys the structure of arrays, releasing all resources.
+ *
+ * \param [in,out] soa
+ */
+void soa_destroy( struct soa *soa );
+
+
+/**
+ * \brief Copies the state of the termites back into the termite array.
+ *
+ * \param [in] soa
+ *
+ * \param [in,out] termites The termites passed to soa_create().
+ */
+void soa_store( const struct soa *soa,
+		struct termite *termites );
+
+
+/**
+ * \brief Advances all termites one time step.
+ *
+ * \param [in,out] soa
+ *
+ * \param [in,out] grid The grid in which the termites wander.
+ *
+ * \param [in] seed The seed of the random number generator.
+ *
+ * \param [in] step The time step.
+ *
+ * \param [in,out] counters The counters to record the events in.
+ *
+ * \param [in,out] log The log to record the cells of pick ups and
+ * drops in (see clusters_record()), or NULL.
+ */
+void soa_step( struct soa *soa,
+	       struct grid *grid,
+	       uint64_t seed,
+	       uint64_t step,
+	       struct counters *counters,
+	       struct intlist *log );
@@ -0,0 +1,328 @@
+#include "strips.h"
+
+#include "simulation.h"
+
+
+/**
+ * \brief Returns the minimum number of rows in each half of a strip.
+ *
+ * The termites of one half touch the rows from the one above the
+ * half to the one below it. The rows touched by two halves stepped
+ * at the same time must be at least 64 bits apart in the grid planes
+ * so that they never share a word.
+ *
+ * \param [in] width The width of the grid.
+ *
+ * \return The minimum number of rows.
+ */
+static int min_half_rows( int width )
+{
+    return 2 + (63 + width - 1) / width;
+}
+
+
+/**
+ * \brief Returns the row of a termite.
+ */
+static inline int termite_row( const struct termite *term )
+{
+    int x, y;
+    termite_get_coords( term, &x, &y );
+    return y;
+}
+
+
+int strips_max_count( const struct simulation *sim )
+{
+    assert( sim != NULL );
+
+    /* The chunks of a sparse grid are created and released on the
+     * fly, which cannot be done by several workers at once.
+     */
+    if( sim->grid.layout == GRID_LAYOUT_SPARSE ) {
+	return 1;
+    }
+
+    int width, height;
+    grid_get_size( &sim->grid, &width, &height );
+    return height / (2 * min_half_rows( width ));
+}
+
+
+void strips_create( struct strips *strips,
+		    struct simulation *sim )
+{
+    assert( strips != NULL );
+    assert( sim != NULL );
+
+    int width, height;
+    grid_get_size( &sim->grid, &width, &height );
+    const int num_strips = strips_max_count( sim ) > 1 ? strips_max_count( sim ) : 1;
+
+    strips->sim = sim;
+    strips->num_strips = num_strips;
+    strips->strip = malloc( sizeof( struct strip ) * num_strips );
+    assert( strips->strip != NULL );
+    for( int s = 0; s < num_strips; ++s ) {
+	struct strip *strip = &strips->strip[ s ];
+	strip->row_begin = (int) ((int64_t) s * height / num_strips);
+	strip->row_end = (int) ((int64_t) (s + 1) * height / num_strips);
+	strip->row_split = (strip->row_begin + strip->row_end) / 2;
+	strip->num_top = 0;
+	intlist_create( &strip->members );
+	intlist_create( &strip->order );
+	intlist_create( &strip->outbox[ 0 ] );
+	intlist_create( &strip->outbox[ 1 ] );
+    }
+    strips_assign( strips );
+    workers_create( &strips->single, 1 );
+}
+
+
+void strips_destroy( struct strips *strips )
+{
+    assert( strips != NULL );
+
+    for( int s = 0; s < strips->num_strips; ++s ) {
+	struct strip *strip = &strips->strip[ s ];
+	intlist_destroy( &strip->members );
+	intlist_destroy( &strip->order );
+	intlist_destroy( &strip->outbox[ 0 ] );
+	intlist_destroy( &strip->outbox[ 1 ] );
+    }
+    free( strips->strip );
+    strips->strip = NULL;
+    strips->num_strips = 0;
+    workers_destroy( &strips->single );
+}
+
+
+void strips_assign( struct strips *strips )
+{
+    assert( strips != NULL );
+
+    const struct simulation *sim = strips->sim;
+    for( int s = 0; s < strips->num_strips; ++s ) {
+	intlist_clear( &strips->strip[ s ].members );
+    }
+
+    /* The strips are sorted by row, so a binary search finds the
+     * strip holding a given row.
+     */
+    for( int k = 0; k < sim->num_termites; ++k ) {
+	const int y = termite_row( &sim->termites[ k ] );
+	int lo = 0, hi = strips->num_strips - 1;
+	while( lo < hi ) {
+	    const int mid = (lo + hi + 1) / 2;
+	    if( strips->strip[ mid ].row_begin <= y ) {
+		lo = mid;
+	    } else {
+		hi = mid - 1;
+	    }
+	}
+	intlist_push( &strips->strip[ lo ].members, k );
+    }
+}
+
+
+/**
+ * \brief Merges three sorted lists into one sorted list.
+ *
+ * \param [out] out
+ *
+ * \param [in] a
+ *
+ * \param [in] b
+ *
+ * \param [in] c
+ */
+static void merge( struct intlist *out,
+		   const struct intlist *a,
+		   const struct intlist *b,
+		   const struct intlist *c )
+{
+    int i = 0, j = 0, k = 0;
+    intlist_clear( out );
+    while( i < a->count || j < b->count || k < c->count ) {
+	const int va = i < a->count ? a->items[ i ] : INT_MAX;
+	const int vb = j < b->count ? b->items[ j ] : INT_MAX;
+	const int vc = k < c->count ? c->items[ k ] : INT_MAX;
+	if( va <= vb && va <= vc ) {
+	    intlist_push( out, va );
+	    ++i;
+	} else if( vb <= vc ) {
+	    intlist_push( out, vb );
+	    ++j;
+	} else {
+	    intlist_push( out, vc );
+	    ++k;
+	}
+    }
+}
+
+
+/**
+ * \brief Context for strips_task().
+ */
+struct strips_context
+{
+    /** \brief The decomposition being stepped. */
+    struct strips *strips;
+
+    /** \brief The team of workers. */
+    struct workers *workers;
+};
+
+
+/**
+ * \brief Steps the termites of one half of a strip.
+ *
+ * \param [in,out] strips
+ *
+ * \param [in] strip The strip.
+ *
+ * \param [in] begin The first item of strip->order to step.
+ *
+ * \param [in] end One past the last item of strip->order to step.
+ *
+ * \param [in] worker The index of the worker.
+ */
+static void step_half( struct strips *strips,
+		       const struct strip *strip,
+		       const int begin,
+		       const int end,
+		       const int worker )
+{
+    struct termite *termites = strips->sim->termites;
+    struct grid *grid = &strips->sim->grid;
+    const uint64_t seed = strips->sim->seed;
+    const uint64_t step = strips->sim->step;
+    struct counters *counters = &strips->sim->counters[ worker ];
+    struct intlist *log = strips->sim->clusters != NULL ? clusters_log( strips->sim->clusters, worker ) : NULL;
+
+    for( int k = begin; k < end; ++k ) {
+	const int t = strip->order.items[ k ];
+	const unsigned events = termite_step( &termites[ t ], grid, rng_turn( rng_draw( seed, t, step ) ) );
+	counters_record( counters, events );
+	if( log != NULL ) {
+	    clusters_record( log, grid, &termites[ t ], events );
+	}
+    }
+}
+
+
+/**
+ * \brief Steps the termites of a contiguous range of strips (one range
+ * per worker).
+ *
+ * \param [in,out] arg The strips_context.
+ *
+ * \param [in] worker The index of the worker.
+ *
+ * \param [in] num_workers The number of workers.
+ */
+static void strips_task( void *arg,
+			 int worker,
+			 int num_workers )
+{
+    struct strips_context *ctx = (struct strips_context*) arg;
+    struct strips *strips = ctx->strips;
+    const struct termite *termites = strips->sim->termites;
+    const int num_strips = strips->num_strips;
+    const int first = (int) ((int64_t) num_strips * worker / num_workers);
+    const int last = (int) ((int64_t) num_strips * (worker + 1) / num_workers);
+
+    /* Order the members by half. Membership is decided up front so
+     * that a termite moving from the top half into the bottom half is
+     * not stepped twice. Every member is written to the next slot of
+     * its half, which is only kept if the termite is in that half, so
+     * the loops do not branch on the random half of each termite.
+     */
+    for( int s = first; s < last; ++s ) {
+	struct strip *strip = &strips->strip[ s ];
+	const int count = strip->members.count;
+	intlist_resize( &strip->order, count + 1 );
+	int *order = strip->order.items;
+	int top = 0;
+	for( int k = 0; k < count; ++k ) {
+	    const int t = strip->members.items[ k ];
+	    order[ top ] = t;
+	    top += termite_row( &termites[ t ] ) < strip->row_split;
+	}
+	int bottom = top;
+	for( int k = 0; k < count; ++k ) {
+	    const int t = strip->members.items[ k ];
+	    order[ bottom ] = t;
+	    bottom += termite_row( &termites[ t ] ) >= strip->row_split;
+	}
+	strip->num_top = top;
+	intlist_resize( &strip->order, count );
+    }
+
+    /* Phase 1: the top halves. */
+    for( int s = first; s < last; ++s ) {
+	step_half( strips, &strips->strip[ s ], 0, strips->strip[ s ].num_top, worker );
+    }
+    workers_barrier( ctx->workers );
+
+    /* Phase 2: the bottom halves. */
+    for( int s = first; s < last; ++s ) {
+	step_half( strips, &strips->strip[ s ], strips->strip[ s ].num_top, strips->strip[ s ].order.count, worker );
+    }
+
+    /* Hand over termites that left a strip. A termite moves at most
+     * one row per step, so it can only have entered the previous or
+     * the next strip. The members are kept sorted by index (which
+     * makes the stepping order independent of the history of
+     * hand-overs), so the lists built here are sorted as well.
+     */
+    for( int s = first; s < last; ++s ) {
+	struct strip *strip = &strips->strip[ s ];
+	intlist_clear( &strip->outbox[ 0 ] );
+	intlist_clear( &strip->outbox[ 1 ] );
+	intlist_clear( &strip->order );
+	for( int k = 0; k < strip->members.count; ++k ) {
+	    const int t = strip->members.items[ k ];
+	    const int y = termite_row( &termites[ t ] );
+	    if( y < strip->row_begin || y >= strip->row_end ) {
+		/* Rows just above the strip (including the wrap from
+		 * the first row to the last) go north.
+		 */
+		const bool north = (y == strip->row_begin - 1) || (strip->row_begin == 0 && y > strip->row_end);
+		intlist_push( &strip->outbox[ north ? 0 : 1 ], t );
+	    } else {
+		intlist_push( &strip->order, t );
+	    }
+	}
+    }
+    workers_barrier( ctx->workers );
+
+    /* Collect the termites handed over by the neighbors. */
+    for( int s = first; s < last; ++s ) {
+	struct strip *strip = &strips->strip[ s ];
+	const struct strip *prev = &strips->strip[ (s + num_strips - 1) % num_strips ];
+	const struct strip *next = &strips->strip[ (s + 1) % num_strips ];
+	if( prev->outbox[ 1 ].count == 0 && next->outbox[ 0 ].count == 0 ) {
+	    const struct intlist staying = strip->order;
+	    strip->order = strip->members;
+	    strip->members = staying;
+	} else {
+	    merge( &strip->members, &strip->order, &prev->outbox[ 1 ], &next->outbox[ 0 ] );
+	}
+    }
+}
+
+
+void strips_step( struct strips *strips,
+		  struct workers *workers )
+{
+    assert( strips != NULL );
+
+    if( workers == NULL ) {
+	workers = &strips->single;
+    }
+    assert( workers->num_workers <= strips->num_strips );
+
+    struct strips_context ctx = { strips, workers };
+    workers_run( workers, strips_task, &ctx );
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "common.h"
+
+#include "intlist.h"
+#include "workers.h"
+
+
+/**
+ * \brief Represents one horizontal strip of the grid.
+ *
+ * A strip owns the rows row_begin to row_end-1 and the termites
+ * located in those rows. The strip is split into a top half (rows
+ * row_begin to row_split-1) and a bottom half (rows row_split to
+ * row_end-1) which are stepped in two separate phases.
+ */
+struct strip
+{
+    /** \brief The first row of the strip. */
+    int row_begin;
+
+    /** \brief The first row of the bottom half. */
+    int row_split;
+
+    /** \brief One past the last row of the strip. */
+    int row_end;
+
+    /** \brief The termites (indices into sim->termites) in the strip. */
+    struct intlist members;
+
+    /**
+     * \brief The members in the order they are stepped: the first
+     * num_top items are in the top half at the start of the step.
+     */
+    struct intlist order;
+
+    /** \brief The number of members in the top half. */
+    int num_top;
+
+    /**
+     * \brief Termites leaving the strip. outbox[ 0 ] holds termites
+     * moving to the previous (northern) strip and outbox[ 1 ] holds
+     * termites moving to the next (southern) strip.
+     */
+    struct intlist outbox[ 2 ];
+};
+
+
+/**
+ * \brief Represents a decomposition of the grid into horizontal
+ * strips, stepped by a team of workers.
+ *
+ * Parallel stepping.
+ *
+ * A termite reads and writes only its own row and the two adjacent
+ * rows. During the first phase of a step every worker steps the
+ * termites in the top halves of its strips, and during the second
+ * phase those in the bottom halves. The halves are tall enough that
+ * the rows touched by two workers in the same phase never share a
+ * 64-bit word of the grid planes, so no two workers ever race on a
+ * cell, a termite never moves into a cell another worker is filling,
+ * and no chip is lost. Termites that cross a strip boundary are
+ * handed over to the neighboring strip at the end of the step.
+ *
+ * Determinism.
+ *
+ * The grid is always divided into as many strips as it can hold
+ * (strips_max_count()), and every worker steps a contiguous range of
+ * them. The halves of one phase do not interact, and every half steps
+ * the termites it holds at the start of the step in the order of
+ * their indices, so the result does not depend on the number of
+ * workers. It differs from that of the scalar engine, which steps all
+ * termites in the order of their indices.
+ */
+struct strips
+{
+    /** \brief The simulation being stepped. */
+    struct simulation *sim;
+
+    /** \brief The number of strips. */
+    int num_strips;
+
+    /** \brief The strips. */
+    struct strip *strip;
+
+    /** \brief A team of one worker, used if no team is passed. */
+    struct workers single;
+};
+
+
+/**
+ * \brief Returns the largest number of strips that the grid of the
+ * simulation can be divided into, which is also the largest number of
+ * workers that can step it.
+ *
+ * \param [in] sim
+ *
+ * \return The maximum number of strips (might be 0 or 1 for small grids).
+ */
+int strips_max_count( const struct simulation *sim );
+
+
+/**
+ * \brief Decomposes the grid of a simulation into strips, as many as
+ * strips_max_count() (but at least one).
+ *
+ * \param [out] strips
+ *
+ * \param [in,out] sim The simulation.
+ */
+void strips_create( struct strips *strips,
+		    struct simulation *sim );
+
+
+/**
+ * \brief Destroys a decomposition, releasing all resources.
+ *
+ * \param [in,out] strips
+ */
+void strips_destroy( struct strips *strips );
+
+
+/**
+ * \brief Reassigns all termites to the strips holding them.
+ *
+ * Must be called if the termite array of the simulation has been
+ * rearranged.
+ *
+ * \param [in,out] strips
+ */
+void strips_assign( struct strips *strips );
+
+
+/**
+ * \brief Advance the simulation one time step.
+ *
+ * \param [in,out] strips
+ *
+ * \param [in,out] workers A team of at most strips->num_strips
+ * workers, or NULL to step on the calling thread.
+ */
+void strips_step( struct strips *strips,
+		  struct workers *workers );
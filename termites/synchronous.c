@@ -0,0 +1,335 @@
+#include "synchronous.h"
+
+#include "simulation.h"
+
+
+/**
+ * \brief The context of a synchronous step shared by all workers.
+ */
+struct synchronous_context
+{
+    /** \brief The engine. */
+    struct synchronous *sync;
+
+    /** \brief The team stepping the simulation. */
+    struct workers *workers;
+
+    /** \brief The key of the priorities of the step. */
+    uint64_t priority_key;
+};
+
+
+void synchronous_create( struct synchronous *sync,
+			 struct simulation *sim )
+{
+    assert( sync != NULL );
+    assert( sim != NULL );
+    assert( sim->grid.layout != GRID_LAYOUT_SPARSE );
+
+    int width, height;
+    grid_get_size( &sim->grid, &width, &height );
+    assert( (double) width * height < UINT32_MAX );
+
+    sync->sim = sim;
+    sync->claim_words = ((size_t) width * height * 4 + 63) / 64;
+    sync->claims = calloc( sync->claim_words, sizeof( uint64_t ) );
+    sync->target = malloc( sizeof( uint32_t ) * sim->num_termites );
+    sync->decision = malloc( sizeof( uint8_t ) * sim->num_termites );
+    sync->events = malloc( sizeof( uint8_t ) * sim->num_termites );
+    assert( sync->claims != NULL && sync->target != NULL && sync->decision != NULL && sync->events != NULL );
+    workers_create( &sync->single, 1 );
+    sync->ghosts = NULL;
+    sync->num_ghosts = 0;
+}
+
+
+void synchronous_destroy( struct synchronous *sync )
+{
+    assert( sync != NULL );
+
+    free( sync->claims );
+    free( sync->target );
+    free( sync->decision );
+    free( sync->events );
+    workers_destroy( &sync->single );
+    for( int i = 0; i < sync->num_ghosts; ++i ) {
+	intlist_destroy( &sync->ghosts[ i ] );
+    }
+    free( sync->ghosts );
+    sync->claims = NULL;
+    sync->target = NULL;
+    sync->decision = NULL;
+    sync->events = NULL;
+    sync->ghosts = NULL;
+    sync->num_ghosts = 0;
+}
+
+
+/**
+ * \brief Returns the claim bits of cell c (bit d for direction d).
+ */
+static inline unsigned claims_of( const struct synchronous *sync,
+				  uint32_t c )
+{
+    const size_t bit = (size_t) c << 2;
+    return (sync->claims[ bit >> 6 ] >> (bit & 63)) & 15;
+}
+
+
+/**
+ * \brief Sets or clears the claim bit of direction d on cell c.
+ */
+static inline void claim_bit( struct synchronous *sync,
+			      uint32_t c,
+			      int d,
+			      bool value )
+{
+    const size_t bit = ((size_t) c << 2) + d;
+    if( value ) {
+	__atomic_fetch_or( &sync->claims[ bit >> 6 ], UINT64_C( 1 ) << (bit & 63), __ATOMIC_RELAXED );
+    } else {
+	__atomic_fetch_and( &sync->claims[ bit >> 6 ], ~(UINT64_C( 1 ) << (bit & 63)), __ATOMIC_RELAXED );
+    }
+}
+
+
+/**
+ * \brief Decides the step of termite k (phase one) on a grid with the
+ * given layout, without writing the grid.
+ *
+ * Always inlined with a constant layout, like the rules of
+ * termite_step().
+ */
+static inline void decide( struct synchronous *sync,
+			   const int k,
+			   const unsigned quarters,
+			   const enum grid_layout layout )
+{
+    const struct termite *term = &sync->sim->termites[ k ];
+    const struct grid *grid = &sync->sim->grid;
+    int x, y;
+    termite_get_coords( term, &x, &y );
+    int direction = termite_get_direction( term );
+    bool carry = termite_carries_wood_chip( term );
+    unsigned events = 0;
+
+    /* Turn, then drop or pick up a chip and turn around. */
+    direction = (direction + quarters) % 4;
+    events |= (quarters != 0) * COUNTERS_TURN;
+    const size_t here = grid_index( grid, x, y );
+    const bool chip_here = grid_test( grid->chips, here );
+    const bool chip_ahead = grid_test( grid->chips, grid_neighbor( grid, layout, x, y, here, direction ) );
+    if( carry && chip_ahead ) {
+	carry = false;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_DROP;
+    } else if( ! carry && chip_here ) {
+	carry = true;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_PICKUP;
+    }
+
+    /* Claim the cell ahead, if it is free. Its chip cannot change
+     * during the step, because no termite is there to toggle it.
+     */
+    const size_t ahead = grid_neighbor( grid, layout, x, y, here, direction );
+    bool claim = false;
+    if( grid_test( grid->termites, ahead ) ) {
+	events |= COUNTERS_BLOCKED_BY_TERMITE;
+    } else if( carry && grid_test( grid->chips, ahead ) ) {
+	events |= COUNTERS_BLOCKED_BY_CHIP;
+    } else {
+	int tx = x + grid_dx[ direction ];
+	int ty = y + grid_dy[ direction ];
+	grid_wrap( grid, layout, &tx, &ty );
+	const uint32_t c = (uint32_t) ty * grid->width + tx;
+	sync->target[ k ] = c;
+	claim_bit( sync, c, direction, true );
+	claim = true;
+    }
+    sync->decision[ k ] = (uint8_t) (direction | (carry << 2) | (claim << 3));
+    sync->events[ k ] = (uint8_t) events;
+}
+
+
+/**
+ * \brief Toggles bit k of a plane shared with other workers.
+ */
+static inline void toggle( uint64_t *plane,
+			   size_t k )
+{
+    __atomic_fetch_xor( &plane[ k >> 6 ], UINT64_C( 1 ) << (k & 63), __ATOMIC_RELAXED );
+}
+
+
+/**
+ * \brief Returns true if the cell at (x, y) has ghost copies in the
+ * padded layout.
+ */
+static inline bool on_boundary( const struct grid *grid,
+				int x,
+				int y )
+{
+    return x == 0 || y == 0 || x == grid->width - 1 || y == grid->height - 1;
+}
+
+
+/**
+ * \brief Applies the decision of termite k (phase two).
+ *
+ * \return The events of the step.
+ */
+static inline unsigned apply( struct synchronous *sync,
+			      const int k,
+			      const uint64_t key,
+			      struct intlist *ghosts )
+{
+    struct termite *term = &sync->sim->termites[ k ];
+    struct grid *grid = &sync->sim->grid;
+    const unsigned decision = sync->decision[ k ];
+    const int direction = decision & 3;
+    unsigned events = sync->events[ k ];
+    int x, y;
+    termite_get_coords( term, &x, &y );
+
+    const bool padded = grid->layout == GRID_LAYOUT_PADDED;
+    if( events & (COUNTERS_DROP | COUNTERS_PICKUP) ) {
+	toggle( grid->chips, grid_index( grid, x, y ) );
+	if( padded && on_boundary( grid, x, y ) ) {
+	    intlist_push( ghosts, x );
+	    intlist_push( ghosts, y );
+	}
+    }
+
+    if( decision & 8 ) {
+	/* Move unless a claim from another direction has a higher
+	 * priority.
+	 */
+	const uint32_t c = sync->target[ k ];
+	const unsigned others = claims_of( sync, c ) & ~(1u << direction);
+	bool wins = true;
+	if( others != 0 ) {
+	    const uint64_t mine = synchronous_priority( key, c, direction );
+	    for( int d = 0; d < 4; ++d ) {
+		if( ((others >> d) & 1) && synchronous_priority( key, c, d ) > mine ) {
+		    wins = false;
+		}
+	    }
+	}
+	if( wins ) {
+	    const int tx = (int) (c % (uint32_t) grid->width);
+	    const int ty = (int) (c / (uint32_t) grid->width);
+	    toggle( grid->termites, grid_index( grid, x, y ) );
+	    toggle( grid->termites, grid_index( grid, tx, ty ) );
+	    if( padded && on_boundary( grid, x, y ) ) {
+		intlist_push( ghosts, x );
+		intlist_push( ghosts, y );
+	    }
+	    if( padded && on_boundary( grid, tx, ty ) ) {
+		intlist_push( ghosts, tx );
+		intlist_push( ghosts, ty );
+	    }
+	    x = tx;
+	    y = ty;
+	    events |= COUNTERS_MOVE;
+	} else {
+	    events |= COUNTERS_BLOCKED_BY_TERMITE;
+	}
+    }
+    termite_set_state( term, x, y, direction, (decision >> 2) & 1 );
+    return events;
+}
+
+
+/**
+ * \brief Steps the termites of one worker (a contiguous range of
+ * indices) through both phases.
+ *
+ * \param [in,out] arg The context (struct synchronous_context).
+ *
+ * \param [in] worker The index of the worker.
+ *
+ * \param [in] num_workers The number of workers.
+ */
+static void synchronous_task( void *arg,
+			      int worker,
+			      int num_workers )
+{
+    struct synchronous_context *ctx = (struct synchronous_context*) arg;
+    struct synchronous *sync = ctx->sync;
+    struct simulation *sim = sync->sim;
+    const int begin = (int) ((int64_t) sim->num_termites * worker / num_workers);
+    const int end = (int) ((int64_t) sim->num_termites * (worker + 1) / num_workers);
+    struct counters *counters = &sim->counters[ worker ];
+    struct intlist *log = sim->clusters != NULL ? clusters_log( sim->clusters, worker ) : NULL;
+    struct intlist *ghosts = &sync->ghosts[ worker ];
+
+    /* Phase 1: decide and claim. */
+    rng_fill_turns( sim->seed, begin, sim->step, end - begin, &sim->turns[ begin ] );
+    switch( sim->grid.layout ) {
+    case GRID_LAYOUT_POW2:
+	for( int k = begin; k < end; ++k ) {
+	    decide( sync, k, sim->turns[ k ], GRID_LAYOUT_POW2 );
+	}
+	break;
+    case GRID_LAYOUT_PADDED:
+	for( int k = begin; k < end; ++k ) {
+	    decide( sync, k, sim->turns[ k ], GRID_LAYOUT_PADDED );
+	}
+	break;
+    default:
+	for( int k = begin; k < end; ++k ) {
+	    decide( sync, k, sim->turns[ k ], GRID_LAYOUT_GENERIC );
+	}
+	break;
+    }
+    workers_barrier( ctx->workers );
+
+    /* Phase 2: resolve the claims and write the grid. */
+    for( int k = begin; k < end; ++k ) {
+	const unsigned events = apply( sync, k, ctx->priority_key, ghosts );
+	counters_record( counters, events );
+	if( log != NULL ) {
+	    clusters_record( log, &sim->grid, &sim->termites[ k ], events );
+	}
+    }
+    workers_barrier( ctx->workers );
+
+    /* Withdraw the claims and bring the ghost cells up to date. */
+    for( int k = begin; k < end; ++k ) {
+	if( sync->decision[ k ] & 8 ) {
+	    claim_bit( sync, sync->target[ k ], sync->decision[ k ] & 3, false );
+	}
+    }
+    if( worker == 0 ) {
+	for( int w = 0; w < num_workers; ++w ) {
+	    const struct intlist *list = &sync->ghosts[ w ];
+	    for( int i = 0; i < list->count; i += 2 ) {
+		grid_update_ghosts( &sim->grid, list->items[ i ], list->items[ i + 1 ] );
+	    }
+	    intlist_clear( &sync->ghosts[ w ] );
+	}
+    }
+}
+
+
+void synchronous_step( struct synchronous *sync,
+		       struct workers *workers )
+{
+    assert( sync != NULL );
+
+    if( workers == NULL ) {
+	workers = &sync->single;
+    }
+    assert( workers->num_workers <= sync->sim->num_threads );
+    if( sync->num_ghosts < workers->num_workers ) {
+	sync->ghosts = realloc( sync->ghosts, sizeof( struct intlist ) * workers->num_workers );
+	for( int i = sync->num_ghosts; i < workers->num_workers; ++i ) {
+	    intlist_create( &sync->ghosts[ i ] );
+	}
+	sync->num_ghosts = workers->num_workers;
+    }
+
+    struct synchronous_context ctx = { sync, workers, rng_draw( sync->sim->seed, RNG_STREAM_PRIORITY, sync->sim->step ) };
+    workers_run( workers, synchronous_task, &ctx );
+}
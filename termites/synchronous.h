@@ -0,0 +1,127 @@
+#pragma once
+
+#include "common.h"
+
+#include "intlist.h"
+#include "rng.h"
+#include "workers.h"
+
+
+/**
+ * \brief Represents the state of the synchronous engine.
+ *
+ * Synchronous update.
+ *
+ * The other engines step the termites one after the other, so termite
+ * k sees the moves of termites 0 to k-1. The synchronous engine steps
+ * all termites at once against the grid as it was at the start of
+ * the step, in two phases separated by a barrier.
+ *
+ * In the first phase every termite decides its turn, pick up or drop
+ * and the cell it wants to move to, without writing the grid. A
+ * termite only moves to a cell that is free at the start of the
+ * step, and only toggles the chip of its own cell, so the only
+ * possible conflict is several termites claiming the same free cell
+ * (picking up, dropping and moving never contend for a chip). Every
+ * cell has four claim bits, one per direction of movement, and a
+ * termite claiming a cell sets the bit of the direction it moves in.
+ *
+ * In the second phase every termite applies its decision. Of the
+ * termites claiming one cell, the one whose direction has the highest
+ * priority moves and the others are blocked. The priority is a hash
+ * of the seed, the step, the cell and the direction, so the outcome
+ * is deterministic and does not depend on the number of threads.
+ * Neighboring termites touch the same words of the grid planes, so
+ * the second phase writes them with atomic operations.
+ *
+ * The result differs from that of the sequential engines (a
+ * different update rule, not a different schedule).
+ */
+struct synchronous
+{
+    /** \brief The simulation being stepped. */
+    struct simulation *sim;
+
+    /**
+     * \brief The claim bits, four per cell: bit 4 * c + d is set if a
+     * termite moving in direction d claims cell c (y * width + x).
+     */
+    uint64_t *claims;
+
+    /** \brief The number of words of claims. */
+    size_t claim_words;
+
+    /** \brief The claimed cell (y * width + x) of each termite. */
+    uint32_t *target;
+
+    /**
+     * \brief The decision of each termite: bits 0-1 hold the new
+     * direction, bit 2 the new carry flag, and bit 3 is set if the
+     * termite claimed a cell.
+     */
+    uint8_t *decision;
+
+    /** \brief The events of each termite other than the move or block. */
+    uint8_t *events;
+
+    /** \brief A team of one worker, used if no team is passed. */
+    struct workers single;
+
+    /**
+     * \brief Boundary cells (x followed by y) whose ghost copies are
+     * out of date, one list per worker (padded layout only).
+     */
+    struct intlist *ghosts;
+
+    /** \brief The number of lists in ghosts. */
+    int num_ghosts;
+};
+
+
+/**
+ * \brief Creates the synchronous engine for a simulation.
+ *
+ * The grid must not have the sparse layout.
+ *
+ * \param [out] sync
+ *
+ * \param [in,out] sim
+ */
+void synchronous_create( struct synchronous *sync,
+			 struct simulation *sim );
+
+
+/**
+ * \brief Destroys the engine, releasing all resources.
+ *
+ * \param [in,out] sync
+ */
+void synchronous_destroy( struct synchronous *sync );
+
+
+/**
+ * \brief Advances the simulation one time step with the synchronous
+ * update rule.
+ *
+ * \param [in,out] sync
+ *
+ * \param [in,out] workers The team to step on, with one worker per
+ * thread of the simulation, or NULL to step sequentially.
+ */
+void synchronous_step( struct synchronous *sync,
+		       struct workers *workers );
+
+
+/**
+ * \brief Returns the priority of a claim on cell c (y * width + x)
+ * from direction d in the step with the given key.
+ *
+ * Distinct claims of a step have distinct priorities, because
+ * rng_mix() is a bijection.
+ */
+static inline uint64_t synchronous_priority( uint64_t key,
+					     uint32_t c,
+					     int d )
+{
+    return rng_mix( key ^ (((uint64_t) c << 2) | d) );
+}
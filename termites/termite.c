@@ -10,8 +10,9 @@ void termite_create( struct termite *term,
 {
     assert( term != NULL );
     assert( grid != NULL );
+    assert( x >= 0 && x < TERMITE_MAX_WIDTH );
+    assert( y >= 0 );
 
-    term->grid = grid;
     term->x = x;
     term->y = y;
     term->direction = direction;
@@ -22,6 +23,21 @@ void termite_create( struct termite *term,
 }
 
 
+void termite_restore( struct termite *term,
+		      struct grid *grid,
+		      const int x,
+		      const int y,
+		      const enum direction direction,
+		      const bool carries_chip )
+{
+    assert( term != NULL );
+    assert( grid != NULL );
+    assert( grid_has_termite_at( grid, x, y ) );
+
+    termite_set_state( term, x, y, direction, carries_chip );
+}
+
+
 void termite_destroy( struct termite *term )
 {
     assert( term != NULL );
@@ -49,37 +65,104 @@ void termite_get_coords( const struct termite *term,
 }
 
 
-void termite_step( struct termite *term )
+enum direction termite_get_direction( const struct termite *term )
 {
     assert( term != NULL );
 
+    return term->direction;
+}
+
+
+void termite_set_state( struct termite *term,
+			const int x,
+			const int y,
+			const enum direction direction,
+			const bool carries_chip )
+{
+    assert( term != NULL );
+    assert( x >= 0 && x < TERMITE_MAX_WIDTH );
+    assert( y >= 0 );
+
+    term->x = x;
+    term->y = y;
+    term->direction = direction;
+    term->carries_chip = carries_chip;
+}
+
+
+/**
+ * \brief Turns the termite.
+ *
+ * The turn is close to random, so it is added to the direction
+ * without a branch, which would be mispredicted in about one step out
+ * of five.
+ *
+ * \param [in,out] direction The direction of the termite.
+ *
+ * \param [in] quarters The number of quarter turns to the right (see
+ * rng_turn()).
+ *
+ * \return COUNTERS_TURN if the termite turned, or 0.
+ */
+static inline unsigned turn( unsigned *direction,
+			     const unsigned quarters )
+{
+    (*direction) = ((*direction) + quarters) % 4;
+    return (quarters != 0) * COUNTERS_TURN;
+}
+
+
+/**
+ * \brief Advances the termite one time step on a grid with the given
+ * layout.
+ *
+ * Always inlined with a constant layout by termite_step(), which
+ * yields one copy of the rules specialized for each layout.
+ *
+ * The packed state of the termite is unpacked into locals at the
+ * start and packed again at the end, so that the rules do not read
+ * and write bit fields.
+ *
+ * \param [in,out] term
+ *
+ * \param [in,out] grid
+ *
+ * \param [in] quarters
+ *
+ * \param [in] layout The layout of the grid.
+ *
+ * \return The events of the step (see termite_step()).
+ */
+static inline unsigned step_in_layout( struct termite *term,
+				   struct grid *grid,
+				   const unsigned quarters,
+				   const enum grid_layout layout )
+{
+    int x = term->x;
+    int y = term->y;
+    unsigned direction = term->direction;
+    unsigned events = 0;
+
     /* Change direction.
      *
      * With some probabilities, either stay on the same course, turn
      * left, or turn right.
      */
-    double random = (double) rand( ) / RAND_MAX;
-    if( random < 0.1 ) {
-	term->direction = (term->direction + 3) % 4;
-    } else if( random < 0.2 ) {
-	term->direction = (term->direction + 1) % 4;
-    }
+    events |= turn( &direction, quarters );
 
-    /* Get the coordinates of the cell ahead. */
-    int x, y;
-    grid_get_coords_in_direction( term->grid, term->x, term->y, &x, &y, term->direction );
+    /* Get the index of the termite's cell and of the cell ahead. */
+    const size_t here = grid_index( grid, x, y );
+    size_t ahead = grid_neighbor( grid, layout, x, y, here, direction );
 
     /* Find out if the cell ahead has a chip already. */
-    bool chip_ahead = grid_has_wood_chip_at( term->grid, x, y );
-
-    /* Find out if the cell ahead is already occupied by a termite. */
-    bool termite_ahead = grid_has_termite_at( term->grid, x, y );
+    bool chip_ahead = grid_test( grid->chips, ahead );
 
     /* Find out if the termite carries a chip. */
-    bool carries_chip = term->carries_chip;
+    const bool carried_chip = term->carries_chip;
+    bool carries_chip = carried_chip;
 
     /* Find out if there is a chip at the termite's current location. */
-    bool chip_here = grid_has_wood_chip_at( term->grid, term->x, term->y );
+    bool chip_here = grid_test( grid->chips, here );
 
     /* Drop chip.
      *
@@ -87,10 +170,12 @@ void termite_step( struct termite *term )
      * immediately in front of the termite, then drop the chip and
      * turn 180 degrees.
      */
-    if( carries_chip && chip_ahead ) {
-	grid_place_wood_chip_at( term->grid, term->x, term->y );
-	term->carries_chip = false;
-	term->direction = (term->direction + 2) % 4;
+    if( carried_chip && chip_ahead ) {
+	assert( ! chip_here );
+	grid_assign( grid, layout, grid->chips, x, y, true );
+	carries_chip = false;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_DROP;
     }
 
     /* Pick up chip.
@@ -99,20 +184,20 @@ void termite_step( struct termite *term )
      * time step but is located at a cell with a wood chip, then pick
      * up that wood chip and turn 180 degrees.
      */
-    if( ! carries_chip && chip_here ) {
-	grid_remove_wood_chip_at( term->grid, term->x, term->y );
-	term->carries_chip = true;
-	term->direction = (term->direction + 2) % 4;
+    if( ! carried_chip && chip_here ) {
+	grid_assign( grid, layout, grid->chips, x, y, false );
+	carries_chip = true;
+	direction = (direction + 2) % 4;
+	events |= COUNTERS_PICKUP;
     }
 
     /* The termite might have changed direction as a consequence of
      * the rules above. Therefore, we now need to update the
-     * coordinates and the status information regarding the cell
-     * ahead.
+     * index and the status information regarding the cell ahead.
      */
-    grid_get_coords_in_direction( term->grid, term->x, term->y, &x, &y, term->direction );
-    chip_ahead = grid_has_wood_chip_at( term->grid, x, y );
-    termite_ahead = grid_has_termite_at( term->grid, x, y );
+    ahead = grid_neighbor( grid, layout, x, y, here, direction );
+    chip_ahead = grid_test( grid->chips, ahead );
+    const bool termite_ahead = grid_test( grid->termites, ahead );
 
     /* Move forward.
      *
@@ -127,10 +212,99 @@ void termite_step( struct termite *term )
      *    rule being applied in this time step) and there is a wood
      *    chip ahead.
      */
-    if( ! termite_ahead && ! (term->carries_chip && chip_ahead) ) {
-	grid_remove_termite_at( term->grid, term->x, term->y );
-	term->x = x;
-	term->y = y;
-	grid_place_termite_at( term->grid, term->x, term->y );
+    if( termite_ahead ) {
+	events |= COUNTERS_BLOCKED_BY_TERMITE;
+    } else if( carries_chip && chip_ahead ) {
+	events |= COUNTERS_BLOCKED_BY_CHIP;
+    } else {
+	int ax = x + grid_dx[ direction ];
+	int ay = y + grid_dy[ direction ];
+	grid_wrap( grid, layout, &ax, &ay );
+	grid_assign( grid, layout, grid->termites, x, y, false );
+	x = ax;
+	y = ay;
+	grid_assign( grid, layout, grid->termites, x, y, true );
+	events |= COUNTERS_MOVE;
+    }
+    termite_set_state( term, x, y, direction, carries_chip );
+    return events;
+}
+
+
+/**
+ * \brief Advances the termite one time step on a grid with the sparse
+ * layout.
+ *
+ * Implements the same rules as step_in_layout(), but goes through the
+ * grid functions because a sparse grid has no planes.
+ *
+ * \param [in,out] term
+ *
+ * \param [in,out] grid
+ *
+ * \param [in] quarters
+ *
+ * \return The events of the step (see termite_step()).
+ */
+static unsigned step_sparse( struct termite *term,
+			     struct grid *grid,
+			     const unsigned quarters )
+{
+    unsigned events = 0;
+
+    /* Change direction. */
+    unsigned direction = term->direction;
+    events |= turn( &direction, quarters );
+    term->direction = direction;
+
+    int ax, ay;
+    grid_get_coords_in_direction( grid, term->x, term->y, &ax, &ay, term->direction );
+    if( term->carries_chip && grid_has_wood_chip_at( grid, ax, ay ) ) {
+	/* Drop chip. */
+	grid_place_wood_chip_at( grid, term->x, term->y );
+	term->carries_chip = false;
+	term->direction = (term->direction + 2) % 4;
+	events |= COUNTERS_DROP;
+    } else if( ! term->carries_chip && grid_has_wood_chip_at( grid, term->x, term->y ) ) {
+	/* Pick up chip. */
+	grid_remove_wood_chip_at( grid, term->x, term->y );
+	term->carries_chip = true;
+	term->direction = (term->direction + 2) % 4;
+	events |= COUNTERS_PICKUP;
+    }
+
+    /* Move forward. */
+    grid_get_coords_in_direction( grid, term->x, term->y, &ax, &ay, term->direction );
+    if( grid_has_termite_at( grid, ax, ay ) ) {
+	events |= COUNTERS_BLOCKED_BY_TERMITE;
+    } else if( term->carries_chip && grid_has_wood_chip_at( grid, ax, ay ) ) {
+	events |= COUNTERS_BLOCKED_BY_CHIP;
+    } else {
+	grid_place_termite_at( grid, ax, ay );
+	grid_remove_termite_at( grid, term->x, term->y );
+	term->x = ax;
+	term->y = ay;
+	events |= COUNTERS_MOVE;
+    }
+    return events;
+}
+
+
+unsigned termite_step( struct termite *term,
+		       struct grid *grid,
+		       const unsigned quarters )
+{
+    assert( term != NULL );
+    assert( grid != NULL );
+
+    switch( grid->layout ) {
+    case GRID_LAYOUT_POW2:
+	return step_in_layout( term, grid, quarters, GRID_LAYOUT_POW2 );
+    case GRID_LAYOUT_PADDED:
+	return step_in_layout( term, grid, quarters, GRID_LAYOUT_PADDED );
+    case GRID_LAYOUT_SPARSE:
+	return step_sparse( term, grid, quarters );
+    default:
+	return step_in_layout( term, grid, quarters, GRID_LAYOUT_GENERIC );
     }
 }
@@ -2,31 +2,41 @@
 
 #include "common.h"
 
+#include "counters.h"
 #include "grid.h"
+#include "rng.h"
+
+
+/** \brief The grids that termites wander in are narrower than this. */
+#define TERMITE_MAX_WIDTH (1 << 30)
 
 
 /**
  * \brief Represents the state of a termite.
  * 
  * A termite has a position, an orientation, and might carry a wood
- * chip.
+ * chip. The state is packed into 8 bytes, so that many termites fit
+ * in the cache. The grid in which the termite wanders is not part of
+ * the state; it is passed to the functions that need it.
+ *
+ * The position is kept as coordinates rather than as an index of a
+ * cell, because the index depends on the layout of the grid (and
+ * sparse grids have none), while the coordinates are what the engines,
+ * the statistics and the snapshots need.
  */
 struct termite
 {
-    /** \brief The grid in which the termite wanders. */
-    struct grid *grid;
+    /** \brief The x-coordinate (less than TERMITE_MAX_WIDTH). */
+    unsigned x : 30;
 
-    /** \brief the x-coordinate. */
-    int x;
+    /** \brief The orientation. */
+    unsigned direction : 2;
 
     /** \brief The y-coordinate. */
-    int y;
-
-    /** \brief The orientation. */
-    enum direction direction;
+    unsigned y : 31;
 
-    /** \brief Flag that is true if the termite carries a wood chip. */
-    bool carries_chip;
+    /** \brief Flag that is set if the termite carries a wood chip. */
+    unsigned carries_chip : 1;
 };
 
 
@@ -52,6 +62,32 @@ void termite_create( struct termite *term,
 		     enum direction direction );
 
 
+/**
+ * \brief Recreates a termite from a saved state.
+ *
+ * Unlike termite_create(), the termite is not placed on the grid,
+ * which is assumed to already record it.
+ *
+ * \param [out] term The termite to create.
+ *
+ * \param [in,out] grid The grid in which the termite wanders.
+ *
+ * \param [in] x The x-coordinate.
+ *
+ * \param [in] y The y-coordinate.
+ *
+ * \param [in] direction The direction.
+ *
+ * \param [in] carries_chip True if the termite carries a wood chip.
+ */
+void termite_restore( struct termite *term,
+		      struct grid *grid,
+		      int x,
+		      int y,
+		      enum direction direction,
+		      bool carries_chip );
+
+
 /**
  * \brief Destroys a termite.
  *
@@ -64,8 +100,18 @@ void termite_destroy( struct termite *term );
  * \brief Advances the termite one time step.
  *
  * \param [in,out] term
+ *
+ * \param [in,out] grid The grid in which the termite wanders.
+ *
+ * \param [in] quarters The number of quarter turns to the right
+ * before the step, as drawn by rng_turn().
+ *
+ * \return The events of the step, a combination of counters_event
+ * flags (see counters_record()).
  */
-void termite_step( struct termite *term );
+unsigned termite_step( struct termite *term,
+		       struct grid *grid,
+		       unsigned quarters );
 
 
 /**
@@ -90,3 +136,36 @@ bool termite_carries_wood_chip( const struct termite *term );
 void termite_get_coords( const struct termite *term,
 			 int *x, 
 			 int *y );
+
+
+/**
+ * \brief Returns the direction of the termite.
+ *
+ * \param [in] term
+ *
+ * \return The direction the termite is facing.
+ */
+enum direction termite_get_direction( const struct termite *term );
+
+
+/**
+ * \brief Overwrites the state of the termite.
+ *
+ * The grid is not updated; the caller is responsible for keeping
+ * the grid consistent with the termite.
+ *
+ * \param [in,out] term
+ *
+ * \param [in] x The x-coordinate.
+ *
+ * \param [in] y The y-coordinate.
+ *
+ * \param [in] direction The direction.
+ *
+ * \param [in] carries_chip True if the termite carries a wood chip.
+ */
+void termite_set_state( struct termite *term,
+			int x,
+			int y,
+			enum direction direction,
+			bool carries_chip );
@@ -0,0 +1,297 @@
+#include "tiles.h"
+
+#include "simulation.h"
+
+
+/**
+ * \brief The context of a step shared by all workers.
+ */
+struct tiles_context
+{
+    /** \brief The decomposition. */
+    struct tiles *tiles;
+
+    /** \brief The team stepping the simulation. */
+    struct workers *workers;
+};
+
+
+/**
+ * \brief Returns the number of tiles to split a side of the grid into:
+ * even (or 1) with parts of at least the given size and about the
+ * preferred size.
+ */
+static int split( int size,
+		  int preferred,
+		  int minimum )
+{
+    int count = (size / preferred) & ~1;
+    if( count < 2 ) {
+	count = 2;
+    }
+    while( count >= 2 && size / count < minimum ) {
+	count -= 2;
+    }
+    return count >= 2 ? count : 1;
+}
+
+
+/**
+ * \brief Maps each cell of a side to the part it falls in.
+ */
+static int *map_parts( int size,
+		       int count )
+{
+    int *part = malloc( sizeof( int ) * size );
+    assert( part != NULL );
+    for( int i = 0; i < count; ++i ) {
+	const int begin = (int) ((int64_t) size * i / count);
+	const int end = (int) ((int64_t) size * (i + 1) / count);
+	for( int k = begin; k < end; ++k ) {
+	    part[ k ] = i;
+	}
+    }
+    return part;
+}
+
+
+void tiles_create( struct tiles *tiles,
+		   struct simulation *sim )
+{
+    assert( tiles != NULL );
+    assert( sim != NULL );
+    assert( sim->grid.layout != GRID_LAYOUT_SPARSE );
+
+    int width, height;
+    grid_get_size( &sim->grid, &width, &height );
+
+    /* Two tiles of one color are one tile apart, of which a termite
+     * touches the cells next to its edges, so the untouched cells in
+     * between must span at least 63 bits: 65 columns, or 2 rows plus
+     * enough rows for 63 bits (see min_half_rows() in strips.c).
+     */
+    tiles->sim = sim;
+    tiles->tiles_x = split( width, TILES_WIDTH, 65 );
+    tiles->tiles_y = split( height, TILES_HEIGHT, 2 + (63 + width - 1) / width );
+    tiles->tile_x = map_parts( width, tiles->tiles_x );
+    tiles->tile_y = map_parts( height, tiles->tiles_y );
+
+    const int num_tiles = tiles->tiles_x * tiles->tiles_y;
+    tiles->tile_of = malloc( sizeof( int ) * sim->num_termites );
+    tiles->start = malloc( sizeof( int ) * (num_tiles + 1) );
+    tiles->members = malloc( sizeof( int ) * sim->num_termites );
+    assert( tiles->tile_of != NULL && tiles->start != NULL && tiles->members != NULL );
+    tiles->histogram = NULL;
+    tiles->deques = NULL;
+    tiles->capacity = 0;
+    workers_create( &tiles->single, 1 );
+}
+
+
+void tiles_destroy( struct tiles *tiles )
+{
+    assert( tiles != NULL );
+
+    free( tiles->tile_x );
+    free( tiles->tile_y );
+    free( tiles->tile_of );
+    free( tiles->start );
+    free( tiles->members );
+    free( tiles->histogram );
+    for( int w = 0; w < tiles->capacity; ++w ) {
+	free( tiles->deques[ w ].items );
+    }
+    free( tiles->deques );
+    workers_destroy( &tiles->single );
+    tiles->tile_x = NULL;
+    tiles->tile_y = NULL;
+    tiles->tile_of = NULL;
+    tiles->start = NULL;
+    tiles->members = NULL;
+    tiles->histogram = NULL;
+    tiles->deques = NULL;
+    tiles->capacity = 0;
+}
+
+
+/**
+ * \brief Takes a tile from the front of a deque (the owner's end).
+ *
+ * \return The tile, or -1 if the deque is empty.
+ */
+static int take_front( struct tiles_deque *deque )
+{
+    uint64_t range = __atomic_load_n( &deque->range, __ATOMIC_ACQUIRE );
+    while( (uint32_t) range < (uint32_t) (range >> 32) ) {
+	if( __atomic_compare_exchange_n( &deque->range, &range, range + 1, false,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) {
+	    return deque->items[ (uint32_t) range ];
+	}
+    }
+    return -1;
+}
+
+
+/**
+ * \brief Steals a tile from the back of a deque.
+ *
+ * \return The tile, or -1 if the deque is empty.
+ */
+static int take_back( struct tiles_deque *deque )
+{
+    uint64_t range = __atomic_load_n( &deque->range, __ATOMIC_ACQUIRE );
+    while( (uint32_t) range < (uint32_t) (range >> 32) ) {
+	if( __atomic_compare_exchange_n( &deque->range, &range, range - (UINT64_C( 1 ) << 32), false,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) {
+	    return deque->items[ (uint32_t) (range >> 32) - 1 ];
+	}
+    }
+    return -1;
+}
+
+
+/**
+ * \brief Steps the termites of one tile.
+ */
+static void step_tile( struct tiles *tiles,
+		       int tile,
+		       struct counters *counters,
+		       struct intlist *log )
+{
+    struct simulation *sim = tiles->sim;
+    for( int i = tiles->start[ tile ]; i < tiles->start[ tile + 1 ]; ++i ) {
+	const int k = tiles->members[ i ];
+	const unsigned events = termite_step( &sim->termites[ k ], &sim->grid, sim->turns[ k ] );
+	counters_record( counters, events );
+	if( log != NULL ) {
+	    clusters_record( log, &sim->grid, &sim->termites[ k ], events );
+	}
+    }
+}
+
+
+/**
+ * \brief Sorts the termites by tile and steps the tiles color by color.
+ *
+ * \param [in,out] arg The context (struct tiles_context).
+ *
+ * \param [in] worker The index of the worker.
+ *
+ * \param [in] num_workers The number of workers.
+ */
+static void tiles_task( void *arg,
+			int worker,
+			int num_workers )
+{
+    struct tiles_context *ctx = (struct tiles_context*) arg;
+    struct tiles *tiles = ctx->tiles;
+    struct simulation *sim = tiles->sim;
+    const int num_tiles = tiles->tiles_x * tiles->tiles_y;
+    const int begin = (int) ((int64_t) sim->num_termites * worker / num_workers);
+    const int end = (int) ((int64_t) sim->num_termites * (worker + 1) / num_workers);
+    int *histogram = &tiles->histogram[ (size_t) worker * num_tiles ];
+    struct counters *counters = &sim->counters[ worker ];
+    struct intlist *log = sim->clusters != NULL ? clusters_log( sim->clusters, worker ) : NULL;
+
+    /* Sort the termites by tile with a counting sort: every worker
+     * counts its chunk, the counts are turned into disjoint output
+     * ranges, and every worker scatters its chunk (see reorder.c).
+     */
+    rng_fill_turns( sim->seed, begin, sim->step, end - begin, &sim->turns[ begin ] );
+    memset( histogram, 0, sizeof( int ) * num_tiles );
+    for( int k = begin; k < end; ++k ) {
+	int x, y;
+	termite_get_coords( &sim->termites[ k ], &x, &y );
+	const int tile = tiles->tile_y[ y ] * tiles->tiles_x + tiles->tile_x[ x ];
+	tiles->tile_of[ k ] = tile;
+	++histogram[ tile ];
+    }
+    workers_barrier( ctx->workers );
+    if( worker == 0 ) {
+	int position = 0;
+	for( int t = 0; t < num_tiles; ++t ) {
+	    tiles->start[ t ] = position;
+	    for( int w = 0; w < num_workers; ++w ) {
+		const int count = tiles->histogram[ (size_t) w * num_tiles + t ];
+		tiles->histogram[ (size_t) w * num_tiles + t ] = position;
+		position += count;
+	    }
+	}
+	tiles->start[ num_tiles ] = position;
+    }
+    workers_barrier( ctx->workers );
+    for( int k = begin; k < end; ++k ) {
+	tiles->members[ histogram[ tiles->tile_of[ k ] ]++ ] = k;
+    }
+
+    /* Step the tiles color by color. */
+    struct tiles_deque *own = &tiles->deques[ worker ];
+    for( int color = 0; color < 4; ++color ) {
+	/* Deal out this worker's share of the occupied tiles. */
+	const int cx = color & 1;
+	const int cy = color >> 1;
+	const int across = (tiles->tiles_x - cx + 1) / 2;
+	const int down = (tiles->tiles_y - cy + 1) / 2;
+	const int first = (int) ((int64_t) across * down * worker / num_workers);
+	const int last = (int) ((int64_t) across * down * (worker + 1) / num_workers);
+	uint32_t count = 0;
+	for( int i = first; i < last; ++i ) {
+	    const int tile = (cy + 2 * (i / across)) * tiles->tiles_x + cx + 2 * (i % across);
+	    if( tiles->start[ tile + 1 ] > tiles->start[ tile ] ) {
+		own->items[ count++ ] = tile;
+	    }
+	}
+	__atomic_store_n( &own->range, (uint64_t) count << 32, __ATOMIC_RELEASE );
+	workers_barrier( ctx->workers );
+
+	/* Work through the own deque, then steal. */
+	int tile;
+	while( (tile = take_front( own )) >= 0 ) {
+	    step_tile( tiles, tile, counters, log );
+	}
+	for( int v = 1; v < num_workers; ++v ) {
+	    struct tiles_deque *victim = &tiles->deques[ (worker + v) % num_workers ];
+	    while( (tile = take_back( victim )) >= 0 ) {
+		step_tile( tiles, tile, counters, log );
+	    }
+	}
+	workers_barrier( ctx->workers );
+    }
+}
+
+
+void tiles_step( struct tiles *tiles,
+		 struct workers *workers )
+{
+    assert( tiles != NULL );
+
+    if( workers == NULL ) {
+	workers = &tiles->single;
+    }
+    assert( workers->num_workers <= tiles->sim->num_threads );
+
+    /* Make room for the counts and deques of every worker. */
+    const int num_tiles = tiles->tiles_x * tiles->tiles_y;
+    if( tiles->capacity < workers->num_workers ) {
+	for( int w = 0; w < tiles->capacity; ++w ) {
+	    free( tiles->deques[ w ].items );
+	}
+	free( tiles->deques );
+	free( tiles->histogram );
+	tiles->capacity = workers->num_workers;
+	tiles->histogram = malloc( sizeof( int ) * num_tiles * tiles->capacity );
+	void *memory = NULL;
+	if( posix_memalign( &memory, 64, sizeof( struct tiles_deque ) * tiles->capacity ) != 0 ) {
+	    memory = NULL;
+	}
+	tiles->deques = (struct tiles_deque*) memory;
+	assert( tiles->histogram != NULL && tiles->deques != NULL );
+	for( int w = 0; w < tiles->capacity; ++w ) {
+	    tiles->deques[ w ].range = 0;
+	    tiles->deques[ w ].items = malloc( sizeof( int ) * num_tiles );
+	}
+    }
+
+    struct tiles_context ctx = { tiles, workers };
+    workers_run( workers, tiles_task, &ctx );
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "common.h"
+
+#include "workers.h"
+
+
+/** \brief The preferred width of a tile (in cells). */
+#define TILES_WIDTH 128
+
+/** \brief The preferred height of a tile (in cells). */
+#define TILES_HEIGHT 32
+
+
+/**
+ * \brief A deque of tiles of one worker for one phase.
+ *
+ * The owner takes tiles from the front and other workers steal them
+ * from the back. Both ends are packed into one word updated with
+ * compare-and-swap, so a tile is taken exactly once. Tiles are only
+ * added before the phase starts.
+ */
+struct tiles_deque
+{
+    /** \brief The front (low 32 bits) and the back (high 32 bits). */
+    uint64_t range;
+
+    /** \brief The tiles. */
+    int *items;
+
+    /** \brief Keeps the deques of different workers on different cache lines. */
+    char padding[ 64 - sizeof( uint64_t ) - sizeof( int* ) ];
+};
+
+
+/**
+ * \brief Represents a decomposition of the grid into small tiles that
+ * are stepped by a team of workers with work stealing.
+ *
+ * Four-coloring.
+ *
+ * Tile (tx, ty) has color (tx mod 2) + 2 (ty mod 2), and the number of
+ * tiles across and down is even (or 1), so tiles of one color are
+ * never adjacent, also across the periodic boundaries. A step runs
+ * four phases, one per color, separated by barriers. A termite only
+ * touches the cells within distance one of its own, and the tiles are
+ * at least 65 cells wide and tall enough (see strips) that the cells
+ * touched by two tiles of one color never share a word of the grid
+ * planes, so the tiles of a phase can be stepped in any order and on
+ * any worker without locks.
+ *
+ * Every tile steps the termites it holds at the start of the step, in
+ * the order of their indices. The result is therefore deterministic
+ * and does not depend on the number of workers or on which worker
+ * stepped which tile, but it differs from that of the scalar engine.
+ *
+ * Load balancing.
+ *
+ * The termites gather around the chip piles, so the tiles hold very
+ * different numbers of termites. At the start of each phase the
+ * occupied tiles of the color are dealt out to the deques of the
+ * workers, and a worker whose deque runs empty steals from the
+ * others.
+ */
+struct tiles
+{
+    /** \brief The simulation being stepped. */
+    struct simulation *sim;
+
+    /** \brief The number of tiles across. */
+    int tiles_x;
+
+    /** \brief The number of tiles down. */
+    int tiles_y;
+
+    /** \brief The column of tiles of each column of the grid. */
+    int *tile_x;
+
+    /** \brief The row of tiles of each row of the grid. */
+    int *tile_y;
+
+    /** \brief The tile of each termite (y * tiles_x + x). */
+    int *tile_of;
+
+    /**
+     * \brief The termites of tile t are members[ start[ t ] ] to
+     * members[ start[ t + 1 ] - 1 ], in the order of their indices.
+     */
+    int *start;
+
+    /** \brief The termites sorted by tile. */
+    int *members;
+
+    /** \brief The number of termites of each worker in each tile. */
+    int *histogram;
+
+    /** \brief The number of workers histogram and deques have room for. */
+    int capacity;
+
+    /** \brief The deques, one per worker. */
+    struct tiles_deque *deques;
+
+    /** \brief A team of one worker, used if no team is passed. */
+    struct workers single;
+};
+
+
+/**
+ * \brief Decomposes the grid of a simulation into tiles.
+ *
+ * The grid must not have the sparse layout.
+ *
+ * \param [out] tiles
+ *
+ * \param [in,out] sim
+ */
+void tiles_create( struct tiles *tiles,
+		   struct simulation *sim );
+
+
+/**
+ * \brief Destroys a decomposition, releasing all resources.
+ *
+ * \param [in,out] tiles
+ */
+void tiles_destroy( struct tiles *tiles );
+
+
+/**
+ * \brief Advances the simulation one time step, tile by tile.
+ *
+ * \param [in,out] tiles
+ *
+ * \param [in,out] workers The team to step on, with one worker per
+ * thread of the simulation, or NULL to step sequentially.
+ */
+void tiles_step( struct tiles *tiles,
+		 struct workers *workers );
@@ -1,7 +1,6 @@
 #pragma once
 
 
-struct cell;
 struct termite;
 struct grid;
 struct simulation;
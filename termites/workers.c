@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+
+#include <sched.h>
+
+#include "workers.h"
+
+
+/** \brief The CPUs to pin the workers to (see workers_set_cpus()). */
+static int pinned_cpus[ CPU_SETSIZE ];
+
+/** \brief The number of CPUs to pin the workers to (0 = OFF). */
+static int num_pinned_cpus = 0;
+
+
+/**
+ * \brief Pins a thread to one CPU.
+ *
+ * \return True on success.
+ */
+static bool pin( pthread_t thread,
+		 int cpu )
+{
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+    return pthread_setaffinity_np( thread, sizeof( set ), &set ) == 0;
+}
+
+
+/**
+ * \brief The main loop of the worker threads.
+ *
+ * Each round starts and ends with a barrier: the first one releases
+ * the task posted by workers_run() and the second one signals that
+ * the task is done.
+ *
+ * \param [in,out] arg The worker thread.
+ *
+ * \return Always NULL.
+ */
+static void *worker_main( void *arg )
+{
+    struct worker_thread *self = (struct worker_thread*) arg;
+    struct workers *workers = self->workers;
+
+    for( ;; ) {
+	pthread_barrier_wait( &workers->barrier );
+	if( workers->quit ) {
+	    break;
+	}
+	workers->task( workers->arg, self->worker, workers->num_workers );
+	pthread_barrier_wait( &workers->barrier );
+    }
+    return NULL;
+}
+
+
+void workers_create( struct workers *workers,
+		     const int num_workers )
+{
+    assert( workers != NULL );
+    assert( num_workers > 0 );
+
+    workers->num_workers = num_workers;
+    workers->task = NULL;
+    workers->arg = NULL;
+    workers->quit = false;
+    pthread_barrier_init( &workers->barrier, NULL, num_workers );
+    workers->threads = NULL;
+    if( num_workers > 1 ) {
+	workers->threads = malloc( sizeof( struct worker_thread ) * (num_workers - 1) );
+	assert( workers->threads != NULL );
+	for( int k = 1; k < num_workers; ++k ) {
+	    struct worker_thread *t = &workers->threads[ k - 1 ];
+	    t->workers = workers;
+	    t->worker = k;
+	    const int error = pthread_create( &t->thread, NULL, worker_main, t );
+	    assert( error == 0 );
+	    (void) error;
+	    if( num_pinned_cpus > 0 ) {
+		pin( t->thread, pinned_cpus[ k % num_pinned_cpus ] );
+	    }
+	}
+    }
+}
+
+
+void workers_destroy( struct workers *workers )
+{
+    assert( workers != NULL );
+
+    if( workers->num_workers > 1 ) {
+	workers->quit = true;
+	pthread_barrier_wait( &workers->barrier );
+	for( int k = 1; k < workers->num_workers; ++k ) {
+	    pthread_join( workers->threads[ k - 1 ].thread, NULL );
+	}
+    }
+    free( workers->threads );
+    workers->threads = NULL;
+    pthread_barrier_destroy( &workers->barrier );
+    workers->num_workers = 0;
+}
+
+
+void workers_run( struct workers *workers,
+		  workers_task task,
+		  void *arg )
+{
+    assert( workers != NULL );
+    assert( task != NULL );
+
+    if( workers->num_workers == 1 ) {
+	task( arg, 0, 1 );
+	return;
+    }
+
+    workers->task = task;
+    workers->arg = arg;
+    pthread_barrier_wait( &workers->barrier );
+    task( arg, 0, workers->num_workers );
+    pthread_barrier_wait( &workers->barrier );
+}
+
+
+void workers_barrier( struct workers *workers )
+{
+    assert( workers != NULL );
+
+    if( workers->num_workers > 1 ) {
+	pthread_barrier_wait( &workers->barrier );
+    }
+}
+
+
+bool workers_set_cpus( const int *cpus,
+		       const int num_cpus )
+{
+    assert( cpus != NULL || num_cpus == 0 );
+    assert( num_cpus >= 0 && num_cpus <= CPU_SETSIZE );
+
+    cpu_set_t available;
+    if( sched_getaffinity( 0, sizeof( available ), &available ) != 0 ) {
+	return false;
+    }
+    for( int k = 0; k < num_cpus; ++k ) {
+	if( cpus[ k ] < 0 || cpus[ k ] >= CPU_SETSIZE || ! CPU_ISSET( cpus[ k ], &available ) ) {
+	    return false;
+	}
+    }
+    memcpy( pinned_cpus, cpus, sizeof( int ) * num_cpus );
+    num_pinned_cpus = num_cpus;
+    return num_cpus == 0 || pin( pthread_self( ), cpus[ 0 ] );
+}
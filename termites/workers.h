@@ -0,0 +1,128 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "common.h"
+
+
+/**
+ * \brief The signature of a task run by a team of workers.
+ *
+ * \param [in,out] arg The argument passed to workers_run().
+ *
+ * \param [in] worker The index of the calling worker (0-based).
+ *
+ * \param [in] num_workers The number of workers in the team.
+ */
+typedef void (*workers_task)( void *arg, int worker, int num_workers );
+
+
+/**
+ * \brief Represents one worker thread of a team.
+ */
+struct worker_thread
+{
+    /** \brief The team the thread belongs to. */
+    struct workers *workers;
+
+    /** \brief The index of the worker (1-based, 0 is the caller). */
+    int worker;
+
+    /** \brief The thread handle. */
+    pthread_t thread;
+};
+
+
+/**
+ * \brief Represents a persistent team of worker threads.
+ *
+ * The calling thread acts as worker 0, so a team of N workers owns
+ * N-1 threads. The threads are created once and then sleep on a
+ * barrier between tasks, which keeps the cost of running a task on
+ * the whole team down to two barrier synchronizations.
+ */
+struct workers
+{
+    /** \brief The number of workers (including the calling thread). */
+    int num_workers;
+
+    /** \brief The threads of workers 1 to num_workers-1. */
+    struct worker_thread *threads;
+
+    /** \brief Barrier shared by all workers. */
+    pthread_barrier_t barrier;
+
+    /** \brief The task currently being run. */
+    workers_task task;
+
+    /** \brief The argument of the task currently being run. */
+    void *arg;
+
+    /** \brief Flag that is true when the threads should exit. */
+    bool quit;
+};
+
+
+/**
+ * \brief Creates a team of workers.
+ *
+ * \param [out] workers
+ *
+ * \param [in] num_workers The number of workers (at least 1).
+ */
+void workers_create( struct workers *workers,
+		     int num_workers );
+
+
+/**
+ * \brief Destroys a team of workers, joining all threads.
+ *
+ * \param [in,out] workers
+ */
+void workers_destroy( struct workers *workers );
+
+
+/**
+ * \brief Runs a task on every worker and waits for all of them.
+ *
+ * \param [in,out] workers
+ *
+ * \param [in] task The task to run.
+ *
+ * \param [in,out] arg The argument passed to the task.
+ */
+void workers_run( struct workers *workers,
+		  workers_task task,
+		  void *arg );
+
+
+/**
+ * \brief Waits until all workers have reached the barrier.
+ *
+ * Must only be called from within a task, and then by every worker.
+ *
+ * \param [in,out] workers
+ */
+void workers_barrier( struct workers *workers );
+
+
+/**
+ * \brief Pins the workers of the teams created from now on to CPUs.
+ *
+ * Worker k of a team runs on CPU cpus[ k % num_cpus ], and the calling
+ * thread, which is worker 0 of the teams it creates, is pinned to
+ * cpus[ 0 ] right away. Since every team maps its workers alike, the
+ * worker that first touches a band of the grid (see
+ * grid_first_touch()) stays on the node of the worker that later
+ * steps it. The setting applies to the whole process; num_cpus = 0
+ * turns pinning off for new teams.
+ *
+ * \param [in] cpus The CPUs.
+ *
+ * \param [in] num_cpus The number of CPUs (at most CPU_SETSIZE).
+ *
+ * \return False if a CPU is not available to the process, in which
+ * case nothing is pinned.
+ */
+bool workers_set_cpus( const int *cpus,
+		       int num_cpus );